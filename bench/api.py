@@ -0,0 +1,239 @@
+"""SkipDict compared with dict, SortedList and heapq.
+
+Times building, score updates, lookups, rank queries, range scans,
+histograms, top-k reads, full scans (one item at a time and in
+batches) and copies with ``SkipDict`` and, where they support the operation,
+with a plain ``dict``, a ``sortedcontainers.SortedList`` of ``(score,
+key)`` pairs kept next to a dict, and ``heapq.nlargest`` over a dict.
+The scores, keys and operation sequences are seeded; each result is
+the best of a number of repeats, printed as one JSON object per line.
+
+Usage::
+
+  python bench/api.py --size 100000 --repeat 3
+"""
+
+import argparse
+import bisect
+import heapq
+import json
+import time
+
+from operator import itemgetter
+from random import Random
+
+from skipdict import SkipDict
+
+# Keys per call for the batched benchmarks; their "ops" count keys.
+BATCH = 100
+
+try:
+    from sortedcontainers import SortedList
+except ImportError:
+    SortedList = None
+
+
+class SkipDictImpl(object):
+    name = "skipdict"
+
+    def build(self, items):
+        self.skipdict = SkipDict(items)
+
+    def update(self, key, score):
+        self.skipdict[key] = score
+
+    def lookup(self, key):
+        return self.skipdict[key]
+
+    def rank(self, key):
+        return self.skipdict.index(key)
+
+    def rank_many(self, keys):
+        return self.skipdict.index_many(keys)
+
+    def range(self, low, high):
+        return list(self.skipdict.keys(low, high))
+
+    def top(self, k):
+        return list(self.skipdict.items()[-k:])
+
+    def histogram(self, edges):
+        return self.skipdict.histogram(edges)
+
+    def scan(self):
+        return sum(1 for item in self.skipdict.items())
+
+    def export(self):
+        return sum(len(batch) for batch in self.skipdict.iter_batches(1000))
+
+    def copy(self):
+        return self.skipdict.copy()
+
+
+class DictImpl(object):
+    name = "dict"
+
+    def build(self, items):
+        self.dict = dict(items)
+
+    def update(self, key, score):
+        self.dict[key] = score
+
+    def lookup(self, key):
+        return self.dict[key]
+
+    def histogram(self, edges):
+        counts = [0] * (len(edges) - 1)
+        for score in self.dict.values():
+            i = bisect.bisect_right(edges, score) - 1
+            if 0 <= i < len(counts):
+                counts[i] += 1
+            elif score == edges[-1]:
+                counts[-1] += 1
+        return counts
+
+    def copy(self):
+        return self.dict.copy()
+
+
+class SortedListImpl(object):
+    name = "sortedlist"
+
+    def build(self, items):
+        self.dict = dict(items)
+        self.list = SortedList((score, key) for key, score in items)
+
+    def update(self, key, score):
+        old = self.dict.get(key)
+        if old is not None:
+            self.list.remove((old, key))
+        self.dict[key] = score
+        self.list.add((score, key))
+
+    def lookup(self, key):
+        return self.dict[key]
+
+    def rank(self, key):
+        return self.list.index((self.dict[key], key))
+
+    def rank_many(self, keys):
+        return [self.rank(key) for key in keys]
+
+    def range(self, low, high):
+        return [key for score, key in self.list.irange((low, ), (high, ))]
+
+    def top(self, k):
+        return [(key, score) for score, key in self.list[-k:]]
+
+    def histogram(self, edges):
+        # The scores are all below the last edge.
+        ranks = [self.list.bisect_left((edge, )) for edge in edges]
+        return [high - low for low, high in zip(ranks, ranks[1:])]
+
+    def scan(self):
+        return sum(1 for score, key in self.list)
+
+    def copy(self):
+        return self.dict.copy(), self.list.copy()
+
+
+class HeapqImpl(object):
+    name = "heapq"
+
+    def build(self, items):
+        self.dict = dict(items)
+
+    def update(self, key, score):
+        self.dict[key] = score
+
+    def lookup(self, key):
+        return self.dict[key]
+
+    def top(self, k):
+        return heapq.nlargest(k, self.dict.items(), key=itemgetter(1))
+
+
+def timed(fn, args, repeat):
+    best = None
+    for _ in range(repeat):
+        started = time.perf_counter()
+        for arg in args:
+            fn(*arg)
+        elapsed = time.perf_counter() - started
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def benchmarks(size, seed):
+    rnd = Random(seed)
+    keys = ["key%d" % i for i in range(size)]
+    items = [(key, rnd.random() * size) for key in keys]
+    picks = [(keys[rnd.randrange(size)], ) for _ in range(size)]
+    updates = [
+        (keys[rnd.randrange(size)], rnd.random() * size)
+        for _ in range(size)
+    ]
+    ranges = []
+    for _ in range(size // 100):
+        low = rnd.random() * size
+        ranges.append((low, low + 100.0))
+    batches = [
+        ([key for key, in picks[i:i + BATCH]], )
+        for i in range(0, size // 10, BATCH)
+    ]
+    tops = [(100, )] * 100
+    edges = [([size * i / 20.0 for i in range(21)], )] * 10
+
+    return items, [
+        ("build", None, [(items, )]),
+        ("lookup", "lookup", picks),
+        ("update", "update", updates),
+        ("rank", "rank", picks[:size // 10]),
+        ("rank_many", "rank_many", batches),
+        ("range", "range", ranges),
+        ("histogram", "histogram", edges),
+        ("top", "top", tops),
+        ("scan", "scan", [()] * 3),
+        ("export", "export", [()] * 3),
+        ("copy", "copy", [()] * 10),
+    ]
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--size", type=int, default=100000)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--seed", type=int, default=42)
+    args = parser.parse_args(argv)
+
+    impls = [SkipDictImpl(), DictImpl(), HeapqImpl()]
+    if SortedList is not None:
+        impls.insert(1, SortedListImpl())
+
+    items, cases = benchmarks(args.size, args.seed)
+    for name, method, calls in cases:
+        for impl in impls:
+            if method is None:
+                fn = impl.build
+            elif hasattr(impl, method):
+                impl.build(items)
+                fn = getattr(impl, method)
+            else:
+                continue
+            seconds = timed(fn, calls, args.repeat)
+            ops = len(calls)
+            if method and method.endswith("_many"):
+                ops = sum(len(arg[0]) for arg in calls)
+            print(json.dumps({
+                "benchmark": "api.%s" % name,
+                "impl": impl.name,
+                "size": args.size,
+                "seed": args.seed,
+                "ops": ops,
+                "seconds": round(seconds, 6),
+                "ns_per_op": round(seconds * 1e9 / ops, 1),
+            }))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,218 @@
+/* Microbenchmarks for the skip list core (libskiplist).
+ *
+ * Runs insert, rank (one at a time and batched), by-rank lookup, range
+ * scan, score update and delete over n entries for each score
+ * distribution, printing one JSON object per line. The runs are seeded,
+ * so the same arguments give the same lists and operation sequences.
+ *
+ * Usage:
+ *
+ *   skiplist_bench [n] [seed]
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "skiplist.h"
+
+#define MAXLEVEL 32
+#define SCAN 100
+#define BATCH 256
+
+static uint64_t state;
+
+static uint64_t next_random(void) {
+    /* xorshift64* */
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dULL;
+}
+
+static double uniform(void) {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int random_level(void) {
+    int level = 1;
+    while ((next_random() & 0xffff) < (0.25 * 0xffff) && level < MAXLEVEL)
+        level++;
+    return level;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Zipfian scores (s = 1) over n / 10 distinct values, so that popular
+ * scores have many ties. */
+static void zipfian(double *scores, unsigned long n) {
+    unsigned long k = n / 10 + 1, i, lo, hi;
+    double *cdf = malloc(k * sizeof(double)), sum = 0.0, u;
+
+    for (i = 0; i < k; i++)
+        cdf[i] = (sum += 1.0 / (i + 1));
+    for (i = 0; i < n; i++) {
+        u = uniform() * sum;
+        lo = 0;
+        hi = k - 1;
+        while (lo < hi) {
+            unsigned long mid = (lo + hi) / 2;
+            if (cdf[mid] < u) lo = mid + 1;
+            else hi = mid;
+        }
+        scores[i] = (double) lo;
+    }
+    free(cdf);
+}
+
+/* Ascending scores with one in a hundred swapped with a neighbour
+ * within 16 places. */
+static void near_sorted(double *scores, unsigned long n) {
+    unsigned long i, j;
+    double tmp;
+
+    for (i = 0; i < n; i++)
+        scores[i] = (double) i;
+    for (i = 0; i < n; i++) {
+        if (next_random() % 100) continue;
+        j = i + next_random() % 16;
+        if (j >= n) continue;
+        tmp = scores[i];
+        scores[i] = scores[j];
+        scores[j] = tmp;
+    }
+}
+
+static void fill(const char *dist, double *scores, unsigned long n) {
+    unsigned long i;
+
+    if (dist[0] == 'z') {
+        zipfian(scores, n);
+    } else if (dist[0] == 'n') {
+        near_sorted(scores, n);
+    } else {
+        for (i = 0; i < n; i++)
+            scores[i] = uniform() * n;
+    }
+}
+
+static void report(const char *op, const char *dist, unsigned long n,
+                   unsigned long ops, double seconds) {
+    printf("{\"benchmark\": \"core.%s\", \"dist\": \"%s\", \"size\": %lu, "
+           "\"ops\": %lu, \"seconds\": %.6f, \"ns_per_op\": %.1f}\n",
+           op, dist, n, ops, seconds, seconds * 1e9 / ops);
+}
+
+/* A random permutation of 0 .. n - 1, to visit the entries in an order
+ * unrelated to their scores. */
+static unsigned long *shuffled(unsigned long n) {
+    unsigned long *order = malloc(n * sizeof(unsigned long)), i, j, tmp;
+
+    for (i = 0; i < n; i++)
+        order[i] = i;
+    for (i = n - 1; i > 0; i--) {
+        j = next_random() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    return order;
+}
+
+static void run(const char *dist, unsigned long n) {
+    double *scores = malloc(n * sizeof(double)), started, score;
+    double *batch_scores = malloc(n * sizeof(double));
+    char *objs = malloc(n);
+    void **batch_objs = malloc(n * sizeof(void *));
+    unsigned long ranks[BATCH];
+    unsigned long *order, i, j, sink = 0;
+    skiplist *sl = slCreate(MAXLEVEL);
+    skiplistNode *x;
+
+    fill(dist, scores, n);
+
+    started = now();
+    for (i = 0; i < n; i++)
+        slInsert(sl, scores[i], objs + i, random_level());
+    report("insert", dist, n, n, now() - started);
+
+    order = shuffled(n);
+    started = now();
+    for (i = 0; i < n; i++)
+        sink += slGetRank(sl, scores[order[i]], objs + order[i]);
+    report("rank", dist, n, n, now() - started);
+
+    for (i = 0; i < n; i++) {
+        batch_scores[i] = scores[order[i]];
+        batch_objs[i] = objs + order[i];
+    }
+    started = now();
+    for (i = 0; i < n; i += BATCH) {
+        j = n - i < BATCH ? n - i : BATCH;
+        slGetRankMany(sl, batch_scores + i, batch_objs + i, j, ranks);
+        sink += ranks[0];
+    }
+    report("rank_many", dist, n, n, now() - started);
+
+    started = now();
+    for (i = 0; i < n; i++) {
+        x = slGetNodeByRank(sl->header, sl->level - 1, order[i] + 1);
+        sink += x != NULL;
+    }
+    report("byrank", dist, n, n, now() - started);
+
+    started = now();
+    for (i = 0; i < n; i++) {
+        score = scores[order[i]];
+        x = slFirstInRange(sl, score, HUGE_VAL);
+        for (j = 0; x && j < SCAN; j++, x = x->level[0].forward)
+            sink++;
+    }
+    report("range", dist, n, n, now() - started);
+
+    /* Small score changes mostly stay in place; the rest are deleted
+     * and inserted again. */
+    started = now();
+    for (i = 0; i < n; i++) {
+        j = order[i];
+        score = scores[j] + (uniform() - 0.5) * 4.0;
+        if (slDelete(sl, scores[j], objs + j, &score) == 1)
+            slInsert(sl, score, objs + j, random_level());
+        scores[j] = score;
+    }
+    report("update", dist, n, n, now() - started);
+
+    started = now();
+    for (i = 0; i < n; i++)
+        sink += slDelete(sl, scores[order[i]], objs + order[i], NULL);
+    report("delete", dist, n, n, now() - started);
+
+    if (sink == 0 || slLength(sl) != 0)
+        fprintf(stderr, "unexpected result for %s\n", dist);
+
+    slFree(sl);
+    free(order);
+    free(batch_objs);
+    free(objs);
+    free(batch_scores);
+    free(scores);
+}
+
+int main(int argc, char **argv) {
+    static const char *dists[] = {"uniform", "zipfian", "near_sorted"};
+    unsigned long n = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    unsigned long seed = argc > 2 ? strtoul(argv[2], NULL, 10) : 42;
+    int i;
+
+    if (n < 2) n = 2;
+    for (i = 0; i < 3; i++) {
+        state = seed * 0x9e3779b97f4a7c15ULL + 1;
+        run(dists[i], n);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+"""Multi-threaded read throughput of a shared skip dict.
+
+Each thread runs a fixed mix of ``get``, ``index`` and range reads
+against one ``SkipDict``. On a free-threaded interpreter (3.13t), the
+read throughput should scale with the number of threads; with the GIL,
+it stays flat.
+
+Usage::
+
+  python bench/threads.py --size 100000 --threads 1,2,4,8
+"""
+
+import argparse
+import json
+import sys
+import threading
+import time
+
+from random import Random
+
+from skipdict import SkipDict
+
+
+def reader(skipdict, keys, seed, deadline, counts, slot):
+    rnd = Random(seed)
+    n = len(keys)
+    ops = 0
+    while time.time() < deadline:
+        for i in range(64):
+            key = keys[rnd.randrange(n)]
+            score = skipdict.get(key)
+            skipdict.index(key)
+            next(iter(skipdict.keys(score, score + 10.0)), None)
+        ops += 64 * 3
+    counts[slot] = ops
+
+
+def run(skipdict, keys, threads, duration, seed):
+    counts = [0] * threads
+    deadline = time.time() + duration
+    workers = [
+        threading.Thread(
+            target=reader,
+            args=(skipdict, keys, seed + i, deadline, counts, i)
+        )
+        for i in range(threads)
+    ]
+    started = time.time()
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join()
+    return sum(counts) / (time.time() - started)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--size", type=int, default=100000)
+    parser.add_argument("--threads", default="1,2,4,8")
+    parser.add_argument("--duration", type=float, default=2.0)
+    parser.add_argument("--seed", type=int, default=42)
+    args = parser.parse_args(argv)
+
+    rnd = Random(args.seed)
+    keys = ["key%d" % i for i in range(args.size)]
+    skipdict = SkipDict((key, rnd.random() * args.size) for key in keys)
+
+    gil = getattr(sys, "_is_gil_enabled", lambda: True)()
+    baseline = None
+    for threads in map(int, args.threads.split(",")):
+        ops = run(skipdict, keys, threads, args.duration, args.seed)
+        baseline = baseline or ops
+        print(json.dumps({
+            "benchmark": "threads.read",
+            "size": args.size,
+            "threads": threads,
+            "gil": gil,
+            "ops_per_sec": round(ops),
+            "scaling": round(ops / baseline, 2),
+        }))
+
+
+if __name__ == "__main__":
+    main()
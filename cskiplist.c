@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cskiplist.h"
+
+#define MARK(p) ((p) | (uintptr_t) 1)
+#define UNMARK(p) ((p) & ~(uintptr_t) 1)
+#define MARKED(p) ((p) & (uintptr_t) 1)
+#define NODE(p) ((cslNode *) UNMARK(p))
+
+static cslNode *cslCreateNode(int level, double score, void *obj) {
+    cslNode *n = calloc(1, sizeof(*n) + level * sizeof(n->next[0]));
+    int i;
+
+    if (!n) return NULL;
+    n->score = score;
+    n->obj = obj;
+    n->level = level;
+    atomic_init(&n->done, 0);
+    for (i = 0; i < level; i++)
+        atomic_init(&n->next[i], 0);
+    return n;
+}
+
+/* Nodes are ordered by score and then by object address. */
+static inline int cslLess(cslNode *x, double score, void *obj) {
+    return x->score < score || (x->score == score && x->obj < obj);
+}
+
+cskiplist *cslCreate(int maxlevel) {
+    cskiplist *sl;
+
+    sl = malloc(sizeof(*sl));
+    if (!sl) return NULL;
+    sl->maxlevel = maxlevel;
+    sl->header = cslCreateNode(maxlevel, 0, NULL);
+    if (!sl->header) {
+        free(sl);
+        return NULL;
+    }
+    atomic_init(&sl->length, 0);
+    atomic_init(&sl->epoch, 0);
+    atomic_init(&sl->handles, NULL);
+    return sl;
+}
+
+/* Must not be called while other threads are using the list. */
+void cslFree(cskiplist *sl) {
+    cslNode *node = sl->header, *next;
+    cslHandle *h = atomic_load(&sl->handles), *link;
+    int i;
+
+    while (node) {
+        next = NODE(atomic_load(&node->next[0]));
+        free(node);
+        node = next;
+    }
+    while (h) {
+        link = h->link;
+        for (i = 0; i < 3; i++) {
+            for (node = h->limbo[i]; node; node = next) {
+                next = node->limbo;
+                free(node);
+            }
+        }
+        free(h);
+        h = link;
+    }
+    free(sl);
+}
+
+/* Handles are never freed while the list is alive; a detached handle
+ * is reused by the next thread that attaches. */
+cslHandle *cslAttach(cskiplist *sl) {
+    cslHandle *h, *head;
+    int inactive;
+
+    for (h = atomic_load(&sl->handles); h; h = h->link) {
+        inactive = 0;
+        if (atomic_compare_exchange_strong(&h->active, &inactive, 1))
+            return h;
+    }
+
+    h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    h->parent = sl;
+    atomic_init(&h->epoch, atomic_load(&sl->epoch));
+    atomic_init(&h->active, 1);
+    atomic_init(&h->pinned, 0);
+    head = atomic_load(&sl->handles);
+    do {
+        h->link = head;
+    } while (!atomic_compare_exchange_weak(&sl->handles, &head, h));
+    return h;
+}
+
+void cslDetach(cslHandle *h) {
+    atomic_store(&h->active, 0);
+}
+
+static void cslReclaim(cslNode **limbo) {
+    cslNode *node = *limbo, *next;
+
+    while (node) {
+        next = node->limbo;
+        free(node);
+        node = next;
+    }
+    *limbo = NULL;
+}
+
+/* Retired nodes are tagged with the global epoch e at the time of
+ * retirement; any thread that could still see them was pinned in
+ * epoch e or earlier, so they are freed once the global epoch has
+ * moved on twice. While we were pinned, the global epoch was at most
+ * one ahead of ours, which bounds the tags in our limbo lists. */
+void cslPin(cslHandle *h) {
+    cskiplist *sl = h->parent;
+    unsigned long last = atomic_load_explicit(&h->epoch, memory_order_relaxed);
+    unsigned long e = atomic_load(&sl->epoch), current;
+    int i;
+
+    /* Pins nest, e.g. when updating the list during a traversal. */
+    if (atomic_load_explicit(&h->pinned, memory_order_relaxed)) {
+        atomic_fetch_add(&h->pinned, 1);
+        return;
+    }
+
+    atomic_store(&h->epoch, e);
+    atomic_store(&h->pinned, 1);
+
+    /* The epoch may have advanced before we were seen as pinned. */
+    current = atomic_load(&sl->epoch);
+    if (current != e) {
+        atomic_store(&h->epoch, current);
+        e = current;
+    }
+
+    if (e - last >= 3) {
+        for (i = 0; i < 3; i++)
+            cslReclaim(&h->limbo[i]);
+    } else if (e != last) {
+        cslReclaim(&h->limbo[(e + 1) % 3]);
+    }
+}
+
+void cslUnpin(cslHandle *h) {
+    atomic_fetch_sub(&h->pinned, 1);
+}
+
+static void cslTryAdvance(cskiplist *sl) {
+    unsigned long e = atomic_load(&sl->epoch);
+    cslHandle *h;
+
+    for (h = atomic_load(&sl->handles); h; h = h->link) {
+        if (atomic_load(&h->pinned) && atomic_load(&h->epoch) != e)
+            return;
+    }
+    atomic_compare_exchange_strong(&sl->epoch, &e, e + 1);
+}
+
+/* Both the inserting and the deleting thread must be done with a node
+ * (and have made sure that it's unlinked at every level) before it can
+ * be retired; the last one to finish retires it. */
+static void cslRelease(cslHandle *h, cslNode *x) {
+    unsigned long e;
+
+    if (atomic_fetch_add(&x->done, 1) != 1)
+        return;
+    e = atomic_load(&h->parent->epoch);
+    x->limbo = h->limbo[e % 3];
+    h->limbo[e % 3] = x;
+    cslTryAdvance(h->parent);
+}
+
+/* Find the predecessors and successors of the score/object pair at
+ * every level, unlinking any marked nodes along the way. Returns 1 if
+ * the pair was found (as succs[0]). */
+static int cslFind(cskiplist *sl, double score, void *obj,
+                   cslNode **preds, cslNode **succs) {
+    cslNode *pred, *curr = NULL;
+    uintptr_t next, expected;
+    int i;
+
+ retry:
+    pred = sl->header;
+    for (i = sl->maxlevel - 1; i >= 0; i--) {
+        curr = NODE(atomic_load(&pred->next[i]));
+        while (curr) {
+            next = atomic_load(&curr->next[i]);
+            if (MARKED(next)) {
+                expected = (uintptr_t) curr;
+                if (!atomic_compare_exchange_strong(&pred->next[i], &expected,
+                                                    UNMARK(next)))
+                    goto retry;
+                curr = NODE(next);
+                continue;
+            }
+            if (!cslLess(curr, score, obj))
+                break;
+            pred = curr;
+            curr = NODE(next);
+        }
+        if (preds) {
+            preds[i] = pred;
+            succs[i] = curr;
+        }
+    }
+    return curr && curr->score == score && curr->obj == obj;
+}
+
+/* Returns 1 if inserted, 0 if the pair is already present and -1 when
+ * out of memory or the level is not within 1..maxlevel. */
+int cslInsert(cslHandle *h, double score, void *obj, int level) {
+    cskiplist *sl = h->parent;
+    cslNode *preds[sl->maxlevel], *succs[sl->maxlevel], *x = NULL;
+    uintptr_t next, expected;
+    int i;
+
+    if (level < 1 || level > sl->maxlevel)
+        return -1;
+
+    cslPin(h);
+    while (1) {
+        if (cslFind(sl, score, obj, preds, succs)) {
+            free(x);
+            cslUnpin(h);
+            return 0;
+        }
+        if (!x && !(x = cslCreateNode(level, score, obj))) {
+            cslUnpin(h);
+            return -1;
+        }
+        for (i = 0; i < level; i++) {
+            atomic_store_explicit(&x->next[i], (uintptr_t) succs[i],
+                                  memory_order_relaxed);
+        }
+        expected = (uintptr_t) succs[0];
+        if (atomic_compare_exchange_strong(&preds[0]->next[0], &expected,
+                                           (uintptr_t) x))
+            break;
+    }
+
+    atomic_fetch_add(&sl->length, 1);
+
+    /* The node is now in the list; link the index levels bottom-up,
+     * giving up as soon as a concurrent delete has marked it. */
+    for (i = 1; i < level; i++) {
+        while (1) {
+            next = atomic_load(&x->next[i]);
+            if (MARKED(next))
+                goto Done;
+            if (NODE(next) != succs[i] &&
+                !atomic_compare_exchange_strong(&x->next[i], &next,
+                                                (uintptr_t) succs[i]))
+                continue;
+            expected = (uintptr_t) succs[i];
+            if (atomic_compare_exchange_strong(&preds[i]->next[i], &expected,
+                                               (uintptr_t) x))
+                break;
+            cslFind(sl, score, obj, preds, succs);
+            if (succs[0] != x)
+                goto Done;
+        }
+    }
+
+ Done:
+    /* A delete may have raced with the linking above, in which case we
+     * unlink the levels it might have missed. */
+    if (MARKED(atomic_load(&x->next[0])))
+        cslFind(sl, score, obj, NULL, NULL);
+    cslRelease(h, x);
+    cslUnpin(h);
+    return 1;
+}
+
+int cslDelete(cslHandle *h, double score, void *obj) {
+    cskiplist *sl = h->parent;
+    cslNode *preds[sl->maxlevel], *succs[sl->maxlevel], *x;
+    uintptr_t next;
+    int i;
+
+    cslPin(h);
+    if (!cslFind(sl, score, obj, preds, succs)) {
+        cslUnpin(h);
+        return 0;
+    }
+
+    /* Mark the index levels top-down, then the bottom level; whoever
+     * marks the bottom level owns the delete. */
+    x = succs[0];
+    for (i = x->level - 1; i >= 1; i--) {
+        next = atomic_load(&x->next[i]);
+        while (!MARKED(next)) {
+            atomic_compare_exchange_weak(&x->next[i], &next, MARK(next));
+        }
+    }
+    next = atomic_load(&x->next[0]);
+    while (1) {
+        if (MARKED(next)) {
+            cslUnpin(h);
+            return 0;
+        }
+        if (atomic_compare_exchange_weak(&x->next[0], &next, MARK(next)))
+            break;
+    }
+
+    cslFind(sl, score, obj, NULL, NULL);
+    atomic_fetch_sub(&sl->length, 1);
+    cslRelease(h, x);
+    cslUnpin(h);
+    return 1;
+}
+
+int cslContains(cslHandle *h, double score, void *obj) {
+    int found;
+
+    cslPin(h);
+    found = cslFind(h->parent, score, obj, NULL, NULL);
+    cslUnpin(h);
+    return found;
+}
+
+unsigned long cslLength(cskiplist *sl) {
+    long length = atomic_load(&sl->length);
+    return length > 0 ? (unsigned long) length : 0;
+}
+
+/* Weakly consistent rank in O(n): nodes are counted as they are seen
+ * at the bottom level, without blocking concurrent updates. Returns 0
+ * when the element cannot be found. */
+unsigned long cslGetRank(cslHandle *h, double score, void *obj) {
+    cslNode *x;
+    uintptr_t next;
+    unsigned long rank = 0;
+
+    cslPin(h);
+    x = NODE(atomic_load(&h->parent->header->next[0]));
+    while (x) {
+        next = atomic_load(&x->next[0]);
+        if (!MARKED(next)) {
+            rank++;
+            if (x->score == score && x->obj == obj)
+                break;
+            if (!cslLess(x, score, obj)) {
+                x = NULL;
+                break;
+            }
+        }
+        x = NODE(next);
+    }
+    cslUnpin(h);
+    return x ? rank : 0;
+}
+
+cslNode *cslFirstInRange(cslHandle *h, double min, double max) {
+    cslNode *x = h->parent->header, *y = NULL;
+    uintptr_t next;
+    int i;
+
+    for (i = h->parent->maxlevel - 1; i >= 0; i--) {
+        y = NODE(atomic_load(&x->next[i]));
+        while (y) {
+            next = atomic_load(&y->next[i]);
+            if (!MARKED(next)) {
+                if (y->score >= min)
+                    break;
+                x = y;
+            }
+            y = NODE(next);
+        }
+    }
+    return (y && y->score <= max) ? y : NULL;
+}
+
+cslNode *cslNext(cslNode *node, double max) {
+    uintptr_t next;
+
+    node = NODE(atomic_load(&node->next[0]));
+    while (node) {
+        next = atomic_load(&node->next[0]);
+        if (!MARKED(next))
+            return node->score <= max ? node : NULL;
+        node = NODE(next);
+    }
+    return NULL;
+}
@@ -0,0 +1,80 @@
+#ifndef CSKIPLIST_H
+#define CSKIPLIST_H
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Lock-free skiplist (Fraser, Herlihy & Shavit) ordered by score and
+ * object pointer, just like the single-threaded skiplist.
+ *
+ * Links carry a mark in their lowest bit; a node is logically deleted
+ * once its level 0 link is marked and searches unlink marked nodes as
+ * they pass them. Memory is reclaimed using epochs: each thread
+ * attaches a handle to the list and passes it to every operation.
+ *
+ * There are no spans: maintaining them would require updating every
+ * level of the search path atomically, which is exactly the
+ * contention this variant avoids. The trade-off is that ranks are
+ * served under a weaker consistency mode: cslGetRank() walks the
+ * bottom level in O(n) and reflects some interleaving of the
+ * concurrent updates, and cslLength() is a counter which is only exact
+ * when the list is quiescent. Use the single-threaded skiplist (under
+ * a lock) where exact O(log n) ranks are required. */
+
+typedef struct cslNode {
+    void *obj;
+    double score;
+    int level;
+    atomic_int done;
+    struct cslNode *limbo;
+    _Atomic(uintptr_t) next[];
+} cslNode;
+
+typedef struct cslHandle {
+    struct cskiplist *parent;
+    struct cslHandle *link;
+    atomic_ulong epoch;
+    atomic_int active;
+    atomic_int pinned;
+    cslNode *limbo[3];
+} cslHandle;
+
+typedef struct cskiplist {
+    cslNode *header;
+    int maxlevel;
+    atomic_long length;
+    atomic_ulong epoch;
+    _Atomic(cslHandle *) handles;
+} cskiplist;
+
+cskiplist *cslCreate(int maxlevel);
+void cslFree(cskiplist *sl);
+
+cslHandle *cslAttach(cskiplist *sl);
+void cslDetach(cslHandle *h);
+
+int cslInsert(cslHandle *h, double score, void *obj, int level);
+int cslDelete(cslHandle *h, double score, void *obj);
+int cslContains(cslHandle *h, double score, void *obj);
+unsigned long cslLength(cskiplist *sl);
+
+unsigned long cslGetRank(cslHandle *h, double score, void *obj);
+
+/* Range traversal. cslFirstInRange() and cslNext() must be called
+ * between cslPin() and cslUnpin() on the same handle, and the nodes
+ * they return may only be dereferenced until cslUnpin(). */
+void cslPin(cslHandle *h);
+void cslUnpin(cslHandle *h);
+cslNode *cslFirstInRange(cslHandle *h, double min, double max);
+cslNode *cslNext(cslNode *node, double max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+/* Tests for the lock-free skip list (cskiplist.h). */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "cskiplist.h"
+
+#define MAXLEVEL 16
+#define THREADS 8
+#define ITEMS 20000
+
+static int failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static char items[ITEMS];
+static pthread_barrier_t barrier;
+
+/* Few distinct scores, so that threads keep meeting in the same
+ * neighbourhoods. */
+static double score_of(int i) {
+    return (double) (i % 97);
+}
+
+typedef struct {
+    cskiplist *sl;
+    int id;
+    unsigned seed;
+    long inserted;
+    long deleted;
+} worker;
+
+static int random_level(unsigned *seed) {
+    int level = 1;
+    while ((rand_r(seed) & 0xffff) < (0.25 * 0xffff) && level < MAXLEVEL)
+        level++;
+    return level;
+}
+
+/* Each thread inserts its share of the items, and then all threads
+ * race to delete every even item (each must be deleted exactly once)
+ * while inserting their share again, which only adds what is missing. */
+static void *run(void *arg) {
+    worker *w = arg;
+    cslHandle *h = cslAttach(w->sl);
+    int i;
+
+    for (i = w->id; i < ITEMS; i += THREADS) {
+        if (cslInsert(h, score_of(i), &items[i],
+                      random_level(&w->seed)) == 1)
+            w->inserted++;
+    }
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < ITEMS; i++) {
+        if (i % 2 == 0 && cslDelete(h, score_of(i), &items[i]) == 1)
+            w->deleted++;
+        if (i % THREADS == w->id && i % 2 == 1 &&
+            cslInsert(h, score_of(i), &items[i],
+                      random_level(&w->seed)) == 1)
+            w->inserted++;
+    }
+    cslDetach(h);
+    return NULL;
+}
+
+static void test_stress(void) {
+    cskiplist *sl = cslCreate(MAXLEVEL);
+    cslHandle *h;
+    cslNode *x, *prev = NULL;
+    pthread_t threads[THREADS];
+    worker workers[THREADS];
+    long inserted = 0, deleted = 0;
+    unsigned long walked = 0;
+    int i;
+
+    pthread_barrier_init(&barrier, NULL, THREADS);
+    for (i = 0; i < THREADS; i++) {
+        workers[i].sl = sl;
+        workers[i].id = i;
+        workers[i].seed = i + 1;
+        workers[i].inserted = workers[i].deleted = 0;
+        CHECK(pthread_create(&threads[i], NULL, run, &workers[i]) == 0);
+    }
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        inserted += workers[i].inserted;
+        deleted += workers[i].deleted;
+    }
+    pthread_barrier_destroy(&barrier);
+    CHECK(inserted == ITEMS);
+    CHECK(deleted == ITEMS / 2);
+
+    /* A full walk of the bottom level agrees with the counter and is
+     * ordered by score and then by object. */
+    h = cslAttach(sl);
+    cslPin(h);
+    for (x = cslFirstInRange(h, -1, 1e9); x; x = cslNext(x, 1e9)) {
+        CHECK((char *) x->obj >= items && (char *) x->obj < items + ITEMS);
+        CHECK(((char *) x->obj - items) % 2 == 1);
+        if (prev) {
+            CHECK(prev->score < x->score ||
+                  (prev->score == x->score && prev->obj < x->obj));
+        }
+        prev = x;
+        walked++;
+    }
+    cslUnpin(h);
+    CHECK(walked == ITEMS / 2);
+    CHECK(cslLength(sl) == walked);
+
+    for (i = 0; i < ITEMS; i++) {
+        CHECK(cslContains(h, score_of(i), &items[i]) == i % 2);
+    }
+    /* items[1] comes right after the odd items with score 0. */
+    CHECK(cslGetRank(h, score_of(1), &items[1]) ==
+          (unsigned long) (ITEMS / 97 + 1) / 2 + 1);
+    cslDetach(h);
+    cslFree(sl);
+}
+
+static void test_level(void) {
+    cskiplist *sl = cslCreate(4);
+    cslHandle *h = cslAttach(sl);
+
+    CHECK(cslInsert(h, 1.0, &items[0], 0) == -1);
+    CHECK(cslInsert(h, 1.0, &items[0], 5) == -1);
+    CHECK(cslInsert(h, 1.0, &items[0], 4) == 1);
+    CHECK(cslInsert(h, 1.0, &items[0], 1) == 0);
+    CHECK(cslLength(sl) == 1);
+    cslDetach(h);
+    cslFree(sl);
+}
+
+int main(void) {
+    test_stress();
+    test_level();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
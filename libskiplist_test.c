@@ -0,0 +1,615 @@
+/* Tests for the standalone C library (libskiplist). */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "skiplist.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+typedef struct {
+    char name[16];
+} item;
+
+static int compare_names(const void *a, const void *b, void *ud) {
+    (*(int *) ud)++;
+    return strcmp(((const item *) a)->name, ((const item *) b)->name);
+}
+
+static int random_level(int maxlevel) {
+    int level = 1;
+    while ((rand() & 0xffff) < (0.25 * 0xffff) && level < maxlevel)
+        level++;
+    return level;
+}
+
+static void test_compare(void) {
+    item items[4] = {{"delta"}, {"alpha"}, {"charlie"}, {"bravo"}};
+    const char *expected[4] = {"bravo", "alpha", "charlie", "delta"};
+    int calls = 0, i;
+    skiplist *sl = slCreateWithCompare(16, compare_names, &calls);
+    skiplistiter *it;
+    skiplistNode *x;
+    const void *obj;
+    double score;
+
+    slInsert(sl, 2.0, &items[0], random_level(16));
+    slInsert(sl, 2.0, &items[1], random_level(16));
+    slInsert(sl, 2.0, &items[2], random_level(16));
+    x = slInsert(sl, 1.0, &items[3], random_level(16));
+    CHECK(x && x->score == 1.0 && x->obj == &items[3]);
+    CHECK(calls > 0);
+    CHECK(slLength(sl) == 4);
+
+    it = slIterNewFromHead(sl);
+    for (i = 0; i < 4; i++) {
+        CHECK(slIterGet(it, &score, &obj) == 0);
+        CHECK(strcmp(((const item *) obj)->name, expected[i]) == 0);
+        slIterNext(it);
+    }
+    slIterDel(it);
+
+    CHECK(slGetRank(sl, 2.0, &items[2]) == 3);
+    CHECK(slDelete(sl, 2.0, &items[1], NULL) == 1);
+    CHECK(slGetRank(sl, 2.0, &items[2]) == 2);
+    CHECK(slDelete(sl, 2.0, &items[1], NULL) == 0);
+    slFree(sl);
+}
+
+static void test_bulk_load(void) {
+    enum { N = 20000 };
+    item *items = malloc(N * sizeof(item));
+    slEntry *entries = malloc(N * sizeof(slEntry));
+    int calls = 0;
+    unsigned long i;
+    skiplist *sl = slCreateWithCompare(16, compare_names, &calls);
+    skiplistNode *x, *prev = NULL;
+
+    for (i = 0; i < N; i++) {
+        snprintf(items[i].name, sizeof(items[i].name), "%08lu",
+                 (i * 7919) % N);
+        entries[i].score = (double) (i % 10);
+        entries[i].obj = &items[i];
+    }
+    CHECK(slBulkLoad(sl, entries, N, 0.25, 42, 4) == 0);
+    CHECK(slLength(sl) == N);
+
+    for (i = 1, x = sl->header->level[0].forward; x;
+         x = x->level[0].forward, i++) {
+        if (prev) {
+            CHECK(prev->score < x->score ||
+                  (prev->score == x->score &&
+                   strcmp(((item *) prev->obj)->name,
+                          ((item *) x->obj)->name) < 0));
+        }
+        if (i % 1000 == 0) {
+            CHECK(slGetRank(sl, x->score, x->obj) == i);
+        }
+        prev = x;
+    }
+    slFree(sl);
+    free(entries);
+    free(items);
+}
+
+/* Forward steps taken by a lookup of x, as in slGetRank(). */
+static unsigned long lookup_steps(skiplist *sl, skiplistNode *x) {
+    skiplistNode *node = sl->header;
+    unsigned long steps = 0;
+    int i;
+
+    for (i = sl->level - 1; i >= 0; i--) {
+        while (node->level[i].forward &&
+               (node->level[i].forward->score < x->score ||
+                (node->level[i].forward->score == x->score &&
+                 node->level[i].forward->obj <= x->obj))) {
+            node = node->level[i].forward;
+            steps++;
+        }
+        if (node == x) break;
+    }
+    return steps;
+}
+
+static void test_stats(void) {
+    enum { N = 2000 };
+    item items[N];
+    skiplist *sl = slCreate(12);
+    skiplistNode *x;
+    unsigned long total, max, expected_total, expected_max, count, steps;
+    size_t empty = slMemoryUsage(sl);
+    int i, round;
+
+    for (i = 0; i < N; i++)
+        slInsert(sl, (double) (i % 50), &items[i], random_level(12));
+    for (round = 0; round < 2; round++) {
+        expected_total = expected_max = count = 0;
+        for (i = 0; i < sl->maxlevel; i++)
+            count += sl->levels[i];
+        CHECK(count == slLength(sl));
+        for (x = sl->header->level[0].forward; x; x = x->level[0].forward) {
+            steps = lookup_steps(sl, x);
+            expected_total += steps;
+            if (steps > expected_max) expected_max = steps;
+        }
+        slPathStats(sl, &total, &max);
+        CHECK(total == expected_total);
+        CHECK(max == expected_max);
+        CHECK(slMemoryUsage(sl) >
+              empty + slLength(sl) * (sizeof(skiplistNode) +
+                                      sizeof(sl->header->level[0])));
+
+        for (i = round; i < N; i += 4)
+            CHECK(slDelete(sl, (double) (i % 50), &items[i], NULL) == 1);
+    }
+    slFree(sl);
+}
+
+static void test_resize(void) {
+    item items[200];
+    skiplist *sl = slCreate(slLevelsFor(0, 0.25, 16));
+    int i;
+
+    CHECK(sl->maxlevel == 2);
+    CHECK(slLevelsFor(1000, 0.25, 16) == 6);
+    CHECK(slLevelsFor(1000, 0.25, 4) == 4);
+    CHECK(slResize(sl, slLevelsFor(200, 0.25, 16)) == 0);
+    CHECK(sl->maxlevel == 5);
+    for (i = 0; i < 200; i++)
+        slInsert(sl, (double) i, &items[i], random_level(sl->maxlevel));
+
+    /* Never below the current level. */
+    CHECK(slResize(sl, 1) == 0);
+    CHECK(sl->maxlevel == sl->level);
+    CHECK(slResize(sl, 12) == 0);
+    CHECK(sl->maxlevel == 12);
+    slInsert(sl, 200.0, &items[0], 12);
+    CHECK(sl->level == 12);
+    for (i = 0; i < 200; i += 10)
+        CHECK(slGetRank(sl, (double) i, &items[i]) == (unsigned long) i + 1);
+    slFree(sl);
+}
+
+static void test_rebalance(void) {
+    enum { N = 5000 };
+    item *items = malloc(N * sizeof(item));
+    skiplist *sl = slCreate(16);
+    skiplistNode *x;
+    unsigned long rank, total, max, before;
+    int i;
+
+    for (i = 0; i < N; i++)
+        slInsert(sl, (double) (i % 97), &items[i], random_level(16));
+    for (i = 0; i < N; i += 3)
+        CHECK(slDelete(sl, (double) (i % 97), &items[i], NULL) == 1);
+    slPathStats(sl, &before, &max);
+
+    CHECK(slRebalance(sl, 0.25) == 0);
+    CHECK(sl->slab != NULL);
+    CHECK(sl->slabLive == slLength(sl));
+    CHECK(slMemoryUsage(sl) > sl->slabSize);
+    for (rank = 1, x = sl->header->level[0].forward; x;
+         rank++, x = x->level[0].forward) {
+        /* Nodes are next to each other in order, with one more level
+         * for each power of four dividing the rank. */
+        size_t height = 1 + (rank % 4 == 0) + (rank % 16 == 0) +
+            (rank % 64 == 0) + (rank % 256 == 0) + (rank % 1024 == 0);
+        CHECK((x->level[0].forward == NULL) == (x == sl->tail));
+        if (x->level[0].forward)
+            CHECK((char *) x->level[0].forward - (char *) x ==
+                  (ptrdiff_t) (sizeof(skiplistNode) +
+                               height * sizeof(x->level[0])));
+        if (rank % 100 == 0)
+            CHECK(slGetRank(sl, x->score, x->obj) == rank);
+    }
+    CHECK(rank == slLength(sl) + 1);
+    CHECK(sl->levels[0] == slLength(sl) - slLength(sl) / 4);
+    slPathStats(sl, &total, &max);
+    CHECK(total <= before);
+
+    /* Deleted nodes stay in the slab until it is empty. */
+    for (i = 1; i < N; i += 3)
+        CHECK(slDelete(sl, (double) (i % 97), &items[i], NULL) == 1);
+    CHECK(sl->slabFree > 0);
+    CHECK(slRebalance(sl, 0.5) == 0);
+    for (i = 2; i < N; i += 3)
+        CHECK(slDelete(sl, (double) (i % 97), &items[i], NULL) == 1);
+    CHECK(slLength(sl) == 0);
+    CHECK(sl->slab == NULL);
+    slInsert(sl, 1.0, &items[0], 3);
+    CHECK(slRebalance(sl, 0.25) == 0);
+    CHECK(slGetRank(sl, 1.0, &items[0]) == 1);
+    slFree(sl);
+    free(items);
+}
+
+static void test_counters(void) {
+    item items[100];
+    skiplist *sl = slCreate(8);
+    double newscore = 1000.0;
+    int i;
+
+#ifdef SKIPLIST_COUNTERS
+    slCounters *c;
+    unsigned long total = 0;
+
+    CHECK(slEnableCounters(sl, 1) == 0);
+    c = sl->counters;
+    for (i = 0; i < 100; i++)
+        slInsert(sl, (double) i, &items[i], random_level(8));
+    CHECK(slGetRank(sl, 50.0, &items[50]) == 51);
+    CHECK(slDelete(sl, 10.0, &items[10], NULL) == 1);
+    /* The last entry stays put; the first one moves to the end. */
+    CHECK(slDelete(sl, 99.0, &items[99], &newscore) == 2);
+    CHECK(slDelete(sl, 0.0, &items[0], &newscore) == 1);
+    CHECK(slFirstInRange(sl, 20.0, 30.0) != NULL);
+
+    CHECK(c->calls[SL_OP_INSERT] == 100);
+    CHECK(c->calls[SL_OP_RANK] == 1);
+    CHECK(c->calls[SL_OP_DELETE] == 3);
+    CHECK(c->calls[SL_OP_RANGE] == 1);
+    CHECK(c->steps[SL_OP_RANK] > 0);
+    CHECK(c->steps[SL_OP_RANGE] > 0);
+    CHECK(c->allocs == 100);
+    CHECK(c->frees == 2);
+    CHECK(c->inplace == 1);
+    CHECK(c->relinks == 1);
+    for (i = 0; i < SL_LATENCY_BUCKETS; i++)
+        total += c->latency[SL_OP_INSERT][i];
+    CHECK(total == 100);
+
+    slResetCounters(sl);
+    CHECK(c->calls[SL_OP_INSERT] == 0);
+    CHECK(slEnableCounters(sl, 0) == 0);
+    CHECK(sl->counters == NULL);
+#else
+    CHECK(slEnableCounters(sl, 1) == -1);
+    CHECK(sl->counters == NULL);
+    for (i = 0; i < 100; i++)
+        slInsert(sl, (double) i, &items[i], random_level(8));
+    CHECK(slDelete(sl, 0.0, &items[0], &newscore) == 1);
+#endif
+    slFree(sl);
+}
+
+/* Whether every link's weight is the sum of the scores it spans, and
+ * the list's weight the sum of all of them. The scores are small
+ * integers, so the sums are exact. */
+static int weights_ok(skiplist *sl) {
+    skiplistNode *x, *y;
+    double sum, total = 0.0;
+    int i;
+
+    for (x = sl->header->level[0].forward; x; x = x->level[0].forward)
+        total += x->score;
+    if (sl->weight != total) return 0;
+    for (i = 0; i < sl->level; i++) {
+        for (x = sl->header; x; x = x->level[i].forward) {
+            sum = 0.0;
+            for (y = x->level[0].forward; y != x->level[i].forward;
+                 y = y->level[0].forward)
+                sum += y->score;
+            if (x->level[i].forward) sum += x->level[i].forward->score;
+            if (x->level[i].weight != sum) return 0;
+        }
+    }
+    return 1;
+}
+
+static void noop(void *ud, void *obj) {
+    (void) ud;
+    (void) obj;
+}
+
+static void test_weights(void) {
+    enum { N = 3000 };
+    item *items = malloc(N * sizeof(item));
+    slEntry *entries = malloc(N * sizeof(slEntry));
+    skiplist *sl = slCreate(12);
+    skiplistNode *x;
+    double score, sum;
+    int i;
+
+    CHECK(slGetNodeByWeight(sl, 0.0) == NULL);
+    for (i = 0; i < N; i++)
+        slInsert(sl, (double) (i % 50), &items[i], random_level(12));
+    CHECK(weights_ok(sl));
+
+    /* In place (small changes) and relinked. */
+    for (i = 0; i < N; i += 7) {
+        score = (double) (i % 50 + (i % 2 ? 1 : 20));
+        CHECK(slDelete(sl, (double) (i % 50), &items[i], &score) > 0);
+        if (slGetRank(sl, score, &items[i]) == 0)
+            slInsert(sl, score, &items[i], random_level(12));
+    }
+    for (i = 1; i < N; i += 7)
+        CHECK(slDelete(sl, (double) (i % 50), &items[i], NULL) == 1);
+    score = 1001.0;
+    slInsert(sl, 1000.0, &items[1], 5);
+    CHECK(slDelete(sl, 1000.0, &items[1], &score) == 2);
+    CHECK(weights_ok(sl));
+    CHECK(slDeleteByRank(sl, 100, 300, noop, NULL) == 201);
+    CHECK(weights_ok(sl));
+
+    /* Each node is found for the weights up to its running sum. */
+    sum = 0.0;
+    for (x = sl->header->level[0].forward; x; x = x->level[0].forward) {
+        if (x->score > 0) {
+            CHECK(slGetNodeByWeight(sl, sum) == x);
+            CHECK(slGetNodeByWeight(sl, sum + x->score - 0.5) == x);
+        }
+        sum += x->score;
+    }
+    CHECK(slGetNodeByWeight(sl, sum + 1.0) == sl->tail);
+
+    CHECK(slRebalance(sl, 0.25) == 0);
+    CHECK(weights_ok(sl));
+    slFree(sl);
+
+    for (i = 0; i < N; i++) {
+        entries[i].score = (double) (i % 50);
+        entries[i].obj = &items[i];
+    }
+    sl = slCreate(12);
+    CHECK(slBulkLoad(sl, entries, N, 0.25, 42, 4) == 0);
+    CHECK(weights_ok(sl));
+    slFree(sl);
+    free(entries);
+    free(items);
+}
+
+static void test_rank_many(void) {
+    enum { N = 500, M = 600 };
+    item items[N], missing;
+    double scores[M];
+    void *objs[M];
+    unsigned long ranks[M];
+    skiplist *sl = slCreate(12);
+    int i;
+
+    slGetRankMany(sl, scores, objs, 0, ranks);
+    for (i = 0; i < N; i++)
+        slInsert(sl, (double) (i % 30), &items[i], random_level(12));
+    for (i = 0; i < M; i++) {
+        int j = (i * 7) % N;
+        scores[i] = (double) (j % 30);
+        objs[i] = &items[j];
+    }
+    /* An absent object, and a present object under the wrong score. */
+    objs[3] = &missing;
+    scores[5] += 0.5;
+
+    slGetRankMany(sl, scores, objs, M, ranks);
+    for (i = 0; i < M; i++)
+        CHECK(ranks[i] == slGetRank(sl, scores[i], objs[i]));
+    CHECK(ranks[3] == 0 && ranks[5] == 0 && ranks[4] != 0);
+    slFree(sl);
+}
+
+static void test_floor_ceiling(void) {
+    item items[50];
+    skiplist *sl = slCreate(8);
+    skiplistNode *x;
+    unsigned long rank;
+    int i;
+
+    CHECK(slFloor(sl, 1.0, &rank) == NULL && rank == 0);
+    CHECK(slCeiling(sl, 1.0, &rank) == NULL && rank == 0);
+    /* Scores 0, 0, 2, 2, ..., 48, 48. */
+    for (i = 0; i < 50; i++)
+        slInsert(sl, (double) (i - i % 2), &items[i], random_level(8));
+
+    x = slFloor(sl, 7.0, &rank);
+    CHECK(x && x->score == 6.0 && rank == 8);
+    x = slFloor(sl, 6.0, &rank);
+    CHECK(x && x->score == 6.0 && rank == 8);
+    x = slCeiling(sl, 6.0, &rank);
+    CHECK(x && x->score == 6.0 && rank == 7);
+    x = slCeiling(sl, 5.5, &rank);
+    CHECK(x && x->score == 6.0 && rank == 7);
+    CHECK(slFloor(sl, -1.0, &rank) == NULL && rank == 0);
+    CHECK(slCeiling(sl, 48.5, &rank) == NULL && rank == 0);
+    x = slFloor(sl, 100.0, &rank);
+    CHECK(x == sl->tail && rank == 50);
+    slFree(sl);
+}
+
+static void test_histogram(void) {
+    enum { N = 1000 };
+    item items[N];
+    double edges[5] = {-1.0, 10.0, 10.0, 50.5, 99.0}, bad[2] = {2.0, 1.0};
+    unsigned long counts[4], expected[4] = {0};
+    double sums[4], expectedsums[4] = {0.0};
+    skiplist *sl = slCreate(12);
+    int i;
+
+    CHECK(slHistogram(sl, edges, 5, counts, sums) == 0);
+    CHECK(counts[0] == 0 && counts[3] == 0 && sums[0] == 0.0);
+    for (i = 0; i < N; i++) {
+        double score = (double) (i % 100);
+        int b = score < 10.0 ? 0 : score < 50.5 ? 2 : 3;
+        slInsert(sl, score, &items[i], random_level(12));
+        expected[b]++;
+        expectedsums[b] += score;
+    }
+    CHECK(slHistogram(sl, edges, 5, counts, NULL) == 0);
+    CHECK(slHistogram(sl, edges, 5, counts, sums) == 0);
+    for (i = 0; i < 4; i++)
+        CHECK(counts[i] == expected[i] && sums[i] == expectedsums[i]);
+    CHECK(slHistogram(sl, bad, 2, counts, sums) == -1);
+    CHECK(slHistogram(sl, edges, 1, counts, sums) == 0);
+    slFree(sl);
+}
+
+/* The same scores, objects, heights, spans and weights: each level of
+ * the lists is walked side by side. */
+static int same_structure(skiplist *a, skiplist *b) {
+    skiplistNode *x, *y;
+    int i;
+
+    if (a->length != b->length || a->level != b->level ||
+        a->weight != b->weight)
+        return 0;
+    for (i = 0; i < a->level; i++) {
+        for (x = a->header, y = b->header; x && y;
+             x = x->level[i].forward, y = y->level[i].forward) {
+            if (x != a->header && (x->score != y->score || x->obj != y->obj))
+                return 0;
+            if (x->level[i].span != y->level[i].span ||
+                x->level[i].weight != y->level[i].weight)
+                return 0;
+        }
+        if (x || y) return 0;
+    }
+    return 1;
+}
+
+static void test_copy(void) {
+    enum { N = 3000 };
+    item *items = malloc(N * sizeof(item)), *other = malloc(N * sizeof(item));
+    skiplist *sl = slCreate(12), *copy;
+    skiplistNode *x;
+    unsigned long rank;
+    int i;
+
+    copy = slCopy(sl);
+    CHECK(copy && slLength(copy) == 0 && copy->tail == NULL);
+    slFree(copy);
+
+    for (i = 0; i < N; i++)
+        slInsert(sl, (double) (i % 100), &items[i], random_level(12));
+    copy = slCopy(sl);
+    CHECK(copy && copy->slab && copy->slabLive == N);
+    CHECK(same_structure(sl, copy));
+    CHECK(slMemoryUsage(copy) == slMemoryUsage(sl));
+    for (i = 0; i < N; i += 37)
+        CHECK(slGetRank(copy, (double) (i % 100), &items[i]) ==
+              slGetRank(sl, (double) (i % 100), &items[i]));
+    CHECK(copy->tail->backward->level[0].forward == copy->tail);
+
+    /* Other objects, in reverse address order, need their ties sorted. */
+    for (x = copy->header->level[0].forward, i = 0; x;
+         x = x->level[0].forward, i++)
+        x->obj = &other[N - 1 - i];
+    CHECK(slSortTies(copy) == 0);
+    for (x = copy->header->level[0].forward, rank = 1; x;
+         x = x->level[0].forward, rank++)
+        CHECK(slGetRank(copy, x->score, x->obj) == rank);
+    CHECK(weights_ok(copy));
+
+    slDelete(copy, 5.0, copy->header->level[0].forward->level[0].forward->obj, NULL);
+    CHECK(slLength(copy) == N && slLength(sl) == N);
+    slFree(copy);
+    slFree(sl);
+    free(items);
+    free(other);
+}
+
+static void test_delete_many(void) {
+    enum { N = 3000 };
+    item *items = malloc(N * sizeof(item));
+    slEntry *entries = malloc(N * sizeof(slEntry));
+    skiplist *sl = slCreate(12);
+    skiplistNode *x;
+    unsigned long rank, n = 0, count;
+    int i, compared = 0;
+
+    for (i = 0; i < N; i++)
+        slInsert(sl, (double) (i % 100), &items[i], random_level(12));
+    for (i = N - 1; i >= 0; i -= 3) {
+        entries[n].score = (double) (i % 100);
+        entries[n++].obj = &items[i];
+    }
+    /* Not in the list: a wrong score and an unknown object. */
+    entries[0].score = -1.0;
+    entries[n].score = 5.0;
+    entries[n++].obj = &rank;
+    CHECK(slDeleteMany(sl, entries, n) == n - 2);
+    CHECK(slLength(sl) == N - (n - 2));
+    for (x = sl->header->level[0].forward, rank = 1; x;
+         x = x->level[0].forward, rank++) {
+        CHECK(((item *) x->obj - items) % 3 != (N - 1) % 3 ||
+              x->obj == &items[N - 1]);
+        CHECK(x->level[0].forward ? x->level[0].forward->backward == x
+                                  : sl->tail == x);
+        if (rank % 50 == 0)
+            CHECK(slGetRank(sl, x->score, x->obj) == rank);
+    }
+    for (i = 0, count = 0; i < sl->maxlevel; i++)
+        count += sl->levels[i];
+    CHECK(count == slLength(sl));
+    CHECK(weights_ok(sl));
+
+    /* A few entries are deleted one by one; in the slab, too. */
+    CHECK(slRebalance(sl, 0.25) == 0);
+    entries[0].score = (double) ((N - 1) % 100);
+    entries[0].obj = &items[N - 1];
+    CHECK(slDeleteMany(sl, entries, 1) == 1);
+    CHECK(sl->slabLive == slLength(sl));
+    slFree(sl);
+
+    /* The entries are sorted by the comparator. */
+    sl = slCreateWithCompare(12, compare_names, &compared);
+    for (i = 0; i < 100; i++) {
+        snprintf(items[i].name, sizeof(items[i].name), "%03d", 99 - i);
+        slInsert(sl, 1.0, &items[i], random_level(12));
+        entries[i].score = 1.0;
+        entries[i].obj = &items[i];
+    }
+    CHECK(slDeleteMany(sl, entries, 50) == 50);
+    CHECK(slLength(sl) == 50 && weights_ok(sl));
+    for (x = sl->header->level[0].forward; x; x = x->level[0].forward)
+        CHECK((item *) x->obj >= &items[50]);
+    slFree(sl);
+    free(entries);
+    free(items);
+}
+
+static void test_default(void) {
+    item items[2];
+    slPairScore score = {1.0, 2.0};
+    skiplistI64 *sl = slI64Create(8);
+    skiplistPair *pair = slPairCreateWithCompare(8, NULL, NULL);
+
+    slI64Insert(sl, INT64_C(9007199254740993), &items[1], 1);
+    slI64Insert(sl, INT64_C(9007199254740993), &items[0], 1);
+    CHECK(sl->header->level[0].forward->obj == &items[0]);
+    CHECK(slI64GetRank(sl, INT64_C(9007199254740993), &items[1]) == 2);
+    slI64Free(sl);
+
+    slPairInsert(pair, score, &items[0], 1);
+    CHECK(slPairGetRank(pair, score, &items[0]) == 1);
+    slPairFree(pair);
+}
+
+int main(void) {
+    test_compare();
+    test_bulk_load();
+    test_stats();
+    test_resize();
+    test_rebalance();
+    test_counters();
+    test_rank_many();
+    test_weights();
+    test_floor_ceiling();
+    test_histogram();
+    test_copy();
+    test_delete_many();
+    test_default();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
 import os
+import sys
 
 from setuptools.extension import Extension
 from setuptools.command.build_ext import build_ext
@@ -9,11 +10,20 @@ def read(fname):
     with open(os.path.join(os.path.dirname(__file__), fname)) as f:
         return f.read()
 
+# Set SKIPDICT_COUNTERS=1 to compile in the instrumentation counters
+# (see SkipDict.counters()).
+define_macros = []
+if os.environ.get('SKIPDICT_COUNTERS'):
+    define_macros.append(('SKIPLIST_COUNTERS', None))
+
 ext_modules = [
     Extension(
         name='skipdict',
-        sources=['skipdict.c', 'skiplist.c'],
-        depends=['skiplist.h'],
+        sources=['skipdict.c', 'skiplist.c', 'shmskiplist.c'],
+        depends=['skiplist.h', 'skiplist_tmpl.h', 'skiplist_impl.h',
+                 'skipdict.h', 'skipdict_impl.h', 'shmskiplist.h'],
+        libraries=['rt'] if sys.platform.startswith('linux') else [],
+        define_macros=define_macros,
     ),
 ]
 
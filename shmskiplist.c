@@ -0,0 +1,604 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shmskiplist.h"
+
+#define ALIGN(n, a) (((n) + (a) - 1) & ~((uint64_t) (a) - 1))
+#define NODE(sl, off) ((shmNode *) ((sl)->base + (off)))
+#define KEY(sl, x) ((char *) (x) + (sl)->keyoff)
+
+/* Sequence lock. The writer makes the counter odd while it updates the
+ * list; readers retry if it was odd, or has changed, by the time they
+ * are done.
+ *
+ * An update takes microseconds, so a counter that stays odd for
+ * SHM_STALL_NS means the writer died (or was stopped) mid-update. The
+ * reader then gives up with ETIMEDOUT rather than spin forever. */
+
+#define SHM_STALL_NS 1000000000LL
+
+static int shmReadBegin(shmskiplist *sl, uint64_t *seq) {
+    struct timespec now;
+    long long t, deadline = 0;
+    unsigned long spins = 0;
+
+    while ((*seq = __atomic_load_n(&sl->hdr->seq, __ATOMIC_ACQUIRE)) & 1) {
+        if (++spins % 1024 == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            t = now.tv_sec * 1000000000LL + now.tv_nsec;
+            if (!deadline) {
+                deadline = t + SHM_STALL_NS;
+            } else if (t >= deadline) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+        }
+        sched_yield();
+    }
+    return 0;
+}
+
+/* Returns 1 if the read must be retried, -1 if the segment is corrupt
+ * and 0 otherwise. */
+static int shmReadRetry(shmskiplist *sl, uint64_t seq, int torn) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&sl->hdr->seq, __ATOMIC_RELAXED) != seq)
+        return 1;
+    return torn ? -1 : 0;
+}
+
+static void shmWriteBegin(shmskiplist *sl) {
+    __atomic_store_n(&sl->hdr->seq, sl->hdr->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void shmWriteEnd(shmskiplist *sl) {
+    __atomic_store_n(&sl->hdr->seq, sl->hdr->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* A reader may see any offset while the writer is active; check that
+ * it points to a node before following it. */
+static inline int shmValid(shmskiplist *sl, uint64_t off) {
+    return off >= sl->nodes && off < sl->size &&
+        (off - sl->nodes) % sl->nodesize == 0;
+}
+
+static uint64_t shmHash(const shmKey *key) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const unsigned char *p;
+    uint32_t i, n;
+
+    if (key->kind == SHM_INT) {
+        p = (const unsigned char *) &key->ival;
+        n = sizeof(key->ival);
+    } else {
+        p = (const unsigned char *) key->data;
+        n = key->len;
+    }
+    h = (h ^ (uint64_t) key->kind) * 0x100000001b3ULL;
+    for (i = 0; i < n; i++)
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+static void shmKeyOf(shmskiplist *sl, shmNode *x, shmKey *key) {
+    key->kind = x->kind;
+    key->ival = x->ival;
+    key->data = KEY(sl, x);
+    key->len = x->keylen < sl->keysize ? x->keylen : sl->keysize;
+}
+
+/* Integers sort before byte strings; byte strings sort like Python
+ * bytes. */
+static int shmKeyCompare(shmskiplist *sl, shmNode *x, const shmKey *key) {
+    uint32_t len = x->keylen < sl->keysize ? x->keylen : sl->keysize;
+    int c;
+
+    if (x->kind != key->kind)
+        return x->kind < key->kind ? -1 : 1;
+    if (x->kind == SHM_INT)
+        return (x->ival > key->ival) - (x->ival < key->ival);
+    c = memcmp(KEY(sl, x), key->data, len < key->len ? len : key->len);
+    if (c) return c;
+    return (len > key->len) - (len < key->len);
+}
+
+static inline int shmLess(shmskiplist *sl, shmNode *x, double score,
+                          const shmKey *key) {
+    return x->score < score ||
+        (x->score == score && shmKeyCompare(sl, x, key) < 0);
+}
+
+/* Find the node for a key in the hash index. Returns its offset, or 0
+ * if the key is not present; the slot is where the key is (or would
+ * be) stored. */
+static uint64_t shmLookup(shmskiplist *sl, const shmKey *key, uint64_t hash,
+                          uint64_t *slot, int *torn) {
+    uint64_t mask = sl->slots - 1, i = hash & mask, n, off;
+    shmNode *x;
+
+    for (n = 0; n < sl->slots; n++, i = (i + 1) & mask) {
+        off = sl->table[i];
+        if (!off) break;
+        if (!shmValid(sl, off)) {
+            *torn = 1;
+            return 0;
+        }
+        x = NODE(sl, off);
+        if (x->hash == hash && shmKeyCompare(sl, x, key) == 0) {
+            if (slot) *slot = i;
+            return off;
+        }
+    }
+    if (slot) *slot = i;
+    return 0;
+}
+
+/* Backward-shift deletion keeps the probe sequences intact without
+ * tombstones. */
+static void shmTableRemove(shmskiplist *sl, uint64_t i) {
+    uint64_t mask = sl->slots - 1, j = i, k, off;
+
+    while (1) {
+        j = (j + 1) & mask;
+        off = sl->table[j];
+        if (!off) break;
+        k = NODE(sl, off)->hash & mask;
+        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            sl->table[i] = off;
+            i = j;
+        }
+    }
+    sl->table[i] = 0;
+}
+
+static uint64_t shmAllocNode(shmskiplist *sl) {
+    shmHeader *h = sl->hdr;
+    uint64_t off = h->freelist;
+
+    if (off) {
+        h->freelist = NODE(sl, off)->levels[0].forward;
+    } else if (h->used <= sl->capacity) {
+        off = sl->nodes + h->used * sl->nodesize;
+        h->used++;
+    }
+    return off;
+}
+
+static void shmFreeNode(shmskiplist *sl, uint64_t off) {
+    NODE(sl, off)->levels[0].forward = sl->hdr->freelist;
+    sl->hdr->freelist = off;
+}
+
+static void shmLink(shmskiplist *sl, uint64_t xoff) {
+    shmHeader *h = sl->hdr;
+    shmNode *x = NODE(sl, xoff), *u;
+    uint64_t update[sl->maxlevel], rank[sl->maxlevel], y = h->header, f;
+    shmKey key;
+    int i;
+
+    shmKeyOf(sl, x, &key);
+    for (i = h->level - 1; i >= 0; i--) {
+        /* store rank that is crossed to reach the insert position */
+        rank[i] = i == (h->level - 1) ? 0 : rank[i + 1];
+        while ((f = NODE(sl, y)->levels[i].forward) &&
+               shmLess(sl, NODE(sl, f), x->score, &key)) {
+            rank[i] += NODE(sl, y)->levels[i].span;
+            y = f;
+        }
+        update[i] = y;
+    }
+    if (x->level > h->level) {
+        for (i = h->level; i < x->level; i++) {
+            rank[i] = 0;
+            update[i] = h->header;
+            NODE(sl, h->header)->levels[i].span = h->length;
+        }
+        h->level = x->level;
+    }
+    for (i = 0; i < x->level; i++) {
+        u = NODE(sl, update[i]);
+        x->levels[i].forward = u->levels[i].forward;
+        u->levels[i].forward = xoff;
+        x->levels[i].span = u->levels[i].span - (rank[0] - rank[i]);
+        u->levels[i].span = (rank[0] - rank[i]) + 1;
+    }
+    for (i = x->level; i < h->level; i++)
+        NODE(sl, update[i])->levels[i].span++;
+
+    x->backward = (update[0] == h->header) ? 0 : update[0];
+    if (x->levels[0].forward)
+        NODE(sl, x->levels[0].forward)->backward = xoff;
+    else
+        h->tail = xoff;
+    h->length++;
+}
+
+static void shmUnlink(shmskiplist *sl, uint64_t xoff) {
+    shmHeader *h = sl->hdr;
+    shmNode *x = NODE(sl, xoff), *u;
+    uint64_t update[sl->maxlevel], y = h->header, f;
+    shmKey key;
+    int i;
+
+    shmKeyOf(sl, x, &key);
+    for (i = h->level - 1; i >= 0; i--) {
+        while ((f = NODE(sl, y)->levels[i].forward) &&
+               shmLess(sl, NODE(sl, f), x->score, &key))
+            y = f;
+        update[i] = y;
+    }
+    for (i = 0; i < h->level; i++) {
+        u = NODE(sl, update[i]);
+        if (u->levels[i].forward == xoff) {
+            u->levels[i].span += x->levels[i].span - 1;
+            u->levels[i].forward = x->levels[i].forward;
+        } else {
+            u->levels[i].span -= 1;
+        }
+    }
+    if (x->levels[0].forward)
+        NODE(sl, x->levels[0].forward)->backward = x->backward;
+    else
+        h->tail = x->backward;
+    while (h->level > 1 &&
+           NODE(sl, h->header)->levels[h->level - 1].forward == 0)
+        h->level--;
+    h->length--;
+}
+
+static shmskiplist *shmMap(int fd, size_t size, int writable) {
+    shmskiplist *sl = malloc(sizeof(*sl));
+    void *base;
+
+    if (!sl) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    base = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        free(sl);
+        return NULL;
+    }
+    sl->base = base;
+    sl->hdr = base;
+    sl->size = size;
+    sl->writable = writable;
+    return sl;
+}
+
+static void shmGeometry(shmskiplist *sl) {
+    shmHeader *h = sl->hdr;
+
+    sl->maxlevel = h->maxlevel;
+    sl->keysize = h->keysize;
+    sl->capacity = h->capacity;
+    sl->nodesize = h->nodesize;
+    sl->keyoff = h->keyoff;
+    sl->nodes = h->nodes;
+    sl->slots = h->slots;
+    sl->table = (uint64_t *) (sl->base + h->table);
+}
+
+/* Create a segment for up to capacity keys. Returns NULL and sets
+ * errno on failure; an existing segment is never replaced. */
+shmskiplist *shmslCreate(const char *name, uint64_t capacity,
+                         int maxlevel, uint32_t keysize) {
+    uint64_t slots = 8, keyoff, nodesize, table, nodes, size;
+    shmskiplist *sl;
+    shmHeader *h;
+    int fd, i;
+
+    if (capacity < 1 || capacity > (1ULL << 40) ||
+        maxlevel < 1 || maxlevel > 64 || keysize > (1U << 20)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    while (slots < 2 * capacity)
+        slots *= 2;
+    keyoff = sizeof(shmNode) + maxlevel * sizeof(shmLevel);
+    nodesize = ALIGN(keyoff + keysize, 8);
+    table = ALIGN(sizeof(shmHeader), 64);
+    nodes = ALIGN(table + slots * sizeof(uint64_t), 64);
+    size = nodes + (capacity + 1) * nodesize;
+
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, size) || !(sl = shmMap(fd, size, 1))) {
+        i = errno;
+        close(fd);
+        shm_unlink(name);
+        errno = i;
+        return NULL;
+    }
+    close(fd);
+
+    h = sl->hdr;
+    h->size = size;
+    h->capacity = capacity;
+    h->maxlevel = maxlevel;
+    h->keysize = keysize;
+    h->nodesize = nodesize;
+    h->keyoff = keyoff;
+    h->nodes = nodes;
+    h->table = table;
+    h->slots = slots;
+    h->header = nodes;
+    h->used = 1;
+    h->level = 1;
+    NODE(sl, nodes)->level = maxlevel;
+    shmGeometry(sl);
+
+    /* Readers check the magic number last. */
+    __atomic_store_n(&h->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    return sl;
+}
+
+/* Map an existing segment read-only. */
+shmskiplist *shmslOpen(const char *name) {
+    shmskiplist *sl;
+    shmHeader *h;
+    struct stat st;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return NULL;
+    }
+    if ((size_t) st.st_size < sizeof(shmHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    sl = shmMap(fd, st.st_size, 0);
+    close(fd);
+    if (!sl) return NULL;
+
+    h = sl->hdr;
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+        h->size != (uint64_t) st.st_size || h->maxlevel < 1 ||
+        h->maxlevel > 64 ||
+        h->keyoff != sizeof(shmNode) + h->maxlevel * sizeof(shmLevel) ||
+        h->nodesize < h->keyoff + h->keysize ||
+        h->slots < 2 * h->capacity || (h->slots & (h->slots - 1)) ||
+        h->table < sizeof(shmHeader) ||
+        h->nodes < h->table + h->slots * sizeof(uint64_t) ||
+        h->nodes + (h->capacity + 1) * h->nodesize != h->size) {
+        shmslClose(sl);
+        errno = EINVAL;
+        return NULL;
+    }
+    shmGeometry(sl);
+    return sl;
+}
+
+void shmslClose(shmskiplist *sl) {
+    munmap(sl->base, sl->size);
+    free(sl);
+}
+
+int shmslUnlink(const char *name) {
+    return shm_unlink(name);
+}
+
+int shmslSet(shmskiplist *sl, const shmKey *key, double score, int level) {
+    uint64_t hash = shmHash(key), slot = 0, off;
+    shmNode *x, *y;
+    int torn = 0;
+
+    if (key->kind == SHM_BYTES && key->len > sl->keysize)
+        return -2;
+
+    off = shmLookup(sl, key, hash, &slot, &torn);
+    if (off) {
+        x = NODE(sl, off);
+        if (x->score == score)
+            return 0;
+        shmWriteBegin(sl);
+        /* Update the score in place if the order is unchanged. */
+        y = x->levels[0].forward ? NODE(sl, x->levels[0].forward) : NULL;
+        if ((!x->backward ||
+             shmLess(sl, NODE(sl, x->backward), score, key)) &&
+            (!y || !shmLess(sl, y, score, key))) {
+            x->score = score;
+        } else {
+            shmUnlink(sl, off);
+            x->score = score;
+            shmLink(sl, off);
+        }
+        shmWriteEnd(sl);
+        return 0;
+    }
+
+    shmWriteBegin(sl);
+    off = shmAllocNode(sl);
+    if (!off) {
+        shmWriteEnd(sl);
+        return -1;
+    }
+    x = NODE(sl, off);
+    memset(x, 0, sl->nodesize);
+    x->score = score;
+    x->hash = hash;
+    x->kind = key->kind;
+    x->level = level < 1 ? 1 : (level > sl->maxlevel ? sl->maxlevel : level);
+    if (key->kind == SHM_INT) {
+        x->ival = key->ival;
+    } else {
+        x->keylen = key->len;
+        memcpy(KEY(sl, x), key->data, key->len);
+    }
+    shmLink(sl, off);
+    sl->table[slot] = off;
+    shmWriteEnd(sl);
+    return 0;
+}
+
+int shmslDelete(shmskiplist *sl, const shmKey *key) {
+    uint64_t slot, off;
+    int torn = 0;
+
+    off = shmLookup(sl, key, shmHash(key), &slot, &torn);
+    if (!off) return 0;
+
+    shmWriteBegin(sl);
+    shmUnlink(sl, off);
+    shmTableRemove(sl, slot);
+    shmFreeNode(sl, off);
+    shmWriteEnd(sl);
+    return 1;
+}
+
+int shmslGet(shmskiplist *sl, const shmKey *key, double *score) {
+    uint64_t hash = shmHash(key), seq, off;
+    int torn, rc;
+
+    do {
+        if (shmReadBegin(sl, &seq)) return -1;
+        torn = 0;
+        off = shmLookup(sl, key, hash, NULL, &torn);
+        if (off) *score = NODE(sl, off)->score;
+    } while ((rc = shmReadRetry(sl, seq, torn)) > 0);
+    return rc < 0 ? -1 : off != 0;
+}
+
+/* Count the nodes that sort before the score/key pair. Every step
+ * moves forward, so a reader can take at most capacity steps on each
+ * level of an intact list. */
+static uint64_t shmCountLess(shmskiplist *sl, double score,
+                             const shmKey *key, int *torn) {
+    uint64_t x = sl->hdr->header, f, rank = 0, steps = 0;
+    int level = sl->hdr->level, i;
+
+    if (level < 1 || level > sl->maxlevel) {
+        *torn = 1;
+        return 0;
+    }
+    for (i = level - 1; i >= 0; i--) {
+        while ((f = NODE(sl, x)->levels[i].forward)) {
+            if (!shmValid(sl, f) || ++steps > sl->capacity * level) {
+                *torn = 1;
+                return 0;
+            }
+            if (!shmLess(sl, NODE(sl, f), score, key))
+                break;
+            rank += NODE(sl, x)->levels[i].span;
+            x = f;
+        }
+    }
+    return rank;
+}
+
+/* Returns the 1-based rank of the key, 0 if it is not present, or -1
+ * if the segment is corrupt. */
+long shmslGetRank(shmskiplist *sl, const shmKey *key) {
+    uint64_t hash = shmHash(key), seq, off, rank = 0;
+    double score;
+    int torn, rc;
+
+    do {
+        if (shmReadBegin(sl, &seq)) return -1;
+        torn = 0;
+        rank = 0;
+        off = shmLookup(sl, key, hash, NULL, &torn);
+        if (off) {
+            score = NODE(sl, off)->score;
+            rank = shmCountLess(sl, score, key, &torn) + 1;
+        }
+    } while ((rc = shmReadRetry(sl, seq, torn)) > 0);
+    return rc < 0 ? -1 : (long) rank;
+}
+
+unsigned long shmslLength(shmskiplist *sl) {
+    return __atomic_load_n(&sl->hdr->length, __ATOMIC_ACQUIRE);
+}
+
+size_t shmslEntrySize(shmskiplist *sl) {
+    return ALIGN(sizeof(shmEntry) + sl->keysize, 8);
+}
+
+/* Copy the entries with a score in [min, max] into a newly allocated
+ * array (which the caller must free). Returns the number of entries,
+ * or -1 if out of memory or the segment is corrupt. */
+long shmslRange(shmskiplist *sl, double min, double max,
+                shmEntry **entries) {
+    size_t stride = shmslEntrySize(sl);
+    uint64_t seq, x, f, n, steps, allocated = 0;
+    shmEntry *e;
+    shmNode *y;
+    char *buf = NULL, *grown;
+    int torn, rc, i, level;
+
+    do {
+        if (shmReadBegin(sl, &seq)) {
+            free(buf);
+            return -1;
+        }
+        torn = 0;
+        n = 0;
+        steps = 0;
+        x = sl->hdr->header;
+        level = sl->hdr->level;
+        if (level < 1 || level > sl->maxlevel) {
+            torn = 1;
+            continue;
+        }
+        for (i = level - 1; i >= 0 && !torn; i--) {
+            while ((f = NODE(sl, x)->levels[i].forward)) {
+                if (!shmValid(sl, f) || ++steps > sl->capacity * level) {
+                    torn = 1;
+                    break;
+                }
+                if (NODE(sl, f)->score >= min)
+                    break;
+                x = f;
+            }
+        }
+        if (torn) continue;
+
+        x = NODE(sl, x)->levels[0].forward;
+        while (x) {
+            if (!shmValid(sl, x) || n >= sl->capacity) {
+                torn = 1;
+                break;
+            }
+            y = NODE(sl, x);
+            if (y->score > max) break;
+            if (n == allocated) {
+                allocated = allocated ? 2 * allocated : 64;
+                grown = realloc(buf, allocated * stride);
+                if (!grown) {
+                    free(buf);
+                    return -1;
+                }
+                buf = grown;
+            }
+            e = (shmEntry *) (buf + n * stride);
+            e->score = y->score;
+            e->ival = y->ival;
+            e->kind = y->kind;
+            e->keylen = y->keylen < sl->keysize ? y->keylen : sl->keysize;
+            memcpy(e->key, KEY(sl, y), e->keylen);
+            n++;
+            x = y->levels[0].forward;
+        }
+    } while ((rc = shmReadRetry(sl, seq, torn)) > 0);
+
+    if (rc < 0) {
+        free(buf);
+        return -1;
+    }
+    *entries = (shmEntry *) buf;
+    return (long) n;
+}
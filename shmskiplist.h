@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Skiplist in a POSIX shared-memory segment.
+ *
+ * Links are offsets from the start of the segment rather than
+ * pointers, such that each process can map the segment at a different
+ * address. Keys are byte strings (up to a fixed size chosen when the
+ * segment is created) or 64-bit integers, and are stored in the nodes
+ * themselves; a hash index (open addressing with linear probing) in
+ * the same segment maps keys to nodes. Entries with the same score are
+ * ordered by key, so the order is the same in every process.
+ *
+ * There is one writer, which creates the segment, and any number of
+ * readers which map it read-only. Readers use a sequence lock: they
+ * copy out what they need and retry if the writer was active in the
+ * meantime. All offsets are checked before they are followed, so a
+ * reader never leaves the segment even when it observes a torn
+ * update. */
+
+#define SHM_MAGIC 0x736b6970646963ULL
+
+typedef struct shmLevel {
+    uint64_t forward;
+    uint64_t span;
+} shmLevel;
+
+typedef struct shmNode {
+    double score;
+    uint64_t backward;
+    uint64_t hash;
+    int64_t ival;
+    uint32_t keylen;
+    uint8_t kind;
+    uint8_t level;
+    shmLevel levels[];
+} shmNode;
+
+typedef struct shmHeader {
+    uint64_t magic;
+    uint64_t seq;
+    uint64_t size;
+    uint64_t capacity;
+    uint32_t maxlevel;
+    uint32_t keysize;
+    uint64_t nodesize;
+    uint64_t keyoff;
+    uint64_t nodes;
+    uint64_t table;
+    uint64_t slots;
+    uint64_t header;
+    uint64_t tail;
+    uint64_t length;
+    uint64_t used;
+    uint64_t freelist;
+    int32_t level;
+} shmHeader;
+
+/* The geometry of the segment is copied from the header when it is
+ * mapped, such that readers never depend on it being intact. */
+typedef struct shmskiplist {
+    shmHeader *hdr;
+    char *base;
+    size_t size;
+    int writable;
+    int maxlevel;
+    uint32_t keysize;
+    uint64_t capacity;
+    uint64_t nodesize;
+    uint64_t keyoff;
+    uint64_t nodes;
+    uint64_t slots;
+    uint64_t *table;
+} shmskiplist;
+
+enum { SHM_INT = 0, SHM_BYTES = 1 };
+
+typedef struct shmKey {
+    int kind;
+    int64_t ival;
+    const char *data;
+    uint32_t len;
+} shmKey;
+
+/* Entries copied out by a range read; see shmslEntrySize(). */
+typedef struct shmEntry {
+    double score;
+    int64_t ival;
+    uint32_t keylen;
+    uint8_t kind;
+    char key[];
+} shmEntry;
+
+shmskiplist *shmslCreate(const char *name, uint64_t capacity,
+                         int maxlevel, uint32_t keysize);
+shmskiplist *shmslOpen(const char *name);
+void shmslClose(shmskiplist *sl);
+int shmslUnlink(const char *name);
+
+/* Writer. Returns 0 on success, -1 when full and -2 if the key is too
+ * long. */
+int shmslSet(shmskiplist *sl, const shmKey *key, double score, int level);
+int shmslDelete(shmskiplist *sl, const shmKey *key);
+
+/* Readers. These return -1 if the segment is corrupt, or with errno
+ * set to ETIMEDOUT if the writer stalled in the middle of an update
+ * (e.g. the process died). */
+int shmslGet(shmskiplist *sl, const shmKey *key, double *score);
+long shmslGetRank(shmskiplist *sl, const shmKey *key);
+unsigned long shmslLength(shmskiplist *sl);
+size_t shmslEntrySize(shmskiplist *sl);
+long shmslRange(shmskiplist *sl, double min, double max, shmEntry **entries);
@@ -3,10 +3,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include "skiplist.h"
+#include "shmskiplist.h"
+
+#define SKIPDICT_MODULE
+#include "skipdict.h"
+
+#include <pthread.h>
 
 #define MAXLEVEL 32
 #define P 0.25
+#define BULK_CHUNK 32768
+#define BULK_THREADS 32
+#define REAP_STEP 2
 
 #if PY_VERSION_HEX < 0x02050000 && !defined(PY_SSIZE_T_MIN)
 typedef int Py_ssize_t;
@@ -29,6 +41,7 @@ inline void PyString_Concat(PyObject** lhs, PyObject* rhs)
 }
 #define PySliceObject PyObject
 #define PyInt_FromLong PyLong_FromLong
+#define PyInt_FromSsize_t PyLong_FromSsize_t
 #define PyInt_AsLong PyLong_AsLong
 #define PyString_FromString PyUnicode_FromString
 #define PyString_FromFormat PyUnicode_FromFormat
@@ -40,6 +53,30 @@ inline void PyString_Concat(PyObject** lhs, PyObject* rhs)
 #define INITERROR return
 #endif
 
+#if PY_VERSION_HEX < 0x03020000
+typedef long Py_hash_t;
+#endif
+
+/* Mutations hash the key before taking the write lock, since __hash__
+   may run arbitrary code, and then use these. Python 2 has no
+   free-threaded builds, where the lock compiles to nothing. */
+#if PY_MAJOR_VERSION >= 3
+#if PY_VERSION_HEX >= 0x030D0000
+/* Still exported, though only declared for the core since 3.13. */
+PyAPI_FUNC(int) _PyDict_SetItem_KnownHash(PyObject *, PyObject *,
+                                          PyObject *, Py_hash_t);
+PyAPI_FUNC(int) _PyDict_DelItem_KnownHash(PyObject *, PyObject *,
+                                          Py_hash_t);
+#endif
+#define Dict_GetItemHash _PyDict_GetItem_KnownHash
+#define Dict_SetItemHash _PyDict_SetItem_KnownHash
+#define Dict_DelItemHash _PyDict_DelItem_KnownHash
+#else
+#define Dict_GetItemHash(mp, key, hash) PyDict_GetItem(mp, key)
+#define Dict_SetItemHash(mp, key, item, hash) PyDict_SetItem(mp, key, item)
+#define Dict_DelItemHash(mp, key, hash) PyDict_DelItem(mp, key)
+#endif
+
 #define double_AsString(value) \
     PyOS_double_to_string(value, 'r', 0, Py_DTSF_ADD_DOT_0, 0);
 
@@ -62,242 +99,93 @@ inline void PyString_Concat(PyObject** lhs, PyObject* rhs)
     Py_INCREF(type);                                    \
     PyModule_AddObject(mod, name, (PyObject *)type);
 
-#define skipdict_Check(op) PyObject_TypeCheck(op, &SkipDictType)
+/* On free-threaded builds, each skip dict carries a reader-writer
+   lock: lookups, rank queries and iteration share it while mutations
+   take it exclusively. With the GIL, the macros compile to nothing. */
+#ifdef Py_GIL_DISABLED
+#define Read_Lock(self) skipdict_rdlock(&(self)->lock)
+#define Read_Unlock(self) pthread_rwlock_unlock(&(self)->lock)
+#define Write_Lock(self) skipdict_wrlock(&(self)->lock)
+#define Write_Unlock(self) pthread_rwlock_unlock(&(self)->lock)
+#else
+#define Read_Lock(self) do { } while (0)
+#define Read_Unlock(self) do { } while (0)
+#define Write_Lock(self) do { } while (0)
+#define Write_Unlock(self) do { } while (0)
+#endif
+
+#define skipdict_Check(op)                          \
+    (PyObject_TypeCheck(op, &SkipDictType) ||       \
+     PyObject_TypeCheck(op, &Int64SkipDictType) ||  \
+     PyObject_TypeCheck(op, &PairSkipDictType))
 #define skipdict_CheckExact(op) (Py_TYPE(op) == &SkipDictType)
 
 static PyTypeObject SkipDictType;
 static PyTypeObject SkipDictIterType;
+static PyTypeObject Int64SkipDictType;
+static PyTypeObject Int64SkipDictIterType;
+static PyTypeObject PairSkipDictType;
+static PyTypeObject PairSkipDictIterType;
+static PyTypeObject ShardedSkipDictType;
+static PyTypeObject ShardedSkipDictIterType;
+static PyTypeObject SharedSkipDictType;
 
 typedef enum {KEY, VALUE, ITEM} itertype;
 
-typedef struct {
-    PyObject_HEAD
-    skiplist *skiplist;
-    PyObject *random;
-    PyObject *mapping;
-} SkipDictObject;
-
-typedef struct {
-    PyObject_HEAD
-    SkipDictObject *skipdict;
-    skiplistiter *iter;
-    itertype type;
-    unsigned long length;
-} SkipDictIterObject;
-
-typedef PyObject * (*iterfunc)(double score, PyObject*);
-
-static PyObject * skipdictiter_next_key(double score, PyObject* value);
-static PyObject * skipdictiter_next_value(double score, PyObject* value);
-static PyObject * skipdictiter_next_item(double score, PyObject* value);
-
-static iterfunc iterators[3] = { skipdictiter_next_key,
-                                 skipdictiter_next_value,
-                                 skipdictiter_next_item };
-
 static const char* iterator_names[3] = { "keys", "values", "items" };
 static const char* booleans[2] = { "false", "true" };
 
-static PyObject *
-skipdict_index(SkipDictObject *self, PyObject *key)
-{
-    PyObject* item = PyDict_GetItem(self->mapping, key);
-    if (!item) {
-        PyErr_SetObject(PyExc_KeyError,
-                        PyObject_Repr(key));
-        return NULL;
-    }
-    PyObject* value = PyTuple_GET_ITEM(item, 1);
-    double score = PyFloat_AsDouble(value);
-    if (score == -1.0 && PyErr_Occurred()) return 0;
-
-    unsigned long rank = slGetRank(self->skiplist, score, (void*) item);
-    if (!rank) {
-        return NULL;
-    }
-
-    return PyLong_FromLong(rank - 1);
-}
-
-static int
-skipdictiter_fetch(skiplistiter *iter, double *score, PyObject **obj)
-{
-    PyObject* item;
-    if (slIterGet(iter, score, (void*) &item)) {
-        PyErr_SetString(PyExc_StopIteration, "");
-        return -1;
-    }
 
-    if (slIterNext(iter)) {
-        PyErr_SetString(PyExc_TypeError,
-                        "unable to advance the internal iterator");
-        return -1;
-    }
-
-    *obj = PyTuple_GET_ITEM(item, 0);
-    return 0;
-}
-
-static PyObject *
-skipdictiter_next(SkipDictIterObject *it)
+#ifdef Py_GIL_DISABLED
+/* Block without holding on to the thread state such that a
+   stop-the-world pause can proceed while we wait. */
+static void
+skipdict_rdlock(pthread_rwlock_t *lock)
 {
-    if (it->length == 0) {
-        PyErr_SetString(PyExc_StopIteration, "");
-        return NULL;
-    }
-
-    double score;
-    PyObject *key;
-
-    int err = skipdictiter_fetch(it->iter, &score, &key);
-    if (err) {
-        return NULL;
+    if (pthread_rwlock_tryrdlock(lock)) {
+        Py_BEGIN_ALLOW_THREADS
+        pthread_rwlock_rdlock(lock);
+        Py_END_ALLOW_THREADS
     }
-
-    it->length--;
-
-    return iterators[it->type](score, key);
-}
-
-static PyObject *
-skipdictiter_next_key(double score, PyObject* key)
-{
-    Py_INCREF(key);
-    return key;
-}
-
-static PyObject *
-skipdictiter_next_value(double score, PyObject* key)
-{
-    return (PyObject *) PyFloat_FromDouble(score);
-}
-
-static PyObject *
-skipdictiter_next_item(double score, PyObject* key)
-{
-    Py_INCREF(key);
-    return Py_BuildValue("(OO)",
-                         key,
-                         (PyObject *) PyFloat_FromDouble(score));
 }
 
 static void
-skipdictiter_dealloc(SkipDictIterObject *it)
-{
-    PyObject_GC_UnTrack(it);
-    slIterDel(it->iter);
-    Py_XDECREF(it->skipdict);
-    PyObject_GC_Del(it);
-}
-
-static int
-skipdictiter_traverse(SkipDictIterObject *it, visitproc visit, void *arg)
-{
-    Py_VISIT(it->skipdict);
-    return 0;
-}
-
-static int
-skipdict_delitem(SkipDictObject *self, PyObject *key, int delete)
+skipdict_wrlock(pthread_rwlock_t *lock)
 {
-    PyObject* item = PyDict_GetItem(self->mapping, key);
-    if (!item) goto Fail;
-    PyObject* value = PyTuple_GET_ITEM(item, 1);
-    if (delete) PyDict_DelItem(self->mapping, key);
-    if (!slDelete(self->skiplist, PyFloat_AsDouble(value), (void*) item, 0)) {
-        goto Fail;
+    if (pthread_rwlock_trywrlock(lock)) {
+        Py_BEGIN_ALLOW_THREADS
+        pthread_rwlock_wrlock(lock);
+        Py_END_ALLOW_THREADS
     }
-    return 0;
- Fail:
-    PyErr_SetObject(PyExc_KeyError, key);
-    return -1;
 }
+#endif
 
+/* Looks up the record of a key with a new reference, or NULL if it is
+   missing. Comparing keys may run arbitrary code, so lookups happen
+   before taking the lock. Returns -1 on error. */
 static int
-skipdict_insertobj(SkipDictObject *self, PyObject *key, PyObject *value,
-                   int mode)
+skipdict_lookup(PyObject *mapping, PyObject *key, PyObject **record)
 {
-    PyObject *item, *previous;
-    double score = PyFloat_AsDouble(value);
-    double s;
-    int level;
-
-    if (!PyNumber_Check(value)) {
-        PyObject *repr = PyObject_Repr(value);
-        PyErr_Format(PyExc_TypeError,
-                     "not a number: %s",
-                     PyString_AsString(repr));
-        Py_DECREF(repr);
-        return -1;
-    }
-
-    if (score == -1.0 && PyErr_Occurred()) {
-        return -1;
-    }
-
-    if (mode > 0) {
-        if ((item = PyDict_GetItem(self->mapping, key))) {
-            previous = PyTuple_GET_ITEM(item, 1);
-            s = PyFloat_AsDouble(previous);
-
-            if (mode == 1) {
-                score -= s;
-            } else {
-                value = PyNumber_Add(value, previous);
-                if (!value) return -1;
-            }
-
-            switch (slDelete(self->skiplist, s, (void*) item, score)) {
-                case 0:
-                    return -1;
-                case 1:
-                    break;
-                case 2:
-                    PyTuple_SetItem(item, 1, value);
-                    Py_INCREF(value);
-                    return 0;
-            }
-
-            score += s;
-        }
-    }
-
-    item = PyTuple_Pack(2, key, value);
-    PyDict_SetItem(self->mapping, key, item);
-    Py_DECREF(item);
-
-    if (self->random) {
-        PyObject* result = PyObject_CallFunction(self->random, "i",
-                                                 self->skiplist->maxlevel);
-        level = (int) PyInt_AsLong(result);
-        if (level == -1 && PyErr_Occurred()) {
-            PyErr_Format(PyExc_TypeError,
-                         "not an integer: %s",
-                         PyString_AsString(PyObject_Repr(result)));
-            Py_XDECREF(result);
-            return -1;
-        }
-        Py_XDECREF(result);
-        if (level > self->skiplist->maxlevel) {
-            PyErr_Format(PyExc_ValueError,
-                         "level not in range (0-%d): %d",
-                         self->skiplist->maxlevel,
-                         level);
-            return -1;
-        }
-    } else {
-        level = 1;
-        while((random() & 0xffff) < (P * 0xffff))
-            level += 1;
-        level = (level < self->skiplist->maxlevel) \
-            ? level : self->skiplist->maxlevel;
-    }
-    slInsert(self->skiplist, score, (void*) item, level);
+#ifdef Py_GIL_DISABLED
+    return PyDict_GetItemRef(mapping, key, record) < 0 ? -1 : 0;
+#elif PY_MAJOR_VERSION >= 3
+    *record = PyDict_GetItemWithError(mapping, key);
+    if (!*record && PyErr_Occurred()) return -1;
+#else
+    /* PyDict_GetItem() hides the errors of hashing. */
+    if (PyObject_Hash(key) == -1) return -1;
+    *record = PyDict_GetItem(mapping, key);
+#endif
+    Py_XINCREF(*record);
     return 0;
 }
 
+typedef int (*pairfunc)(void *arg, PyObject *key, PyObject *value);
+
+/* Call func for each (key, value) pair of a dict, item sequence or
+   iterable. */
 static int
-skipdict_insertseq(SkipDictObject *self, PyObject *seq)
+skipdict_foreach(PyObject *seq, pairfunc func, void *arg)
 {
     PyObject *it = NULL;
     Py_ssize_t i;
@@ -355,7 +243,7 @@ skipdict_insertseq(SkipDictObject *self, PyObject *seq)
         key = PySequence_Fast_GET_ITEM(fast, 0);
         value = PySequence_Fast_GET_ITEM(fast, 1);
 
-        if (skipdict_insertobj(self, key, value, 2)) {
+        if (func(arg, key, value)) {
             goto Fail;
         }
 
@@ -368,528 +256,2326 @@ skipdict_insertseq(SkipDictObject *self, PyObject *seq)
 Fail:
     Py_XDECREF(item);
     Py_XDECREF(fast);
-    Py_XDECREF(ref);
     i = -1;
 Return:
     Py_XDECREF(it);
+    Py_XDECREF(ref);
     return Py_SAFE_DOWNCAST(i, Py_ssize_t, int);
 }
 
-static PyObject *
-skipdict_change(SkipDictObject *self, PyObject *args)
+
+static int
+skipdict_bulkthreads(Py_ssize_t n)
 {
-    PyObject *key, *change;
-    if (!PyArg_ParseTuple(args, "OO:change", &key, &change)) {
-        return NULL;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long threads = (long) (n / BULK_CHUNK);
+
+    if (threads > cpus) threads = cpus;
+    if (threads > BULK_THREADS) threads = BULK_THREADS;
+    return threads < 1 ? 1 : (int) threads;
+}
+
+
+/* Score types. Each instantiation of skipdict_impl.h converts between
+   Python objects and its score type using the functions below. */
+
+/* How union() and intersection() combine the scores of a key. */
+enum { AGGREGATE_SUM, AGGREGATE_MIN, AGGREGATE_MAX };
+
+#define AGGREGATE(aggregate, acc, score, less)                         \
+    switch (aggregate) {                                                \
+    case AGGREGATE_MIN: if (less(score, acc)) acc = score; break;       \
+    case AGGREGATE_MAX: if (less(acc, score)) acc = score; break;       \
     }
 
-    if (skipdict_insertobj(self, key, change, 2)) return NULL;
+#define NUMBER_LESS(a, b) ((a) < (b))
+#define PAIR_LESS(a, b) ((a).primary < (b).primary ||                   \
+                         ((a).primary == (b).primary &&                 \
+                          (a).secondary < (b).secondary))
 
-    Py_INCREF(Py_None);
-    return Py_None;
+static int
+skipdict_nota(const char *what, PyObject *value)
+{
+#if PY_MAJOR_VERSION >= 3
+    PyErr_Format(PyExc_TypeError, "not %s: %R", what, value);
+#else
+    PyObject *repr = PyObject_Repr(value);
+    if (repr) {
+        PyErr_Format(PyExc_TypeError, "not %s: %s", what,
+                     PyString_AsString(repr));
+        Py_DECREF(repr);
+    }
+#endif
+    return -1;
 }
 
 static int
-skipdict_setup(SkipDictObject *self, int maxlevel,
-               PyObject *rnd, PyObject *seq)
+skipdict_score_from(PyObject *value, double *score)
 {
-    int err = 0;
-    self->random = rnd;
-    Py_XINCREF(rnd);
-    self->mapping = NULL;
-    self->skiplist = NULL;
-    self->skiplist = slCreate(maxlevel);
-    if (!self->skiplist) {
+    if (!PyNumber_Check(value)) {
+        return skipdict_nota("a number", value);
+    }
+    *score = PyFloat_AsDouble(value);
+    if (*score == -1.0 && PyErr_Occurred()) {
         return -1;
     }
+    return 0;
+}
 
-    self->mapping = PyDict_New();
+static PyObject *
+skipdict_score_to(double score)
+{
+    return PyFloat_FromDouble(score);
+}
 
-    if (seq) {
-        err = skipdict_insertseq(self, seq);
-        if (err) {
-            return -1;
-        }
-    }
+static PyObject *
+skipdict_score_add(PyObject *value, PyObject *previous)
+{
+    return PyNumber_Add(value, previous);
+}
 
+static int
+skipdict_score_scale(double *score, double weight)
+{
+    *score *= weight;
     return 0;
 }
 
 static int
-skipdict_init(SkipDictObject *self, PyObject *args, PyObject *kw)
+skipdict_score_aggregate(double *acc, double score, int aggregate)
 {
-    int maxlevel = MAXLEVEL;
-    PyObject *rnd = NULL;
-    PyObject *seq = NULL;
-    static char *kwlist[] = {
-        "sequence", "maxlevel", "random", NULL
-    };
+    if (aggregate == AGGREGATE_SUM) *acc += score;
+    AGGREGATE(aggregate, *acc, score, NUMBER_LESS);
+    return 0;
+}
 
-    if (!PyArg_ParseTupleAndKeywords(args, kw, "|OiO:SkipDict", kwlist,
-                                     &seq, &maxlevel, &rnd)) {
-        return -1;
-    }
-    return skipdict_setup(self, maxlevel, rnd, seq);
+static double
+skipdict_score_distance(double a, double b)
+{
+    return fabs(a - b);
 }
 
-static void
-skipdict_dealloc(SkipDictObject* self)
+static char *
+skipdict_score_str(double score)
 {
-    slFree(self->skiplist);
-    if (self->mapping) {
-        PyDict_Clear(self->mapping);
-        Py_DECREF(self->mapping);
-    }
-    Py_XDECREF(self->random);
-    Py_TYPE(self)->tp_free((PyObject*)self);
+    return double_AsString(score);
 }
 
-static PyObject *
-skipdict_iterator(SkipDictObject *self, skiplistiter *iter, itertype type, Py_ssize_t length)
+/* Integer scores are kept exact over the full 64-bit range. */
+static int
+skipdict_i64_score_from(PyObject *value, int64_t *score)
 {
-    SkipDictIterObject *it = NULL;
-    if (!skipdict_Check(self)) {
-        PyErr_BadInternalCall();
-        return NULL;
-    }
+    PyObject *index;
+    PY_LONG_LONG v;
 
-    if (!iter) {
-        iter = slIterNewFromHead(self->skiplist);
+    if (!PyIndex_Check(value)) {
+        return skipdict_nota("an integer", value);
     }
-
-    if (!iter) {
-        return NULL;
+    index = PyNumber_Index(value);
+    if (!index) {
+        return -1;
     }
-
-    it = PyObject_GC_New(SkipDictIterObject, &SkipDictIterType);
-    if (!it) {
-        slIterDel(iter);
-        return NULL;
+    v = PyLong_AsLongLong(index);
+    Py_DECREF(index);
+    if (v == -1 && PyErr_Occurred()) {
+        return -1;
     }
-
-    Py_INCREF(self);
-
-    it->skipdict = self;
-    it->iter = iter;
-    it->type = type;
-    it->length = length > 1 ? (unsigned long) length : slLength(self->skiplist);
-    PyObject_GC_Track(it);
-
-    return (PyObject *)it;
+    *score = (int64_t) v;
+    return 0;
 }
 
 static PyObject *
-skipdict_iter(SkipDictObject *skipdict)
+skipdict_i64_score_to(int64_t score)
 {
-    return skipdict_iterator(skipdict, NULL, KEY, -1);
+    return PyLong_FromLongLong((PY_LONG_LONG) score);
 }
 
 static PyObject *
-skipdictiter_item(SkipDictIterObject *self, Py_ssize_t index)
+skipdict_i64_score_add(PyObject *value, PyObject *previous)
 {
-    if (index < 0) {
-        index = self->length + index;
-    }
-
-    index = index % slLength(self->skipdict->skiplist);
-
-    skiplistNode* node = slGetNodeByRank(self->iter->node,
-                                         self->skipdict->skiplist->level - 1,
-                                         index);
-
-    if (!node) {
-        PyErr_SetObject(PyExc_IndexError,
-                        PyString_FromString("index out of range"));
-        return NULL;
-    }
+    return PyNumber_Add(value, previous);
+}
 
-    PyObject *obj = PyTuple_GET_ITEM(node->obj, 0);
-    return iterators[self->type](node->score, obj);
+static int
+skipdict_i64_overflow(void)
+{
+    PyErr_SetString(PyExc_OverflowError, "int64 score out of range");
+    return -1;
 }
 
-static PyObject *
-skipdictiter_slice(SkipDictIterObject *self, PyObject* item)
+/* Weights are applied exactly, so they need to be integers. */
+static int
+skipdict_i64_score_scale(int64_t *score, double weight)
 {
-    if (PyIndex_Check(item)) {
-        PyObject *i, *result;
-        i = PyNumber_Index(item);
-        if (!i)
-            return NULL;
-        long index = PyLong_AsLong(i);
-        Py_DECREF(i);
-        result = skipdictiter_item(self, index);
-        return result;
+    if (weight != floor(weight)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "weights must be integers for int64 scores");
+        return -1;
     }
-
-    if (!PySlice_Check(item)) {
-        PyErr_Format(PyExc_TypeError,
-                     "range indices must be integers or slices, not %.200s",
-                     Py_TYPE(item)->tp_name);
-        return NULL;
+    if (!(weight >= -9223372036854775808.0 &&
+          weight < 9223372036854775808.0) ||
+        __builtin_mul_overflow(*score, (int64_t) weight, score)) {
+        return skipdict_i64_overflow();
     }
+    return 0;
+}
 
-    Py_ssize_t ilow;
-    Py_ssize_t ihigh;
-    Py_ssize_t step;
-    Py_ssize_t length;
-
-    if (PySlice_GetIndicesEx((PySliceObject *)item,
-                             slLength(self->skipdict->skiplist),
-                             &ilow, &ihigh, &step, &length)) {
-        return NULL;
+static int
+skipdict_i64_score_aggregate(int64_t *acc, int64_t score, int aggregate)
+{
+    if (aggregate == AGGREGATE_SUM &&
+        __builtin_add_overflow(*acc, score, acc)) {
+        return skipdict_i64_overflow();
     }
+    AGGREGATE(aggregate, *acc, score, NUMBER_LESS);
+    return 0;
+}
 
-    if (step != 1) {
-        PyErr_Format(PyExc_ValueError,
-                     "slice step %d not supported",
-                     (int) step);
-        return NULL;
-    }
+static double
+skipdict_i64_score_distance(int64_t a, int64_t b)
+{
+    return a < b ? (double) ((uint64_t) b - (uint64_t) a)
+                 : (double) ((uint64_t) a - (uint64_t) b);
+}
 
+static char *
+skipdict_i64_score_str(int64_t score)
+{
+    char buf[24];
+    char *s;
 
-    skiplistNode* node = slGetNodeByRank(self->iter->node,
-                                         self->skipdict->skiplist->level - 1,
-                                         ilow);
+    PyOS_snprintf(buf, sizeof(buf), "%lld", (long long) score);
+    s = PyMem_Malloc(strlen(buf) + 1);
+    if (s) strcpy(s, buf);
+    return s;
+}
 
-    skiplistiter *iter = slIterNew(self->skipdict->skiplist, node);
+/* Pair scores are a (primary, secondary) sequence of two numbers,
+   compared lexicographically. */
+static int
+skipdict_pair_score_from(PyObject *value, slPairScore *score)
+{
+    PyObject *fast;
 
-    if (!iter) {
-        return NULL;
+    if (!PySequence_Check(value) || PySequence_Size(value) != 2) {
+        PyErr_Clear();
+        return skipdict_nota("a pair of numbers", value);
     }
-
-    PyObject *it = skipdict_iterator(self->skipdict, iter, self->type, ihigh - ilow);
-    if (!it) {
-        slIterDel(iter);
+    fast = PySequence_Fast(value, "not a pair of numbers");
+    if (!fast) {
+        return -1;
     }
-
-    return it;
-}
-
-static Py_ssize_t
-skipdict_length(SkipDictObject *self)
-{
-    Py_ssize_t len = slLength(self->skiplist);
-    return len;
+    if (skipdict_score_from(PySequence_Fast_GET_ITEM(fast, 0),
+                            &score->primary) ||
+        skipdict_score_from(PySequence_Fast_GET_ITEM(fast, 1),
+                            &score->secondary)) {
+        Py_DECREF(fast);
+        return -1;
+    }
+    Py_DECREF(fast);
+    return 0;
 }
 
-static int
-skipdict_contains(SkipDictObject *self, PyObject *key)
+static PyObject *
+skipdict_pair_score_to(slPairScore score)
 {
-    return PyDict_Contains(self->mapping, key);
+    return Py_BuildValue("(dd)", score.primary, score.secondary);
 }
 
 static PyObject *
-skipdict_getitem(SkipDictObject *self, PyObject *key)
+skipdict_pair_score_add(PyObject *value, PyObject *previous)
 {
-    PyObject *item = PyDict_GetItem(self->mapping, key);
-    if (!item) {
-        PyErr_SetObject(PyExc_KeyError, key);
+    slPairScore a, b;
+
+    if (skipdict_pair_score_from(value, &a) ||
+        skipdict_pair_score_from(previous, &b)) {
         return NULL;
     }
-    PyObject* value = PyTuple_GET_ITEM(item, 1);
-    Py_INCREF(value);
-    return value;
+    a.primary += b.primary;
+    a.secondary += b.secondary;
+    return skipdict_pair_score_to(a);
 }
 
 static int
-skipdict_ass_sub(SkipDictObject *self, PyObject *key, PyObject *value)
+skipdict_pair_score_scale(slPairScore *score, double weight)
 {
-    if (value) {
-        if (skipdict_insertobj(self, key, value, 1)) return -1;
-    } else {
-        if (skipdict_delitem(self, key, 1)) return -1;
+    score->primary *= weight;
+    score->secondary *= weight;
+    return 0;
+}
+
+static int
+skipdict_pair_score_aggregate(slPairScore *acc, slPairScore score,
+                              int aggregate)
+{
+    if (aggregate == AGGREGATE_SUM) {
+        acc->primary += score.primary;
+        acc->secondary += score.secondary;
     }
+    AGGREGATE(aggregate, *acc, score, PAIR_LESS);
     return 0;
 }
 
-static PyObject *
-skipdict_get(SkipDictObject *self, PyObject *args)
+/* Nearness is by the primary score. */
+static double
+skipdict_pair_score_distance(slPairScore a, slPairScore b)
 {
-    PyObject *key, *value;
-    PyObject *failobj = Py_None;
+    return fabs(a.primary - b.primary);
+}
 
-    if (!PyArg_UnpackTuple(args, "get", 1, 2, &key, &failobj))
-        return NULL;
+static char *
+skipdict_pair_score_str(slPairScore score)
+{
+    char *primary = double_AsString(score.primary);
+    char *secondary = double_AsString(score.secondary);
+    char *s = NULL;
+
+    if (primary && secondary) {
+        size_t size = strlen(primary) + strlen(secondary) + 5;
+        if ((s = PyMem_Malloc(size))) {
+            PyOS_snprintf(s, size, "(%s, %s)", primary, secondary);
+        }
+    }
+    PyMem_Free(primary);
+    PyMem_Free(secondary);
+    return s;
+}
+
+static PyTypeObject *
+skipdict_scoretype(PyObject *name)
+{
+    static const char *names[3] = { "double", "int64", "pair" };
+    PyTypeObject *types[3] = {
+        &SkipDictType, &Int64SkipDictType, &PairSkipDictType
+    };
+    int i;
+
+#if PY_MAJOR_VERSION >= 3
+    for (i = 0; i < 3; i++) {
+        if (PyUnicode_Check(name) &&
+            PyUnicode_CompareWithASCIIString(name, names[i]) == 0) {
+            return types[i];
+        }
+    }
+#else
+    PyObject *str = PyUnicode_Check(name) ?
+        PyUnicode_AsASCIIString(name) : (Py_INCREF(name), name);
+    for (i = 0; str && PyString_Check(str) && i < 3; i++) {
+        if (strcmp(PyString_AS_STRING(str), names[i]) == 0) {
+            Py_DECREF(str);
+            return types[i];
+        }
+    }
+    Py_XDECREF(str);
+    PyErr_Clear();
+#endif
+    PyErr_SetString(PyExc_ValueError,
+                    "score_type must be 'double', 'int64' or 'pair'");
+    return NULL;
+}
+
+/* Expiry deadlines are in seconds since the epoch, as time.time(). */
+static double
+skipdict_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/* Sampling draws from a per-instance generator (splitmix64), which
+   seed() can reset to make the draws repeatable. */
+static uint64_t
+skipdict_next_random(uint64_t *state)
+{
+    uint64_t x = (*state += 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* A number in [0, 1). */
+static double
+skipdict_uniform(uint64_t *state)
+{
+    return (skipdict_next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int
+skipdict_rank_compare(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *) a;
+    unsigned long y = *(const unsigned long *) b;
+    return (x > y) - (x < y);
+}
+
+static int
+skipdict_aggregate(PyObject *name)
+{
+    static const char *names[3] = { "sum", "min", "max" };
+    int i;
+
+#if PY_MAJOR_VERSION >= 3
+    for (i = 0; i < 3; i++) {
+        if (PyUnicode_Check(name) &&
+            PyUnicode_CompareWithASCIIString(name, names[i]) == 0) {
+            return i;
+        }
+    }
+#else
+    PyObject *str = PyUnicode_Check(name) ?
+        PyUnicode_AsASCIIString(name) : (Py_INCREF(name), name);
+    for (i = 0; str && PyString_Check(str) && i < 3; i++) {
+        if (strcmp(PyString_AS_STRING(str), names[i]) == 0) {
+            Py_DECREF(str);
+            return i;
+        }
+    }
+    Py_XDECREF(str);
+    PyErr_Clear();
+#endif
+    PyErr_SetString(PyExc_ValueError,
+                    "aggregate must be 'sum', 'min' or 'max'");
+    return -1;
+}
+
+/* SkipDict(score_type=...) returns an instance of the type specialized
+   for that score type. */
+static PyObject *
+skipdict_new(PyTypeObject *type, PyObject *args, PyObject *kw)
+{
+    PyObject *scoretype = NULL;
+
+    if (type == &SkipDictType && kw) {
+        scoretype = PyDict_GetItemString(kw, "score_type");
+    }
+    if (scoretype && scoretype != Py_None) {
+        if (!(type = skipdict_scoretype(scoretype))) {
+            return NULL;
+        }
+        if (type != &SkipDictType) {
+            return PyObject_Call((PyObject *) type, args, kw);
+        }
+    }
+    return type->tp_alloc(type, 0);
+}
+
+#define SD(name) skipdict_##name
+#define SDI(name) skipdictiter_##name
+#define SDT(name) SkipDict##name
+#define SL_SUFFIX
+#define SD_SCORE double
+#define SD_NAME "SkipDict"
+#define SD_SCORE_TYPE "double"
+#include "skipdict_impl.h"
+
+#define SD(name) skipdict_i64_##name
+#define SDI(name) skipdictiter_i64_##name
+#define SDT(name) Int64SkipDict##name
+#define SL_SUFFIX I64
+#define SD_SCORE int64_t
+#define SD_NAME "Int64SkipDict"
+#define SD_SCORE_TYPE "int64"
+#include "skipdict_impl.h"
+
+#define SD(name) skipdict_pair_##name
+#define SDI(name) skipdictiter_pair_##name
+#define SDT(name) PairSkipDict##name
+#define SL_SUFFIX Pair
+#define SD_SCORE slPairScore
+#define SD_NAME "PairSkipDict"
+#define SD_SCORE_TYPE "pair"
+#include "skipdict_impl.h"
+
+/* The repr of a list of (key, value) tuples, in the form of a dict
+   (as for the skip dict itself). */
+static PyObject *
+skipdict_items_repr(PyObject *self, PyObject *items)
+{
+    PyObject *fmt = NULL, *sep = NULL, *pieces = NULL, *s;
+    PyObject *result = NULL;
+    Py_ssize_t i, n;
+    int status = Py_ReprEnter(self);
+
+    if (status) {
+        Py_XDECREF(items);
+        return status > 0 ? PyString_FromString("{...}") : NULL;
+    }
+    if (!items) goto Done;
+
+    n = PyList_GET_SIZE(items);
+    fmt = PyString_FromString("%r: %r");
+    sep = PyString_FromString(", ");
+    pieces = PyList_New(n);
+    if (!fmt || !sep || !pieces) goto Done;
+    for (i = 0; i < n; i++) {
+        s = PyNumber_Remainder(fmt, PyList_GET_ITEM(items, i));
+        if (!s) goto Done;
+        PyList_SET_ITEM(pieces, i, s);
+    }
+
+    if (!(s = _PyString_Join(sep, pieces))) goto Done;
+    Py_DECREF(fmt);
+    if ((fmt = PyString_FromString("{%s}"))) {
+        result = PyNumber_Remainder(fmt, s);
+    }
+    Py_DECREF(s);
+
+ Done:
+    Py_ReprLeave(self);
+    Py_XDECREF(items);
+    Py_XDECREF(fmt);
+    Py_XDECREF(sep);
+    Py_XDECREF(pieces);
+    return result;
+}
+
+/* Sharded skip dict.
+
+   Keys are partitioned by hash across a number of skip dicts (each
+   with its own lock), while ordered views are produced by a k-way
+   merge over the shards using a binary heap. The global rank of an
+   entry is the sum of the number of entries that sort before it in
+   each shard. */
+
+typedef struct {
+    PyObject_HEAD
+    Py_ssize_t nshards;
+    SkipDictObject **shards;
+} ShardedSkipDictObject;
+
+typedef struct {
+    double score;
+    void *obj;
+    skiplistNode *node;
+    Py_ssize_t shard;
+} shardhead;
+
+typedef struct {
+    PyObject_HEAD
+    ShardedSkipDictObject *owner;
+    itertype type;
+    int forward;
+    double min;
+    double max;
+    Py_ssize_t size;
+    shardhead *heap;
+    unsigned long *versions;
+} ShardedSkipDictIterObject;
+
+static SkipDictObject *
+shardedskipdict_route(ShardedSkipDictObject *self, PyObject *key)
+{
+    Py_hash_t hash = PyObject_Hash(key);
+    if (hash == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    return self->shards[(size_t) hash % (size_t) self->nshards];
+}
+
+/* Returns true if a sorts before b in the direction of iteration. */
+static int
+shardhead_before(shardhead *a, shardhead *b, int forward)
+{
+    int less = a->score < b->score ||
+        (a->score == b->score && a->obj < b->obj);
+    return forward ? less : !less;
+}
+
+static void
+shardhead_siftdown(ShardedSkipDictIterObject *it, Py_ssize_t i)
+{
+    shardhead *heap = it->heap;
+    shardhead head = heap[i];
+    Py_ssize_t child;
+
+    while ((child = 2 * i + 1) < it->size) {
+        if (child + 1 < it->size &&
+            shardhead_before(&heap[child + 1], &heap[child], it->forward))
+            child++;
+        if (!shardhead_before(&heap[child], &head, it->forward))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = head;
+}
+
+static void
+shardhead_siftup(ShardedSkipDictIterObject *it, Py_ssize_t i)
+{
+    shardhead *heap = it->heap;
+    shardhead head = heap[i];
+    Py_ssize_t parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!shardhead_before(&head, &heap[parent], it->forward))
+            break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = head;
+}
+
+static PyObject *
+shardedskipdict_iterator(ShardedSkipDictObject *self, itertype type,
+                         double min, double max)
+{
+    ShardedSkipDictIterObject *it;
+    Py_ssize_t i;
+
+    it = PyObject_GC_New(ShardedSkipDictIterObject, &ShardedSkipDictIterType);
+    if (!it) {
+        return NULL;
+    }
+
+    it->forward = min <= max;
+    if (!it->forward) {
+        double temp = min;
+        min = max;
+        max = temp;
+    }
+
+    Py_INCREF(self);
+    it->owner = self;
+    it->type = type;
+    it->min = min;
+    it->max = max;
+    it->size = 0;
+    it->heap = PyMem_Malloc(self->nshards * sizeof(shardhead));
+    it->versions = PyMem_Malloc(self->nshards * sizeof(unsigned long));
+    if (!it->heap || !it->versions) {
+        Py_DECREF(it);
+        return PyErr_NoMemory();
+    }
+
+    for (i = 0; i < self->nshards; i++) {
+        SkipDictObject *shard = self->shards[i];
+        skiplistNode *node;
+
+        Read_Lock(shard);
+        node = it->forward ? slFirstInRange(shard->skiplist, min, max) : \
+            slLastInRange(shard->skiplist, min, max);
+        it->versions[i] = shard->version;
+        if (node) {
+            shardhead *head = &it->heap[it->size];
+            head->score = node->score;
+            head->obj = node->obj;
+            head->node = node;
+            head->shard = i;
+            shardhead_siftup(it, it->size++);
+        }
+        Read_Unlock(shard);
+    }
+
+    PyObject_GC_Track(it);
+    return (PyObject *) it;
+}
+
+static PyObject *
+shardedskipdictiter_next(ShardedSkipDictIterObject *it)
+{
+    if (it->size == 0) {
+        PyErr_SetString(PyExc_StopIteration, "");
+        return NULL;
+    }
+
+    shardhead *head = &it->heap[0];
+    SkipDictObject *shard = it->owner->shards[head->shard];
+    skiplistNode *node;
+    PyObject *key;
+    double score;
+
+    Read_Lock(shard);
+    if (it->versions[head->shard] != shard->version) {
+        Read_Unlock(shard);
+        PyErr_SetString(PyExc_RuntimeError,
+                        "skipdict mutated during iteration");
+        return NULL;
+    }
+
+    node = head->node;
+    score = node->score;
+    key = PyTuple_GET_ITEM(node->obj, 0);
+    Py_INCREF(key);
+
+    node = it->forward ? node->level[0].forward : node->backward;
+    if (node && node->score >= it->min && node->score <= it->max) {
+        head->score = node->score;
+        head->obj = node->obj;
+        head->node = node;
+    } else {
+        it->heap[0] = it->heap[--it->size];
+    }
+    Read_Unlock(shard);
+
+    if (it->size) {
+        shardhead_siftdown(it, 0);
+    }
+
+    PyObject *result = skipdict_iterators[it->type](score, key);
+    Py_DECREF(key);
+    return result;
+}
+
+static void
+shardedskipdictiter_dealloc(ShardedSkipDictIterObject *it)
+{
+    PyObject_GC_UnTrack(it);
+    PyMem_Free(it->heap);
+    PyMem_Free(it->versions);
+    Py_XDECREF(it->owner);
+    PyObject_GC_Del(it);
+}
+
+static int
+shardedskipdictiter_traverse(ShardedSkipDictIterObject *it,
+                             visitproc visit, void *arg)
+{
+    Py_VISIT(it->owner);
+    return 0;
+}
+
+static int
+shardedskipdict_collectpair(ShardedSkipDictObject *self,
+                            PyObject *key, PyObject *value)
+{
+    SkipDictObject *shard = shardedskipdict_route(self, key);
+
+    if (!shard) return -1;
+    return skipdict_collectpair(shard, key, value);
+}
+
+/* Links the shards first, first + step, ... of a bulk load. */
+typedef struct {
+    ShardedSkipDictObject *owner;
+    slEntry **entries;
+    unsigned long *lengths;
+    unsigned long seed;
+    Py_ssize_t first;
+    Py_ssize_t step;
+    pthread_t thread;
+    int started;
+    int err;
+} shardwork;
+
+static void *
+shardedskipdict_linkwork(void *arg)
+{
+    shardwork *w = arg;
+    SkipDictObject *shard;
+    Py_ssize_t i;
+
+    for (i = w->first; i < w->owner->nshards; i += w->step) {
+        shard = w->owner->shards[i];
+        if (w->lengths[i] &&
+            slBulkLoad(shard->skiplist, w->entries[i], w->lengths[i],
+                       shard->p, w->seed + i, 1)) {
+            w->err = -1;
+        }
+    }
+    return NULL;
+}
+
+/* The pairs are partitioned into the shards' mappings first, and then
+   each shard is sorted and linked on its own, a number of shards per
+   native thread, with the GIL released. */
+static int
+shardedskipdict_bulkload(ShardedSkipDictObject *self, PyObject *seq,
+                         int threads)
+{
+    Py_ssize_t n = self->nshards, i;
+    slEntry **entries = NULL;
+    unsigned long *lengths = NULL, total = 0, seed;
+    shardwork *work = NULL;
+    int err = -1;
+
+    if (skipdict_foreach(seq, (pairfunc) shardedskipdict_collectpair, self)) {
+        return -1;
+    }
+
+    entries = PyMem_Malloc(n * sizeof(slEntry *));
+    lengths = PyMem_Malloc(n * sizeof(unsigned long));
+    if (!entries || !lengths) {
+        PyErr_NoMemory();
+        goto Done;
+    }
+    memset(entries, 0, n * sizeof(slEntry *));
+    for (i = 0; i < n; i++) {
+        if (skipdict_entries(self->shards[i], &entries[i], &lengths[i])) {
+            goto Done;
+        }
+        total += lengths[i];
+    }
+
+    if (threads <= 0) {
+        threads = skipdict_bulkthreads(total);
+    }
+    if (threads > n) {
+        threads = (int) n;
+    }
+    if (!(work = PyMem_Malloc(threads * sizeof(shardwork)))) {
+        PyErr_NoMemory();
+        goto Done;
+    }
+    seed = (unsigned long) random();
+    for (i = 0; i < threads; i++) {
+        work[i].owner = self;
+        work[i].entries = entries;
+        work[i].lengths = lengths;
+        work[i].seed = seed;
+        work[i].first = i;
+        work[i].step = threads;
+        work[i].err = 0;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for (i = 1; i < threads; i++) {
+        work[i].started = !pthread_create(
+            &work[i].thread, NULL, shardedskipdict_linkwork, &work[i]);
+    }
+    shardedskipdict_linkwork(&work[0]);
+    for (i = 1; i < threads; i++) {
+        if (work[i].started)
+            pthread_join(work[i].thread, NULL);
+        else
+            shardedskipdict_linkwork(&work[i]);
+    }
+    Py_END_ALLOW_THREADS
+
+    err = 0;
+    for (i = 0; i < threads; i++) {
+        err |= work[i].err;
+    }
+    if (err) PyErr_NoMemory();
+
+ Done:
+    for (i = 0; entries && i < n; i++) {
+        PyMem_Free(entries[i]);
+    }
+    PyMem_Free(entries);
+    PyMem_Free(lengths);
+    PyMem_Free(work);
+    return err;
+}
+
+static int
+shardedskipdict_init(ShardedSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    int maxlevel = MAXLEVEL;
+    int threads = 0;
+    Py_ssize_t nshards = 8;
+    Py_ssize_t i;
+    PyObject *seq = NULL;
+    static char *kwlist[] = {
+        "sequence", "maxlevel", "shards", "threads", NULL
+    };
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|Oini:ShardedSkipDict", kwlist,
+                                     &seq, &maxlevel, &nshards, &threads)) {
+        return -1;
+    }
+
+    if (self->shards) {
+        PyErr_SetString(PyExc_RuntimeError, "already initialized");
+        return -1;
+    }
+
+    if (nshards < 1) {
+        PyErr_Format(PyExc_ValueError,
+                     "number of shards must be positive: %zd",
+                     nshards);
+        return -1;
+    }
+
+    self->shards = PyMem_Malloc(nshards * sizeof(SkipDictObject *));
+    if (!self->shards) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (i = 0; i < nshards; i++) {
+        self->shards[i] = (SkipDictObject *) PyObject_CallFunction(
+            (PyObject *) &SkipDictType, "()i", maxlevel);
+        if (!self->shards[i]) {
+            self->nshards = i;
+            return -1;
+        }
+    }
+    self->nshards = nshards;
+
+    if (seq) {
+        return shardedskipdict_bulkload(self, seq, threads);
+    }
+
+    return 0;
+}
+
+static void
+shardedskipdict_dealloc(ShardedSkipDictObject *self)
+{
+    Py_ssize_t i;
+    for (i = 0; i < self->nshards; i++) {
+        Py_DECREF(self->shards[i]);
+    }
+    PyMem_Free(self->shards);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static Py_ssize_t
+shardedskipdict_length(ShardedSkipDictObject *self)
+{
+    Py_ssize_t i, len = 0;
+    for (i = 0; i < self->nshards; i++) {
+        len += skipdict_length(self->shards[i]);
+    }
+    return len;
+}
+
+static int
+shardedskipdict_contains(ShardedSkipDictObject *self, PyObject *key)
+{
+    SkipDictObject *shard = shardedskipdict_route(self, key);
+    if (!shard) return -1;
+    return skipdict_contains(shard, key);
+}
+
+static PyObject *
+shardedskipdict_getitem(ShardedSkipDictObject *self, PyObject *key)
+{
+    SkipDictObject *shard = shardedskipdict_route(self, key);
+    if (!shard) return NULL;
+    return skipdict_getitem(shard, key);
+}
+
+static int
+shardedskipdict_ass_sub(ShardedSkipDictObject *self, PyObject *key,
+                        PyObject *value)
+{
+    SkipDictObject *shard = shardedskipdict_route(self, key);
+    if (!shard) return -1;
+    return skipdict_ass_sub(shard, key, value);
+}
+
+/* Methods that take the key as their first argument are forwarded to
+   the shard that owns the key. */
+#define SHARDED_FORWARD(name)                                       \
+    static PyObject *                                               \
+    shardedskipdict_##name(ShardedSkipDictObject *self,             \
+                           PyObject *args)                          \
+    {                                                               \
+        SkipDictObject *shard;                                      \
+        if (!PyTuple_Check(args) || PyTuple_GET_SIZE(args) < 1) {   \
+            PyErr_SetString(PyExc_TypeError,                        \
+                            #name "() requires a key argument");    \
+            return NULL;                                            \
+        }                                                           \
+        shard = shardedskipdict_route(                              \
+            self, PyTuple_GET_ITEM(args, 0));                       \
+        if (!shard) return NULL;                                    \
+        return skipdict_##name(shard, args);                        \
+    }
+
+SHARDED_FORWARD(get)
+SHARDED_FORWARD(setdefault)
+SHARDED_FORWARD(change)
+
+static PyObject *
+shardedskipdict_index(ShardedSkipDictObject *self, PyObject *key)
+{
+    SkipDictObject *shard = shardedskipdict_route(self, key);
+    unsigned long rank = 0;
+    double score;
+    PyObject *item;
+    Py_ssize_t i;
+
+    if (!shard) return NULL;
+
+    Read_Lock(shard);
+    item = PyDict_GetItem(shard->mapping, key);
+    if (!item) {
+        Read_Unlock(shard);
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+    score = PyFloat_AsDouble(PyTuple_GET_ITEM(item, 1));
+    Read_Unlock(shard);
+    if (score == -1.0 && PyErr_Occurred()) return NULL;
+
+    /* The item is only used for its address, which orders entries
+       with the same score across shards. */
+    for (i = 0; i < self->nshards; i++) {
+        Read_Lock(self->shards[i]);
+        rank += slCountLess(self->shards[i]->skiplist, score, (void *) item);
+        Read_Unlock(self->shards[i]);
+    }
+
+    return PyLong_FromUnsignedLong(rank);
+}
+
+static PyObject *
+shardedskipdict_iterator_from_range(ShardedSkipDictObject *self,
+                                    PyObject *args, PyObject *kw,
+                                    itertype type)
+{
+    PyObject *min = NULL;
+    PyObject *max = NULL;
+    double dmin = -HUGE_VAL;
+    double dmax = HUGE_VAL;
+
+    static char *kwlist[] = {"min", "max", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|OO:ShardedSkipDict", kwlist,
+                                     &min, &max)) {
+        return NULL;
+    }
+
+    float_Convert(dmin, min);
+    float_Convert(dmax, max);
+
+    return shardedskipdict_iterator(self, type, dmin, dmax);
+}
+
+static PyObject *
+shardedskipdict_keys(ShardedSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    return shardedskipdict_iterator_from_range(self, args, kw, KEY);
+}
+
+static PyObject *
+shardedskipdict_values(ShardedSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    return shardedskipdict_iterator_from_range(self, args, kw, VALUE);
+}
+
+static PyObject *
+shardedskipdict_items(ShardedSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    return shardedskipdict_iterator_from_range(self, args, kw, ITEM);
+}
+
+static PyObject *
+shardedskipdict_iter(ShardedSkipDictObject *self)
+{
+    return shardedskipdict_iterator(self, KEY, -HUGE_VAL, HUGE_VAL);
+}
+
+/* Returns the k items with the highest scores, highest first. */
+static PyObject *
+shardedskipdict_top(ShardedSkipDictObject *self, PyObject *args)
+{
+    Py_ssize_t k, i;
+    PyObject *it, *result, *item;
+
+    if (!PyArg_ParseTuple(args, "n:top", &k)) {
+        return NULL;
+    }
+
+    it = shardedskipdict_iterator(self, ITEM, HUGE_VAL, -HUGE_VAL);
+    if (!it) return NULL;
+
+    result = PyList_New(0);
+    for (i = 0; result && i < k; i++) {
+        item = PyIter_Next(it);
+        if (!item) {
+            if (PyErr_Occurred()) Py_CLEAR(result);
+            break;
+        }
+        if (PyList_Append(result, item)) Py_CLEAR(result);
+        Py_DECREF(item);
+    }
+
+    Py_DECREF(it);
+    return result;
+}
+
+static PyObject *
+shardedskipdict_repr(ShardedSkipDictObject *self)
+{
+    PyObject *it = shardedskipdict_iterator(self, ITEM, -HUGE_VAL, HUGE_VAL);
+    PyObject *items;
+
+    if (!it) return NULL;
+    items = PySequence_List(it);
+    Py_DECREF(it);
+    return skipdict_items_repr((PyObject *) self, items);
+}
+
+static PyObject *
+shardedskipdict_nshards(ShardedSkipDictObject *self)
+{
+    return PyInt_FromLong((long) self->nshards);
+}
+
+static PyMethodDef shardedskipdict_methods[] = {
+    {"get", (PyCFunction)shardedskipdict_get, METH_VARARGS, NULL},
+    {"setdefault", (PyCFunction)shardedskipdict_setdefault, METH_VARARGS, NULL},
+    {"change", (PyCFunction)shardedskipdict_change, METH_VARARGS, NULL},
+    {"index", (PyCFunction)shardedskipdict_index, METH_O, NULL},
+    {"keys", (PyCFunction)shardedskipdict_keys, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"values", (PyCFunction)shardedskipdict_values, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"items", (PyCFunction)shardedskipdict_items, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"top", (PyCFunction)shardedskipdict_top, METH_VARARGS, NULL},
+    {NULL}
+};
+
+static PyGetSetDef shardedskipdict_getset[] = {
+    {"shards", (getter)shardedskipdict_nshards, NULL, "shards", NULL},
+    {NULL}
+};
+
+static PyMappingMethods shardedskipdict_as_mapping = {
+    (lenfunc)shardedskipdict_length,       /*mp_length*/
+    (binaryfunc)shardedskipdict_getitem,   /*mp_subscript*/
+    (objobjargproc)shardedskipdict_ass_sub,/*mp_ass_subscript*/
+};
+
+static PySequenceMethods shardedskipdict_as_sequence = {
+    (lenfunc)shardedskipdict_length,       /*sq_length*/
+    0,                                     /*sq_concat*/
+    0,                                     /*sq_repeat*/
+    0,                                     /*sq_item*/
+    0,                                     /*sq_slice*/
+    0,                                     /*sq_ass_item*/
+    0,                                     /*sq_ass_slice*/
+    (objobjproc)shardedskipdict_contains,  /*sq_contains*/
+    0,                                     /*sq_inplace_concat*/
+    0,                                     /*sq_inplace_repeat*/
+};
+
+static PyTypeObject ShardedSkipDictType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "skipdict.ShardedSkipDict",            /* tp_name */
+    sizeof(ShardedSkipDictObject),         /* tp_basicsize */
+    0,                                     /* tp_itemsize */
+    (destructor)shardedskipdict_dealloc,   /* tp_dealloc */
+    0,                                     /* tp_print */
+    0,                                     /* tp_getattr */
+    0,                                     /* tp_setattr */
+    0,                                     /* tp_compare */
+    (reprfunc)shardedskipdict_repr,        /* tp_repr */
+    0,                                     /* tp_as_number */
+    &shardedskipdict_as_sequence,          /* tp_as_sequence*/
+    &shardedskipdict_as_mapping,           /* tp_as_mapping */
+    (hashfunc)PyObject_HashNotImplemented, /* tp_hash */
+    0,                                     /* tp_call */
+    0,                                     /* tp_str */
+    0,                                     /* tp_getattro */
+    0,                                     /* tp_setattro */
+    0,                                     /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE,/* tp_flags */
+    0,                                     /* tp_doc */
+    0,                                     /* tp_traverse */
+    0,                                     /* tp_clear */
+    0,                                     /* tp_richcompare */
+    0,                                     /* tp_weaklistoffset */
+    (getiterfunc)shardedskipdict_iter,     /* tp_iter */
+    0,                                     /* tp_iternext */
+    shardedskipdict_methods,               /* tp_methods */
+    0,                                     /* tp_members */
+    shardedskipdict_getset,                /* tp_getset */
+    0,                                     /* tp_base */
+    0,                                     /* tp_dict */
+    0,                                     /* tp_descr_get */
+    0,                                     /* tp_descr_set */
+    0,                                     /* tp_dictoffset */
+    (initproc)shardedskipdict_init,        /* tp_init */
+    PyType_GenericAlloc,                   /* tp_alloc */
+    PyType_GenericNew,                     /* tp_new */
+    PyObject_Del,                          /* tp_free */
+    0,                                     /* tp_is_gc */
+};
+
+static PyTypeObject ShardedSkipDictIterType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "skipdict.ShardedSkipDictIterator",     /* tp_name */
+    sizeof(ShardedSkipDictIterObject),      /* tp_basicsize */
+    0,                                      /* tp_itemsize */
+    /* methods */
+    (destructor)shardedskipdictiter_dealloc,/* tp_dealloc */
+    0,                                      /* tp_print */
+    0,                                      /* tp_getattr */
+    0,                                      /* tp_setattr */
+    0,                                      /* tp_compare */
+    0,                                      /* tp_repr */
+    0,                                      /* tp_as_number */
+    0,                                      /* tp_as_sequence */
+    0,                                      /* tp_as_mapping */
+    0,                                      /* tp_hash */
+    0,                                      /* tp_call */
+    0,                                      /* tp_str */
+    PyObject_GenericGetAttr,                /* tp_getattro */
+    0,                                      /* tp_setattro */
+    0,                                      /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_HAVE_GC,  /* tp_flags */
+    0,                                      /* tp_doc */
+    (traverseproc)shardedskipdictiter_traverse, /* tp_traverse */
+    0,                                      /* tp_clear */
+    0,                                      /* tp_richcompare */
+    0,                                      /* tp_weaklistoffset */
+    PyObject_SelfIter,                      /* tp_iter */
+    (iternextfunc)shardedskipdictiter_next, /* tp_iternext */
+    0,                                      /* tp_methods */
+};
+
+/* Shared-memory skip dict.
+
+   The skiplist lives in a POSIX shared-memory segment which one
+   process creates (and writes to) while others map it read-only; see
+   shmskiplist.h. Keys are bytes or integers and values are floats.
+   Reads are copied out of the segment, so ordered views are lists
+   rather than live iterators. */
+
+#define SHARED_MAXLEVEL 16
+#define SHARED_CAPACITY 65536
+#define SHARED_KEYSIZE 32
+
+#ifdef Py_GIL_DISABLED
+#define Shared_Lock(self) pthread_mutex_lock(&(self)->lock)
+#define Shared_Unlock(self) pthread_mutex_unlock(&(self)->lock)
+#else
+#define Shared_Lock(self) do { } while (0)
+#define Shared_Unlock(self) do { } while (0)
+#endif
+
+typedef struct {
+    PyObject_HEAD
+    shmskiplist *shm;
+    char *name;
+#ifdef Py_GIL_DISABLED
+    pthread_mutex_t lock;
+#endif
+} SharedSkipDictObject;
+
+static int
+sharedskipdict_check(SharedSkipDictObject *self, int write)
+{
+    if (!self->shm) {
+        PyErr_SetString(PyExc_ValueError, "shared skip dict is closed");
+        return -1;
+    }
+    if (write && !self->shm->writable) {
+        PyErr_SetString(PyExc_TypeError, "shared skip dict is read-only");
+        return -1;
+    }
+    return 0;
+}
+
+static int
+sharedskipdict_key(PyObject *key, shmKey *k)
+{
+    char *data;
+    Py_ssize_t len;
+
+    if (PyBytes_Check(key)) {
+        if (PyBytes_AsStringAndSize(key, &data, &len)) return -1;
+        k->kind = SHM_BYTES;
+        k->data = data;
+        k->len = (uint32_t) len;
+        k->ival = 0;
+        if ((Py_ssize_t) k->len != len) goto TooLong;
+        return 0;
+    }
+#if PY_MAJOR_VERSION < 3
+    if (PyInt_Check(key) || PyLong_Check(key)) {
+#else
+    if (PyLong_Check(key)) {
+#endif
+        k->kind = SHM_INT;
+        k->ival = PyLong_AsLongLong(key);
+        k->data = NULL;
+        k->len = 0;
+        if (k->ival == -1 && PyErr_Occurred()) return -1;
+        return 0;
+    }
+    PyErr_Format(PyExc_TypeError, "key must be bytes or int, not %.200s",
+                 Py_TYPE(key)->tp_name);
+    return -1;
+ TooLong:
+    PyErr_SetString(PyExc_ValueError, "key too long");
+    return -1;
+}
+
+static PyObject *
+sharedskipdict_entrykey(shmEntry *e)
+{
+    if (e->kind == SHM_INT)
+        return PyLong_FromLongLong(e->ival);
+    return PyBytes_FromStringAndSize(e->key, e->keylen);
+}
+
+static int
+sharedskipdict_corrupt(void)
+{
+    if (errno == ETIMEDOUT) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "shared skip dict writer stalled mid-update");
+    } else {
+        PyErr_SetString(PyExc_RuntimeError, "shared skip dict is corrupt");
+    }
+    return -1;
+}
+
+static int
+sharedskipdict_init(SharedSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    const char *name;
+    int create = 0, maxlevel = SHARED_MAXLEVEL;
+    Py_ssize_t capacity = SHARED_CAPACITY, keysize = SHARED_KEYSIZE;
+    shmskiplist *shm;
+
+    static char *kwlist[] = {
+        "name", "create", "capacity", "maxlevel", "keysize", NULL
+    };
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "s|innn:SharedSkipDict",
+                                     kwlist, &name, &create, &capacity,
+                                     &maxlevel, &keysize)) {
+        return -1;
+    }
+
+    if (self->shm) {
+        PyErr_SetString(PyExc_TypeError, "already initialized");
+        return -1;
+    }
+
+    if (create && (capacity < 1 || maxlevel < 1 || maxlevel > 64 ||
+                   keysize < 0)) {
+        PyErr_SetString(PyExc_ValueError, "invalid segment geometry");
+        return -1;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    shm = create ? shmslCreate(name, capacity, maxlevel, keysize) : \
+        shmslOpen(name);
+    Py_END_ALLOW_THREADS
+
+    if (!shm) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, (char *) name);
+        return -1;
+    }
+
+    self->shm = shm;
+    self->name = PyMem_Malloc(strlen(name) + 1);
+    if (!self->name) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    strcpy(self->name, name);
+#ifdef Py_GIL_DISABLED
+    pthread_mutex_init(&self->lock, NULL);
+#endif
+    return 0;
+}
+
+static PyObject *
+sharedskipdict_close(SharedSkipDictObject *self)
+{
+    if (self->shm) {
+        shmslClose(self->shm);
+        self->shm = NULL;
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static void
+sharedskipdict_dealloc(SharedSkipDictObject *self)
+{
+    if (self->shm) shmslClose(self->shm);
+#ifdef Py_GIL_DISABLED
+    if (self->name) pthread_mutex_destroy(&self->lock);
+#endif
+    PyMem_Free(self->name);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+/* Remove the name of the segment; processes that have it mapped can
+   keep using it. */
+static PyObject *
+sharedskipdict_unlink(SharedSkipDictObject *self)
+{
+    if (!self->name) {
+        PyErr_SetString(PyExc_ValueError, "shared skip dict is closed");
+        return NULL;
+    }
+    if (shmslUnlink(self->name)) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, self->name);
+        return NULL;
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static Py_ssize_t
+sharedskipdict_length(SharedSkipDictObject *self)
+{
+    if (sharedskipdict_check(self, 0)) return -1;
+    return (Py_ssize_t) shmslLength(self->shm);
+}
+
+/* Returns 1 and sets the score if the key is present, 0 if it is not
+   and -1 on error. */
+static int
+sharedskipdict_lookup(SharedSkipDictObject *self, PyObject *key,
+                      double *score)
+{
+    shmKey k;
+    int found;
+
+    if (sharedskipdict_check(self, 0) || sharedskipdict_key(key, &k))
+        return -1;
+    errno = 0;
+    found = shmslGet(self->shm, &k, score);
+    if (found < 0) return sharedskipdict_corrupt();
+    return found;
+}
+
+static PyObject *
+sharedskipdict_getitem(SharedSkipDictObject *self, PyObject *key)
+{
+    double score;
+
+    switch (sharedskipdict_lookup(self, key, &score)) {
+        case 1:
+            return PyFloat_FromDouble(score);
+        case 0:
+            PyErr_SetObject(PyExc_KeyError, key);
+    }
+    return NULL;
+}
+
+static int
+sharedskipdict_contains(SharedSkipDictObject *self, PyObject *key)
+{
+    double score;
+    return sharedskipdict_lookup(self, key, &score);
+}
+
+static PyObject *
+sharedskipdict_get(SharedSkipDictObject *self, PyObject *args)
+{
+    PyObject *key, *failobj = Py_None;
+    double score;
+
+    if (!PyArg_UnpackTuple(args, "get", 1, 2, &key, &failobj))
+        return NULL;
+
+    switch (sharedskipdict_lookup(self, key, &score)) {
+        case 1:
+            return PyFloat_FromDouble(score);
+        case 0:
+            Py_INCREF(failobj);
+            return failobj;
+    }
+    return NULL;
+}
+
+static int
+sharedskipdict_set(SharedSkipDictObject *self, PyObject *key, double score)
+{
+    shmKey k;
+    int level = 1, err;
+
+    if (sharedskipdict_key(key, &k)) return -1;
+
+    while ((random() & 0xffff) < (P * 0xffff))
+        level += 1;
+
+    err = shmslSet(self->shm, &k, score, level);
+    if (err == -1) {
+        PyErr_SetString(PyExc_MemoryError, "shared skip dict is full");
+    } else if (err == -2) {
+        PyErr_SetString(PyExc_ValueError, "key too long");
+    }
+    return err ? -1 : 0;
+}
+
+static int
+sharedskipdict_ass_sub(SharedSkipDictObject *self, PyObject *key,
+                       PyObject *value)
+{
+    shmKey k;
+    double score;
+    int err;
+
+    if (sharedskipdict_check(self, 1)) return -1;
+
+    if (!value) {
+        if (sharedskipdict_key(key, &k)) return -1;
+        Shared_Lock(self);
+        err = shmslDelete(self->shm, &k);
+        Shared_Unlock(self);
+        if (!err) {
+            PyErr_SetObject(PyExc_KeyError, key);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!PyNumber_Check(value)) {
+        PyErr_Format(PyExc_TypeError, "not a number: %.200s",
+                     Py_TYPE(value)->tp_name);
+        return -1;
+    }
+    score = PyFloat_AsDouble(value);
+    if (score == -1.0 && PyErr_Occurred()) return -1;
+
+    Shared_Lock(self);
+    err = sharedskipdict_set(self, key, score);
+    Shared_Unlock(self);
+    return err;
+}
+
+static PyObject *
+sharedskipdict_change(SharedSkipDictObject *self, PyObject *args)
+{
+    PyObject *key;
+    double change, score = 0;
+    int err;
+
+    if (!PyArg_ParseTuple(args, "Od:change", &key, &change)) {
+        return NULL;
+    }
+
+    if (sharedskipdict_check(self, 1)) return NULL;
+
+    Shared_Lock(self);
+    err = sharedskipdict_lookup(self, key, &score) < 0 || \
+        sharedskipdict_set(self, key, score + change);
+    Shared_Unlock(self);
+    if (err) return NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+sharedskipdict_index(SharedSkipDictObject *self, PyObject *key)
+{
+    shmKey k;
+    long rank;
+
+    if (sharedskipdict_check(self, 0) || sharedskipdict_key(key, &k))
+        return NULL;
+
+    errno = 0;
+    rank = shmslGetRank(self->shm, &k);
+    if (rank < 0) {
+        sharedskipdict_corrupt();
+        return NULL;
+    }
+    if (!rank) {
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+    return PyLong_FromLong(rank - 1);
+}
+
+static PyObject *
+sharedskipdict_list(SharedSkipDictObject *self, itertype type,
+                    double min, double max)
+{
+    PyObject *result, *item;
+    shmEntry *entries = NULL, *e;
+    size_t stride;
+    long n, i;
+
+    if (sharedskipdict_check(self, 0)) return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    errno = 0;
+    n = shmslRange(self->shm, min, max, &entries);
+    Py_END_ALLOW_THREADS
+
+    if (n < 0) {
+        if (errno == ETIMEDOUT) {
+            sharedskipdict_corrupt();
+        } else {
+            PyErr_SetString(PyExc_MemoryError,
+                            "cannot read shared skip dict");
+        }
+        return NULL;
+    }
+
+    stride = shmslEntrySize(self->shm);
+    result = PyList_New(n);
+    for (i = 0; result && i < n; i++) {
+        e = (shmEntry *) ((char *) entries + i * stride);
+        switch (type) {
+            case KEY:
+                item = sharedskipdict_entrykey(e);
+                break;
+            case VALUE:
+                item = PyFloat_FromDouble(e->score);
+                break;
+            default:
+                item = Py_BuildValue("(Nd)", sharedskipdict_entrykey(e),
+                                     e->score);
+        }
+        if (!item) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+    free(entries);
+    return result;
+}
+
+static PyObject *
+sharedskipdict_list_from_range(SharedSkipDictObject *self,
+                               PyObject *args, PyObject *kw,
+                               itertype type)
+{
+    PyObject *min = NULL;
+    PyObject *max = NULL;
+    PyObject *result;
+    double dmin = -HUGE_VAL;
+    double dmax = HUGE_VAL;
+
+    static char *kwlist[] = {"min", "max", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|OO:SharedSkipDict", kwlist,
+                                     &min, &max)) {
+        return NULL;
+    }
+
+    float_Convert(dmin, min);
+    float_Convert(dmax, max);
+
+    /* The range is read in order and reversed if min is above max. */
+    if (dmin > dmax) {
+        result = sharedskipdict_list(self, type, dmax, dmin);
+        if (result && PyList_Reverse(result)) Py_CLEAR(result);
+        return result;
+    }
+    return sharedskipdict_list(self, type, dmin, dmax);
+}
+
+static PyObject *
+sharedskipdict_keys(SharedSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    return sharedskipdict_list_from_range(self, args, kw, KEY);
+}
+
+static PyObject *
+sharedskipdict_values(SharedSkipDictObject *self, PyObject *args,
+                      PyObject *kw)
+{
+    return sharedskipdict_list_from_range(self, args, kw, VALUE);
+}
+
+static PyObject *
+sharedskipdict_items(SharedSkipDictObject *self, PyObject *args,
+                     PyObject *kw)
+{
+    return sharedskipdict_list_from_range(self, args, kw, ITEM);
+}
+
+static PyObject *
+sharedskipdict_iter(SharedSkipDictObject *self)
+{
+    PyObject *keys = sharedskipdict_list(self, KEY, -HUGE_VAL, HUGE_VAL);
+    PyObject *it;
+
+    if (!keys) return NULL;
+    it = PyObject_GetIter(keys);
+    Py_DECREF(keys);
+    return it;
+}
+
+static PyObject *
+sharedskipdict_name(SharedSkipDictObject *self)
+{
+    if (!self->name) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return PyString_FromString(self->name);
+}
+
+static PyObject *
+sharedskipdict_capacity(SharedSkipDictObject *self)
+{
+    if (sharedskipdict_check(self, 0)) return NULL;
+    return PyLong_FromUnsignedLongLong(self->shm->capacity);
+}
+
+static PyObject *
+sharedskipdict_writable(SharedSkipDictObject *self)
+{
+    return PyBool_FromLong(self->shm && self->shm->writable);
+}
+
+static PyMethodDef sharedskipdict_methods[] = {
+    {"get", (PyCFunction)sharedskipdict_get, METH_VARARGS, NULL},
+    {"change", (PyCFunction)sharedskipdict_change, METH_VARARGS, NULL},
+    {"index", (PyCFunction)sharedskipdict_index, METH_O, NULL},
+    {"keys", (PyCFunction)sharedskipdict_keys, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"values", (PyCFunction)sharedskipdict_values, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"items", (PyCFunction)sharedskipdict_items, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"close", (PyCFunction)sharedskipdict_close, METH_NOARGS, NULL},
+    {"unlink", (PyCFunction)sharedskipdict_unlink, METH_NOARGS, NULL},
+    {NULL}
+};
+
+static PyGetSetDef sharedskipdict_getset[] = {
+    {"name", (getter)sharedskipdict_name, NULL, "name", NULL},
+    {"capacity", (getter)sharedskipdict_capacity, NULL, "capacity", NULL},
+    {"writable", (getter)sharedskipdict_writable, NULL, "writable", NULL},
+    {NULL}
+};
+
+static PyMappingMethods sharedskipdict_as_mapping = {
+    (lenfunc)sharedskipdict_length,        /*mp_length*/
+    (binaryfunc)sharedskipdict_getitem,    /*mp_subscript*/
+    (objobjargproc)sharedskipdict_ass_sub, /*mp_ass_subscript*/
+};
+
+static PySequenceMethods sharedskipdict_as_sequence = {
+    (lenfunc)sharedskipdict_length,        /*sq_length*/
+    0,                                     /*sq_concat*/
+    0,                                     /*sq_repeat*/
+    0,                                     /*sq_item*/
+    0,                                     /*sq_slice*/
+    0,                                     /*sq_ass_item*/
+    0,                                     /*sq_ass_slice*/
+    (objobjproc)sharedskipdict_contains,   /*sq_contains*/
+    0,                                     /*sq_inplace_concat*/
+    0,                                     /*sq_inplace_repeat*/
+};
+
+static PyTypeObject SharedSkipDictType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "skipdict.SharedSkipDict",             /* tp_name */
+    sizeof(SharedSkipDictObject),          /* tp_basicsize */
+    0,                                     /* tp_itemsize */
+    (destructor)sharedskipdict_dealloc,    /* tp_dealloc */
+    0,                                     /* tp_print */
+    0,                                     /* tp_getattr */
+    0,                                     /* tp_setattr */
+    0,                                     /* tp_compare */
+    0,                                     /* tp_repr */
+    0,                                     /* tp_as_number */
+    &sharedskipdict_as_sequence,           /* tp_as_sequence*/
+    &sharedskipdict_as_mapping,            /* tp_as_mapping */
+    (hashfunc)PyObject_HashNotImplemented, /* tp_hash */
+    0,                                     /* tp_call */
+    0,                                     /* tp_str */
+    0,                                     /* tp_getattro */
+    0,                                     /* tp_setattro */
+    0,                                     /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE,/* tp_flags */
+    0,                                     /* tp_doc */
+    0,                                     /* tp_traverse */
+    0,                                     /* tp_clear */
+    0,                                     /* tp_richcompare */
+    0,                                     /* tp_weaklistoffset */
+    (getiterfunc)sharedskipdict_iter,      /* tp_iter */
+    0,                                     /* tp_iternext */
+    sharedskipdict_methods,                /* tp_methods */
+    0,                                     /* tp_members */
+    sharedskipdict_getset,                 /* tp_getset */
+    0,                                     /* tp_base */
+    0,                                     /* tp_dict */
+    0,                                     /* tp_descr_get */
+    0,                                     /* tp_descr_set */
+    0,                                     /* tp_dictoffset */
+    (initproc)sharedskipdict_init,         /* tp_init */
+    PyType_GenericAlloc,                   /* tp_alloc */
+    PyType_GenericNew,                     /* tp_new */
+    PyObject_Del,                          /* tp_free */
+    0,                                     /* tp_is_gc */
+};
+
+/* Multi-index skip dict.
+
+   Several named score orderings over one key set. Each key has one
+   record, (key, score, score, ...), in one slot of the mapping, and
+   each field has a skiplist of the records ordered by that field's
+   score. Values are tuples of scores in field order; ordered views
+   and ranks take the field name and are lists, as for the shared
+   skip dict. */
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *fields;           /* tuple of names */
+    PyObject *mapping;          /* key -> record */
+    skiplist **skiplists;       /* one per field */
+    Py_ssize_t nfields;
+#ifdef Py_GIL_DISABLED
+    pthread_rwlock_t lock;
+#endif
+} MultiSkipDictObject;
+
+static Py_ssize_t
+multiskipdict_field(MultiSkipDictObject *self, PyObject *name)
+{
+    Py_ssize_t i;
+    int eq;
+
+    for (i = 0; i < self->nfields; i++) {
+        eq = PyObject_RichCompareBool(
+            PyTuple_GET_ITEM(self->fields, i), name, Py_EQ);
+        if (eq) return eq < 0 ? -1 : i;
+    }
+    PyErr_SetObject(PyExc_KeyError, name);
+    return -1;
+}
+
+/* Converts a sequence of scores in field order, or a dict of scores by
+   field name, into new floats; fields missing from the dict are left
+   NULL. */
+static int
+multiskipdict_scores(MultiSkipDictObject *self, PyObject *value,
+                     PyObject **scores)
+{
+    PyObject *name, *score, *fast = NULL;
+    Py_ssize_t i, pos = 0;
+    double d;
+
+    memset(scores, 0, self->nfields * sizeof(PyObject *));
+    if (PyDict_Check(value)) {
+        while (PyDict_Next(value, &pos, &name, &score)) {
+            if ((i = multiskipdict_field(self, name)) < 0 ||
+                skipdict_score_from(score, &d)) goto Fail;
+            Py_XDECREF(scores[i]);
+            if (!(scores[i] = PyFloat_FromDouble(d))) goto Fail;
+        }
+        return 0;
+    }
 
-    PyObject *item = PyDict_GetItem(self->mapping, key);
-    if (item) {
-        value = PyTuple_GET_ITEM(item, 1);
-    } else {
-        value = failobj;
+    fast = PySequence_Fast(value, "expected a sequence or dict of scores");
+    if (!fast) return -1;
+    if (PySequence_Fast_GET_SIZE(fast) != self->nfields) {
+        PyErr_Format(PyExc_ValueError, "expected %zd scores, got %zd",
+                     self->nfields, PySequence_Fast_GET_SIZE(fast));
+        goto Fail;
+    }
+    for (i = 0; i < self->nfields; i++) {
+        if (skipdict_score_from(PySequence_Fast_GET_ITEM(fast, i), &d) ||
+            !(scores[i] = PyFloat_FromDouble(d))) goto Fail;
     }
+    Py_DECREF(fast);
+    return 0;
 
-    Py_INCREF(value);
-    return value;
+ Fail:
+    Py_XDECREF(fast);
+    for (i = 0; i < self->nfields; i++) {
+        Py_CLEAR(scores[i]);
+    }
+    return -1;
 }
 
-PyObject *
-skipdict_setdefault(SkipDictObject *self, PyObject *args)
+/* A random height for a node of a field's skiplist. */
+static int
+multiskipdict_level(void)
 {
-    PyObject *key, *value;
-    PyObject *defaultobj = Py_None;
+    int level = 1;
 
-    if (!PyArg_UnpackTuple(args, "setdefault", 1, 2, &key, &defaultobj))
-        return NULL;
+    while ((random() & 0xffff) < (P * 0xffff) && level < MAXLEVEL)
+        level++;
+    return level;
+}
 
-    PyObject *item = PyDict_GetItem(self->mapping, key);
-    if (!item) {
-        if (skipdict_insertobj(self, key, defaultobj, 0)) {
-            return NULL;
+/* Drops the record of a key after a node could not be allocated for
+   the given field, unlinking its nodes in the other skiplists at the
+   scores in the record. */
+static void
+multiskipdict_drop(MultiSkipDictObject *self, PyObject *key, Py_hash_t hash,
+                   PyObject *record, Py_ssize_t missing)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < self->nfields; i++) {
+        if (i == missing) continue;
+        slDelete(self->skiplists[i],
+                 PyFloat_AS_DOUBLE(PyTuple_GET_ITEM(record, i + 1)),
+                 (void *) record, NULL);
+    }
+    Dict_DelItemHash(self->mapping, key, hash);
+    PyErr_NoMemory();
+}
+
+/* Sets the given scores (stealing them) of the key's record, which
+   needs all of them if the key is new. Each field relinks or updates
+   its node in place; nothing changes if a score is missing. The key is
+   hashed before taking the write lock. */
+static int
+multiskipdict_assign(MultiSkipDictObject *self, PyObject *key,
+                     Py_hash_t hash, PyObject **scores)
+{
+    PyObject *record, *previous;
+    Py_ssize_t i;
+    double score;
+    int err = -1;
+
+    if (!(record = Dict_GetItemHash(self->mapping, key, hash))) {
+        if (PyErr_Occurred()) goto Done;
+        for (i = 0; i < self->nfields; i++) {
+            if (!scores[i]) {
+                PyErr_SetString(PyExc_ValueError,
+                                "a new key needs every score");
+                goto Done;
+            }
         }
-        value = defaultobj;
-    } else {
-        value = PyTuple_GET_ITEM(item, 1);
+        if (!(record = PyTuple_New(self->nfields + 1))) goto Done;
+        Py_INCREF(key);
+        PyTuple_SET_ITEM(record, 0, key);
+        for (i = 0; i < self->nfields; i++) {
+            PyTuple_SET_ITEM(record, i + 1, scores[i]);
+            scores[i] = NULL;
+        }
+        err = Dict_SetItemHash(self->mapping, key, record, hash);
+        Py_DECREF(record);
+        if (err) goto Done;
+        for (i = 0; i < self->nfields; i++) {
+            if (!slInsert(self->skiplists[i],
+                          PyFloat_AS_DOUBLE(PyTuple_GET_ITEM(record, i + 1)),
+                          (void *) record, multiskipdict_level())) {
+                multiskipdict_drop(self, key, hash, record, i);
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    for (i = 0; i < self->nfields; i++) {
+        if (!scores[i]) continue;
+        previous = PyTuple_GET_ITEM(record, i + 1);
+        score = PyFloat_AS_DOUBLE(scores[i]);
+        if (slDelete(self->skiplists[i], PyFloat_AS_DOUBLE(previous),
+                     (void *) record, &score) == 1 &&
+            !slInsert(self->skiplists[i], score, (void *) record,
+                      multiskipdict_level())) {
+            multiskipdict_drop(self, key, hash, record, i);
+            goto Done;
+        }
+        PyTuple_SET_ITEM(record, i + 1, scores[i]);
+        scores[i] = NULL;
+        Py_DECREF(previous);
     }
+    err = 0;
 
-    Py_XINCREF(value);
-    return value;
+ Done:
+    for (i = 0; i < self->nfields; i++) {
+        Py_CLEAR(scores[i]);
+    }
+    return err;
 }
 
-static PyObject *
-skipdict_iterator_from_range(SkipDictObject *self,
-                             PyObject *args, PyObject *kw,
-                             itertype type)
+static int
+multiskipdict_insertpair(MultiSkipDictObject *self, PyObject *key,
+                         PyObject *value)
 {
-    PyObject *min = NULL;
-    PyObject *max = NULL;
+    PyObject **scores;
+    Py_hash_t hash;
+    int err = -1;
+
+    if ((hash = PyObject_Hash(key)) == -1) return -1;
+    scores = PyMem_Malloc(self->nfields * sizeof(PyObject *));
+    if (!scores) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (!multiskipdict_scores(self, value, scores)) {
+        Write_Lock(self);
+        err = multiskipdict_assign(self, key, hash, scores);
+        Write_Unlock(self);
+    }
+    PyMem_Free(scores);
+    return err;
+}
 
-    static char *kwlist[] = {"min", "max", NULL};
+static int
+multiskipdict_init(MultiSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    PyObject *fields, *seq = NULL, *name;
+    Py_ssize_t i, j;
+    static char *kwlist[] = {"fields", "sequence", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kw, "|OO:SkipDict", kwlist,
-                                     &min, &max)) {
-        return NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|O:MultiSkipDict", kwlist,
+                                     &fields, &seq)) {
+        return -1;
+    }
+    if (self->fields) {
+        PyErr_SetString(PyExc_RuntimeError, "already initialized");
+        return -1;
     }
+#ifdef Py_GIL_DISABLED
+    pthread_rwlock_init(&self->lock, NULL);
+#endif
 
-    PyObject *it = NULL;
-    skiplistiter *iter;
+    if (!(self->fields = PySequence_Tuple(fields))) return -1;
+    self->nfields = PyTuple_GET_SIZE(self->fields);
+    if (!self->nfields) {
+        PyErr_SetString(PyExc_ValueError, "no fields given");
+        return -1;
+    }
+    for (i = 0; i < self->nfields; i++) {
+        name = PyTuple_GET_ITEM(self->fields, i);
+        for (j = 0; j < i; j++) {
+            int eq = PyObject_RichCompareBool(
+                PyTuple_GET_ITEM(self->fields, j), name, Py_EQ);
+            if (eq < 0) return -1;
+            if (eq) {
+                PyErr_SetString(PyExc_ValueError, "duplicate field");
+                return -1;
+            }
+        }
+    }
 
-    if (!self->skiplist->tail) {
-        it = PyTuple_New(0);
-        return PyObject_GetIter(it);
+    self->skiplists = PyMem_Malloc(self->nfields * sizeof(skiplist *));
+    if (!self->skiplists) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    memset(self->skiplists, 0, self->nfields * sizeof(skiplist *));
+    for (i = 0; i < self->nfields; i++) {
+        if (!(self->skiplists[i] = slCreate(MAXLEVEL))) {
+            PyErr_NoMemory();
+            return -1;
+        }
     }
+    if (!(self->mapping = PyDict_New())) return -1;
 
-    if (!(min || max)) {
-        iter = slIterNewFromHead(self->skiplist);
-    } else {
-        double dmin = self->skiplist->header->level[0].forward->score;
-        double dmax = self->skiplist->tail->score;
+    if (seq) {
+        return skipdict_foreach(
+            seq, (pairfunc) multiskipdict_insertpair, self);
+    }
+    return 0;
+}
 
-        float_Convert(dmin, min);
-        float_Convert(dmax, max);
+static void
+multiskipdict_dealloc(MultiSkipDictObject *self)
+{
+    Py_ssize_t i;
 
-        iter = slIterNewFromRange(self->skiplist, dmin, dmax);
+    for (i = 0; self->skiplists && i < self->nfields; i++) {
+        if (self->skiplists[i]) slFree(self->skiplists[i]);
     }
+    PyMem_Free(self->skiplists);
+    Py_XDECREF(self->mapping);
+    Py_XDECREF(self->fields);
+#ifdef Py_GIL_DISABLED
+    pthread_rwlock_destroy(&self->lock);
+#endif
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
 
-    if (!iter) {
-        return NULL;
-    }
-    it = skipdict_iterator(self, iter, type, -1);
-    if (!it) {
-        slIterDel(iter);
+static int
+multiskipdict_check(MultiSkipDictObject *self)
+{
+    if (!self->mapping) {
+        PyErr_SetString(PyExc_RuntimeError, "not initialized");
+        return -1;
     }
-    return it;
+    return 0;
 }
 
-static PyObject *
-skipdict_keys(SkipDictObject *self, PyObject *args, PyObject *kw)
+static Py_ssize_t
+multiskipdict_length(MultiSkipDictObject *self)
 {
-    return skipdict_iterator_from_range(self, args, kw, KEY);
+    if (multiskipdict_check(self)) return -1;
+    return PyDict_Size(self->mapping);
 }
 
-static PyObject *
-skipdict_values(SkipDictObject *self, PyObject *args, PyObject *kw)
+static int
+multiskipdict_contains(MultiSkipDictObject *self, PyObject *key)
 {
-    return skipdict_iterator_from_range(self, args, kw, VALUE);
+    if (multiskipdict_check(self)) return -1;
+    return PyDict_Contains(self->mapping, key);
 }
 
+/* The scores of a key, or failobj if it is missing; a KeyError
+   without one. */
 static PyObject *
-skipdict_items(SkipDictObject *self, PyObject *args, PyObject *kw)
+multiskipdict_find(MultiSkipDictObject *self, PyObject *key,
+                   PyObject *failobj)
 {
-    return skipdict_iterator_from_range(self, args, kw, ITEM);
+    PyObject *record, *result;
+
+    if (multiskipdict_check(self) ||
+        skipdict_lookup(self->mapping, key, &record)) return NULL;
+    if (!record) {
+        if (!failobj) {
+            PyErr_SetObject(PyExc_KeyError, key);
+        }
+        Py_XINCREF(failobj);
+        return failobj;
+    }
+    Read_Lock(self);
+    result = PyTuple_GetSlice(record, 1, self->nfields + 1);
+    Read_Unlock(self);
+    Py_DECREF(record);
+    return result;
 }
 
 static PyObject *
-skipdict_repr(SkipDictObject *self)
+multiskipdict_getitem(MultiSkipDictObject *self, PyObject *key)
 {
+    return multiskipdict_find(self, key, NULL);
+}
+
+static int
+multiskipdict_ass_sub(MultiSkipDictObject *self, PyObject *key,
+                      PyObject *value)
+{
+    PyObject *record;
+    Py_hash_t hash;
     Py_ssize_t i;
-    PyObject *s, *temp, *colon = NULL;
-    PyObject *pieces = NULL, *result = NULL;
-    PyObject *key, *value;
-    SkipDictIterObject * it = NULL;
-    double score;
+    int err = 0;
 
-    i = Py_ReprEnter((PyObject *)self);
-    if (i != 0) {
-        return i > 0 ? PyString_FromString("{...}") : NULL;
+    if (multiskipdict_check(self)) return -1;
+    if (value) {
+        return multiskipdict_insertpair(self, key, value);
     }
-
-    if (slLength(self->skiplist) == 0) {
-        result = PyString_FromString("{}");
-        goto Done;
+    if ((hash = PyObject_Hash(key)) == -1) return -1;
+
+    Write_Lock(self);
+    record = Dict_GetItemHash(self->mapping, key, hash);
+    if (record) {
+        /* The record is released after the lock, as the mapping may
+           hold its last reference. */
+        Py_INCREF(record);
+        for (i = 0; i < self->nfields; i++) {
+            slDelete(self->skiplists[i],
+                     PyFloat_AS_DOUBLE(PyTuple_GET_ITEM(record, i + 1)),
+                     (void *) record, NULL);
+        }
+        err = Dict_DelItemHash(self->mapping, key, hash);
+    }
+    Write_Unlock(self);
+    if (!record) {
+        if (!PyErr_Occurred()) PyErr_SetObject(PyExc_KeyError, key);
+        return -1;
     }
+    Py_DECREF(record);
+    return err;
+}
 
-    pieces = PyList_New(0);
-    if (pieces == NULL)
-        goto Done;
+static PyObject *
+multiskipdict_get(MultiSkipDictObject *self, PyObject *args)
+{
+    PyObject *key, *failobj = Py_None;
 
-    colon = PyString_FromString(": ");
-    if (colon == NULL)
-        goto Done;
+    if (!PyArg_UnpackTuple(args, "get", 1, 2, &key, &failobj))
+        return NULL;
+    return multiskipdict_find(self, key, failobj);
+}
 
-    it = (SkipDictIterObject* ) skipdict_iterator(self, NULL, ITEM, -1);
+/* set(key, **scores) changes some of the scores of a key at once. */
+static PyObject *
+multiskipdict_set(MultiSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    PyObject *key;
 
-    /* Do repr() on each key+value pair, and insert ": " between them.
-       Note that repr may mutate the dict. */
-    i = 0;
-    while (!skipdictiter_fetch(it->iter, &score, &key)) {
-        value = (PyObject *) PyFloat_FromDouble(score);
-        int status;
-        s = PyObject_Repr(key);
-        PyString_Concat(&s, colon);
-        PyString_ConcatAndDel(&s, PyObject_Repr(value));
-        Py_DECREF(value);
-        if (s == NULL)
-            goto Done;
-        status = PyList_Append(pieces, s);
-        Py_DECREF(s);  /* append created a new ref */
-        if (status < 0)
-            goto Done;
-    }
+    if (!PyArg_UnpackTuple(args, "set", 1, 1, &key)) return NULL;
+    if (multiskipdict_check(self)) return NULL;
+    if (kw && multiskipdict_insertpair(self, key, kw)) return NULL;
+    Py_INCREF(Py_None);
+    return Py_None;
+}
 
-    PyErr_Clear();
+static PyObject *
+multiskipdict_index(MultiSkipDictObject *self, PyObject *args)
+{
+    PyObject *name, *key, *record;
+    Py_ssize_t i;
+    unsigned long rank = 0;
+
+    if (!PyArg_ParseTuple(args, "OO:index", &name, &key)) return NULL;
+    if (multiskipdict_check(self) ||
+        (i = multiskipdict_field(self, name)) < 0) return NULL;
+
+    if (skipdict_lookup(self->mapping, key, &record)) return NULL;
+    if (record) {
+        Read_Lock(self);
+        rank = slGetRank(self->skiplists[i],
+                         PyFloat_AS_DOUBLE(PyTuple_GET_ITEM(record, i + 1)),
+                         (void *) record);
+        Read_Unlock(self);
+        Py_DECREF(record);
+    }
+    /* The record may have been deleted since the lookup. */
+    if (!rank) {
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+    return PyInt_FromSsize_t((Py_ssize_t) rank - 1);
+}
 
-    /* Add "{}" decorations to the first and last items. */
-    assert(PyList_GET_SIZE(pieces) > 0);
-    s = PyString_FromString("{");
-    if (s == NULL)
-        goto Done;
+/* The entries of a field between min and max, in reverse if min is
+   greater than max. */
+static PyObject *
+multiskipdict_list(MultiSkipDictObject *self, PyObject *args, PyObject *kw,
+                   itertype type)
+{
+    PyObject *name, *min = NULL, *max = NULL, *result, *record, *item;
+    double dmin = -HUGE_VAL, dmax = HUGE_VAL, score;
+    skiplistNode *node;
+    Py_ssize_t i;
+    int forward;
+    static char *kwlist[] = {"field", "min", "max", NULL};
 
-    temp = PyList_GET_ITEM(pieces, 0);
-    PyString_ConcatAndDel(&s, temp);
-    PyList_SET_ITEM(pieces, 0, s);
-    if (s == NULL)
-        goto Done;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|OO:MultiSkipDict", kwlist,
+                                     &name, &min, &max)) {
+        return NULL;
+    }
+    if (multiskipdict_check(self) ||
+        (i = multiskipdict_field(self, name)) < 0) return NULL;
+    float_Convert(dmin, min);
+    float_Convert(dmax, max);
+
+    forward = dmin <= dmax;
+    if (!forward) {
+        score = dmin;
+        dmin = dmax;
+        dmax = score;
+    }
+    if (!(result = PyList_New(0))) return NULL;
+
+    Read_Lock(self);
+    node = forward ? slFirstInRange(self->skiplists[i], dmin, dmax) : \
+        slLastInRange(self->skiplists[i], dmin, dmax);
+    while (node && node->score >= dmin && node->score <= dmax) {
+        record = node->obj;
+        switch (type) {
+            case KEY:
+                item = PyTuple_GET_ITEM(record, 0);
+                Py_INCREF(item);
+                break;
+            case VALUE:
+                item = PyTuple_GetSlice(record, 1, self->nfields + 1);
+                break;
+            default:
+                item = PyTuple_Pack(2, PyTuple_GET_ITEM(record, 0),
+                                    PyTuple_GET_ITEM(record, i + 1));
+        }
+        if (!item || PyList_Append(result, item)) {
+            Py_XDECREF(item);
+            Py_CLEAR(result);
+            break;
+        }
+        Py_DECREF(item);
+        node = forward ? node->level[0].forward : node->backward;
+    }
+    Read_Unlock(self);
+    return result;
+}
 
-    s = PyString_FromString("}");
-    if (s == NULL)
-        goto Done;
-    temp = PyList_GET_ITEM(pieces, PyList_GET_SIZE(pieces) - 1);
-    PyString_ConcatAndDel(&temp, s);
-    PyList_SET_ITEM(pieces, PyList_GET_SIZE(pieces) - 1, temp);
-    if (temp == NULL)
-        goto Done;
+static PyObject *
+multiskipdict_keys(MultiSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    return multiskipdict_list(self, args, kw, KEY);
+}
 
-    /* Paste them all together with ", " between. */
-    s = PyString_FromString(", ");
-    if (s == NULL)
-        goto Done;
-    result = _PyString_Join(s, pieces);
-    Py_DECREF(s);
-Done:
-    Py_XDECREF(pieces);
-    Py_XDECREF(colon);
-    Py_XDECREF(it);
-    Py_ReprLeave((PyObject *)self);
-    return result;
+static PyObject *
+multiskipdict_values(MultiSkipDictObject *self, PyObject *args, PyObject *kw)
+{
+    return multiskipdict_list(self, args, kw, VALUE);
 }
 
 static PyObject *
-skipdict_maxlevel(SkipDictObject *self)
+multiskipdict_items(MultiSkipDictObject *self, PyObject *args, PyObject *kw)
 {
-    return PyInt_FromLong(self->skiplist->maxlevel);
+    return multiskipdict_list(self, args, kw, ITEM);
 }
 
 static PyObject *
-skipdictiter_repr(SkipDictIterObject *self)
+multiskipdict_iter(MultiSkipDictObject *self)
 {
-    char* min = double_AsString(self->iter->min);
-    char* max = double_AsString(self->iter->max);
-    PyObject *repr = PyString_FromFormat("<SkipDictIterator "
-                                         "type=\"%s\" "
-                                         "forward=%s "
-                                         "min=%s "
-                                         "max=%s "
-                                         "at %p>",
-                                         iterator_names[self->type],
-                                         booleans[self->iter->forward],
-                                         min,
-                                         max,
-                                         self->skipdict);
-    PyMem_Free(min);
-    PyMem_Free(max);
-    return repr;
+    if (multiskipdict_check(self)) return NULL;
+    return PyObject_GetIter(self->mapping);
 }
 
+/* Keys and their scores, in the order of the first field. */
 static PyObject *
-skipdict_richcompare(SkipDictObject *self, PyObject* other, int op)
+multiskipdict_repr(MultiSkipDictObject *self)
 {
-    PyObject *mapping;
-    if (PyDict_Check(other)) {
-        mapping = other;
-    } else {
-        if (!skipdict_Check(other)) {
-            PyObject *repr = PyObject_Repr(other);
-            PyErr_Format(PyExc_TypeError,
-                         "can't compare with %s",
-                         PyString_AsString(repr));
-            Py_DECREF(repr);
-            return NULL;
+    PyObject *items, *record, *item;
+    skiplistNode *node;
+
+    if (multiskipdict_check(self)) return NULL;
+    if (!(items = PyList_New(0))) return NULL;
+
+    Read_Lock(self);
+    for (node = self->skiplists[0]->header->level[0].forward; node;
+         node = node->level[0].forward) {
+        record = node->obj;
+        item = Py_BuildValue("(ON)", PyTuple_GET_ITEM(record, 0),
+                             PyTuple_GetSlice(record, 1, self->nfields + 1));
+        if (!item || PyList_Append(items, item)) {
+            Py_XDECREF(item);
+            Py_CLEAR(items);
+            break;
         }
-        SkipDictObject* obj = (SkipDictObject*) other;
-        mapping = obj->mapping;
+        Py_DECREF(item);
     }
-    return PyDict_Type.tp_richcompare(self->mapping, mapping, op);
+    Read_Unlock(self);
+    return skipdict_items_repr((PyObject *) self, items);
+}
+
+static PyObject *
+multiskipdict_fields(MultiSkipDictObject *self)
+{
+    if (multiskipdict_check(self)) return NULL;
+    Py_INCREF(self->fields);
+    return self->fields;
 }
 
-static PyMethodDef skipdict_methods[] = {
-    {"get", (PyCFunction)skipdict_get, METH_VARARGS, NULL},
-    {"setdefault", (PyCFunction)skipdict_setdefault, METH_VARARGS, NULL},
-    {"keys", (PyCFunction)skipdict_keys, METH_VARARGS | METH_KEYWORDS, NULL},
-    {"values", (PyCFunction)skipdict_values, METH_VARARGS | METH_KEYWORDS, NULL},
-    {"items", (PyCFunction)skipdict_items, METH_VARARGS | METH_KEYWORDS, NULL},
-    {"index", (PyCFunction)skipdict_index, METH_O, NULL},
-    {"change", (PyCFunction)skipdict_change, METH_VARARGS, NULL},
+static PyMethodDef multiskipdict_methods[] = {
+    {"get", (PyCFunction)multiskipdict_get, METH_VARARGS, NULL},
+    {"set", (PyCFunction)multiskipdict_set, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"index", (PyCFunction)multiskipdict_index, METH_VARARGS, NULL},
+    {"keys", (PyCFunction)multiskipdict_keys, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"values", (PyCFunction)multiskipdict_values, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"items", (PyCFunction)multiskipdict_items, METH_VARARGS | METH_KEYWORDS, NULL},
     {NULL}
 };
 
-static PyGetSetDef skipdict_getset[] = {
-    {"maxlevel", (getter)skipdict_maxlevel, NULL, "maxlevel", NULL},
+static PyGetSetDef multiskipdict_getset[] = {
+    {"fields", (getter)multiskipdict_fields, NULL, "fields", NULL},
     {NULL}
 };
 
-static PyMappingMethods mapping = {
-    (lenfunc)skipdict_length,              /*mp_length*/
-    (binaryfunc)skipdict_getitem,          /*mp_subscript*/
-    (objobjargproc)skipdict_ass_sub,       /*mp_ass_subscript*/
+static PyMappingMethods multiskipdict_as_mapping = {
+    (lenfunc)multiskipdict_length,         /*mp_length*/
+    (binaryfunc)multiskipdict_getitem,     /*mp_subscript*/
+    (objobjargproc)multiskipdict_ass_sub,  /*mp_ass_subscript*/
 };
 
-static PySequenceMethods sequence = {
-    (lenfunc)skipdict_length,              /*sq_length*/
+static PySequenceMethods multiskipdict_as_sequence = {
+    (lenfunc)multiskipdict_length,         /*sq_length*/
     0,                                     /*sq_concat*/
     0,                                     /*sq_repeat*/
     0,                                     /*sq_item*/
- 	0,                                     /*sq_slice*/
+    0,                                     /*sq_slice*/
     0,                                     /*sq_ass_item*/
     0,                                     /*sq_ass_slice*/
-    (objobjproc)skipdict_contains,         /*sq_contains*/
+    (objobjproc)multiskipdict_contains,    /*sq_contains*/
     0,                                     /*sq_inplace_concat*/
     0,                                     /*sq_inplace_repeat*/
 };
 
-static PyTypeObject SkipDictType = {
+static PyTypeObject MultiSkipDictType = {
     PyVarObject_HEAD_INIT(NULL, 0)
-    "skipdict.SkipDict",                   /* tp_name */
-    sizeof(SkipDictObject),                /* tp_basicsize */
+    "skipdict.MultiSkipDict",              /* tp_name */
+    sizeof(MultiSkipDictObject),           /* tp_basicsize */
     0,                                     /* tp_itemsize */
-    (destructor)skipdict_dealloc,          /* tp_dealloc */
+    (destructor)multiskipdict_dealloc,     /* tp_dealloc */
     0,                                     /* tp_print */
     0,                                     /* tp_getattr */
     0,                                     /* tp_setattr */
     0,                                     /* tp_compare */
-    (reprfunc)skipdict_repr,               /* tp_repr */
+    (reprfunc)multiskipdict_repr,          /* tp_repr */
     0,                                     /* tp_as_number */
-    &sequence,                             /* tp_as_sequence*/
-    &mapping,                              /* tp_as_mapping */
+    &multiskipdict_as_sequence,            /* tp_as_sequence*/
+    &multiskipdict_as_mapping,             /* tp_as_mapping */
     (hashfunc)PyObject_HashNotImplemented, /* tp_hash */
     0,                                     /* tp_call */
     0,                                     /* tp_str */
@@ -898,63 +2584,201 @@ static PyTypeObject SkipDictType = {
     0,                                     /* tp_as_buffer */
     Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE,/* tp_flags */
     0,                                     /* tp_doc */
-    0,		                               /* tp_traverse */
-    0,		                               /* tp_clear */
-    (richcmpfunc)skipdict_richcompare,     /* tp_richcompare */
-    0,		                               /* tp_weaklistoffset */
-    (getiterfunc)skipdict_iter,            /* tp_iter */
-    0,		                               /* tp_iternext */
-    skipdict_methods,                      /* tp_methods */
+    0,                                     /* tp_traverse */
+    0,                                     /* tp_clear */
+    0,                                     /* tp_richcompare */
+    0,                                     /* tp_weaklistoffset */
+    (getiterfunc)multiskipdict_iter,       /* tp_iter */
+    0,                                     /* tp_iternext */
+    multiskipdict_methods,                 /* tp_methods */
     0,                                     /* tp_members */
-    skipdict_getset,                       /* tp_getset */
+    multiskipdict_getset,                  /* tp_getset */
     0,                                     /* tp_base */
     0,                                     /* tp_dict */
     0,                                     /* tp_descr_get */
     0,                                     /* tp_descr_set */
     0,                                     /* tp_dictoffset */
-    (initproc)skipdict_init,               /* tp_init */
+    (initproc)multiskipdict_init,          /* tp_init */
     PyType_GenericAlloc,                   /* tp_alloc */
     PyType_GenericNew,                     /* tp_new */
     PyObject_Del,                          /* tp_free */
     0,                                     /* tp_is_gc */
 };
 
-static PyMappingMethods skipdictiter_as_mapping = {
-    0,                                     /*mp_length*/
-    (binaryfunc)skipdictiter_slice,        /*mp_subscript*/
-    0,                                     /*mp_ass_subscript*/
-};
+/* C API (see skipdict.h). */
 
-static PyTypeObject SkipDictIterType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    "skipdict.SkipDictIterator",            /* tp_name */
-    sizeof(SkipDictIterObject),             /* tp_basicsize */
-    0,                                      /* tp_itemsize */
-    /* methods */
-    (destructor)skipdictiter_dealloc,       /* tp_dealloc */
-    0,                                      /* tp_print */
-    0,                                      /* tp_getattr */
-    0,                                      /* tp_setattr */
-    0,                                      /* tp_compare */
-    (reprfunc)skipdictiter_repr,            /* tp_repr */
-    0,                                      /* tp_as_number */
-    0,                                      /* tp_as_sequence */
-    &skipdictiter_as_mapping,               /* tp_as_mapping */
-    0,                                      /* tp_hash */
-    0,                                      /* tp_call */
-    0,                                      /* tp_str */
-    PyObject_GenericGetAttr,                /* tp_getattro */
-    0,                                      /* tp_setattro */
-    0,                                      /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_HAVE_GC,  /* tp_flags */
-    0,                                      /* tp_doc */
-    (traverseproc)skipdictiter_traverse,    /* tp_traverse */
-    0,                                      /* tp_clear */
-    0,                                      /* tp_richcompare */
-    0,                                      /* tp_weaklistoffset */
-    PyObject_SelfIter,                      /* tp_iter */
-    (iternextfunc)skipdictiter_next,        /* tp_iternext */
-    0,                                      /* tp_methods */
+static int
+skipdict_capi_lookup(PyObject *sd, PyObject *key, double *score)
+{
+    SkipDictObject *self = (SkipDictObject *) sd;
+    int found = 0;
+
+    Read_Lock(self);
+    PyObject *item = PyDict_GetItem(self->mapping, key);
+    if (item) {
+        found = skipdict_score_from(PyTuple_GET_ITEM(item, 1), score) ? \
+            -1 : 1;
+    }
+    Read_Unlock(self);
+    return found;
+}
+
+static int
+skipdict_capi_set(PyObject *sd, PyObject *key, double score)
+{
+    SkipDictObject *self = (SkipDictObject *) sd;
+    PyObject *value;
+    Py_hash_t hash;
+    int err, level;
+
+    if ((hash = PyObject_Hash(key)) == -1 ||
+        (level = skipdict_draw(self)) < 0 ||
+        !(value = PyFloat_FromDouble(score))) {
+        return -1;
+    }
+    Write_Lock(self);
+    err = skipdict_assign(self, key, hash, value, level);
+    skipdict_write_unlock(self);
+    Py_DECREF(value);
+    return err ? -1 : 0;
+}
+
+static int
+skipdict_capi_change(PyObject *sd, PyObject *key, double delta,
+                     double *score)
+{
+    SkipDictObject *self = (SkipDictObject *) sd;
+    PyObject *value;
+    double sum = delta;
+    Py_hash_t hash;
+    int err, level;
+
+    if ((hash = PyObject_Hash(key)) == -1 ||
+        (level = skipdict_draw(self)) < 0) {
+        return -1;
+    }
+
+    /* The sum is computed here rather than with PyNumber_Add() as in
+       change(), such that only the result is boxed. */
+    Write_Lock(self);
+    PyObject *item = Dict_GetItemHash(self->mapping, key, hash);
+    if (item) {
+        double previous;
+        if (skipdict_score_from(PyTuple_GET_ITEM(item, 1), &previous)) {
+            skipdict_write_unlock(self);
+            return -1;
+        }
+        sum += previous;
+    } else if (PyErr_Occurred()) {
+        skipdict_write_unlock(self);
+        return -1;
+    }
+    value = PyFloat_FromDouble(sum);
+    err = !value || skipdict_insertobj(self, key, hash, value, 1, level);
+    skipdict_write_unlock(self);
+    Py_XDECREF(value);
+    if (err) return -1;
+    if (score) *score = sum;
+    return 0;
+}
+
+static int
+skipdict_capi_delete(PyObject *sd, PyObject *key)
+{
+    SkipDictObject *self = (SkipDictObject *) sd;
+    Py_hash_t hash;
+    int err = 0, found;
+
+    if ((hash = PyObject_Hash(key)) == -1) return -1;
+    Write_Lock(self);
+    found = Dict_GetItemHash(self->mapping, key, hash) != NULL;
+    if (found) {
+        err = skipdict_delitem(self, key, hash, 1);
+    } else {
+        err = PyErr_Occurred() != NULL;
+    }
+    skipdict_write_unlock(self);
+    return err ? -1 : found;
+}
+
+static Py_ssize_t
+skipdict_capi_rank(PyObject *sd, PyObject *key)
+{
+    SkipDictObject *self = (SkipDictObject *) sd;
+    unsigned long rank = 0;
+    double score;
+
+    skipdict_read_lock(self);
+    PyObject *item = PyDict_GetItem(self->mapping, key);
+    if (!item) {
+        Read_Unlock(self);
+        PyErr_SetObject(PyExc_KeyError, key);
+        return -1;
+    }
+    if (skipdict_score_from(PyTuple_GET_ITEM(item, 1), &score)) {
+        Read_Unlock(self);
+        return -1;
+    }
+    rank = slGetRank(self->skiplist, score, (void *) item);
+    Read_Unlock(self);
+    return (Py_ssize_t) rank - 1;
+}
+
+static Py_ssize_t
+skipdict_capi_count(PyObject *sd, double min, double max)
+{
+    SkipDictObject *self = (SkipDictObject *) sd;
+    skiplistNode *first, *last;
+    Py_ssize_t count = 0;
+
+    skipdict_read_lock(self);
+    first = slFirstInRange(self->skiplist, min, max);
+    if (first) {
+        last = slLastInRange(self->skiplist, min, max);
+        count = (Py_ssize_t) (
+            slGetRank(self->skiplist, last->score, last->obj) -
+            slGetRank(self->skiplist, first->score, first->obj) + 1);
+    }
+    Read_Unlock(self);
+    return count;
+}
+
+static int
+skipdict_capi_range(PyObject *sd, double min, double max,
+                    skipdict_visitfunc visit, void *arg)
+{
+    SkipDictObject *self = (SkipDictObject *) sd;
+    int forward = min <= max;
+    skiplistNode *node;
+    int result = 0;
+
+    if (!forward) {
+        double temp = min;
+        min = max;
+        max = temp;
+    }
+
+    skipdict_read_lock(self);
+    node = forward ? slFirstInRange(self->skiplist, min, max) : \
+        slLastInRange(self->skiplist, min, max);
+    while (node && node->score >= min && node->score <= max) {
+        result = visit(PyTuple_GET_ITEM(node->obj, 0), node->score, arg);
+        if (result) break;
+        node = forward ? node->level[0].forward : node->backward;
+    }
+    Read_Unlock(self);
+    return result;
+}
+
+static SkipDict_CAPI skipdict_capi = {
+    &SkipDictType,
+    skipdict_capi_lookup,
+    skipdict_capi_set,
+    skipdict_capi_change,
+    skipdict_capi_delete,
+    skipdict_capi_rank,
+    skipdict_capi_count,
+    skipdict_capi_range,
 };
 
 static PyMethodDef methods[] = {
@@ -990,8 +2814,28 @@ initskipdict(void)
     if (module == NULL)
         INITERROR;
 
+#ifdef Py_GIL_DISABLED
+    PyUnstable_Module_SetGIL(module, Py_MOD_GIL_NOT_USED);
+#endif
+
     PyType_Prepare(module, "SkipDict", &SkipDictType);
     PyType_Prepare(module, "SkipDictIterator", &SkipDictIterType);
+    PyType_Prepare(module, "Int64SkipDict", &Int64SkipDictType);
+    PyType_Prepare(module, "Int64SkipDictIterator",
+                   &Int64SkipDictIterType);
+    PyType_Prepare(module, "PairSkipDict", &PairSkipDictType);
+    PyType_Prepare(module, "PairSkipDictIterator", &PairSkipDictIterType);
+    PyType_Prepare(module, "ShardedSkipDict", &ShardedSkipDictType);
+    PyType_Prepare(module, "ShardedSkipDictIterator",
+                   &ShardedSkipDictIterType);
+    PyType_Prepare(module, "SharedSkipDict", &SharedSkipDictType);
+    PyType_Prepare(module, "MultiSkipDict", &MultiSkipDictType);
+
+    PyObject *capsule = PyCapsule_New(&skipdict_capi,
+                                      SKIPDICT_CAPSULE_NAME, NULL);
+    if (capsule == NULL)
+        INITERROR;
+    PyModule_AddObject(module, "skipdict_CAPI", capsule);
 
 #if PY_MAJOR_VERSION >= 3
     return module;
@@ -0,0 +1,78 @@
+#ifndef SKIPDICT_H
+#define SKIPDICT_H
+
+/* C API for other extension modules, exported through a capsule in the
+ * same way as the datetime C API:
+ *
+ *     #include "skipdict.h"
+ *
+ *     if (SkipDict_IMPORT == NULL) return NULL;   (in module init)
+ *
+ *     SkipDictAPI->Change(sd, key, 1.0, &score);
+ *
+ * The functions take a SkipDict (the default "double" score type) and
+ * skip argument parsing, boxing of the arguments and method dispatch;
+ * use SkipDict_Check() first if the type is not known. They must be
+ * called with the GIL held (or an attached thread state on
+ * free-threaded builds) and take the skip dict's lock themselves. On
+ * error they return -1 with an exception set. */
+
+#include <Python.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SKIPDICT_CAPSULE_NAME "skipdict.skipdict_CAPI"
+
+/* Called for each entry by Range(). A non-zero return value stops the
+ * traversal and is returned by Range(); -1 must set an exception. The
+ * skip dict is locked for reading and must not be modified. */
+typedef int (*skipdict_visitfunc)(PyObject *key, double score, void *arg);
+
+typedef struct {
+    PyTypeObject *SkipDictType;
+
+    /* Returns 1 and sets *score if the key is present, 0 if not. */
+    int (*Lookup)(PyObject *sd, PyObject *key, double *score);
+
+    /* Sets the score of the key. Returns 0. */
+    int (*Set)(PyObject *sd, PyObject *key, double score);
+
+    /* Adds delta to the score of the key (inserting it with a score of
+     * delta if missing) and stores the result in *score unless NULL.
+     * Returns 0. */
+    int (*Change)(PyObject *sd, PyObject *key, double delta,
+                  double *score);
+
+    /* Removes the key. Returns 1 if it was present, 0 if not. */
+    int (*Delete)(PyObject *sd, PyObject *key);
+
+    /* The 0-based rank of the key, or -1 with KeyError set. */
+    Py_ssize_t (*Rank)(PyObject *sd, PyObject *key);
+
+    /* The number of entries with min <= score <= max. */
+    Py_ssize_t (*Count)(PyObject *sd, double min, double max);
+
+    /* Calls visit for each entry with a score between min and max, in
+     * descending order if max < min. Returns 0 when done. */
+    int (*Range)(PyObject *sd, double min, double max,
+                 skipdict_visitfunc visit, void *arg);
+} SkipDict_CAPI;
+
+#ifndef SKIPDICT_MODULE
+static SkipDict_CAPI *SkipDictAPI = NULL;
+
+#define SkipDict_Check(op) \
+    PyObject_TypeCheck(op, SkipDictAPI->SkipDictType)
+
+#define SkipDict_IMPORT \
+    (SkipDictAPI = (SkipDict_CAPI *) PyCapsule_Import( \
+        SKIPDICT_CAPSULE_NAME, 0))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
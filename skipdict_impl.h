@@ -0,0 +1,2777 @@
+/* Python types for one score type of the skiplist core; included once per
+   score type by skipdict.c. The includer defines SL_SUFFIX, SD_SCORE,
+   SD_NAME and SD_SCORE_TYPE along with the name macros SD(), SDI() and
+   SDT(), and the score conversions SD(score_from), SD(score_to),
+   SD(score_add) and SD(score_str), SD(score_scale) and
+   SD(score_aggregate) for union() and intersection(), and
+   SD(score_distance) for nearest(). */
+
+typedef struct {
+    PyObject_HEAD
+    SLT(skiplist) *skiplist;
+    PyObject *random;
+    PyObject *mapping;
+    unsigned long version;
+    double p;
+    int maxlevel;
+    int adaptive;
+    double autorebalance;
+    unsigned long churn;
+    skiplist *expiry;
+    PyObject *deadlines;
+    uint64_t rng;
+    double lazydelete;
+    SLT(slEntry) *dead;         /* deleted lazily, holding the records */
+    unsigned long ndead;
+    unsigned long deadsize;
+    PyObject *dropped;          /* released after the write lock */
+#ifdef Py_GIL_DISABLED
+    pthread_rwlock_t lock;
+#endif
+} SDT(Object);
+
+typedef struct {
+    PyObject_HEAD
+    SDT(Object) *skipdict;
+    SLT(skiplistiter) *iter;
+    itertype type;
+    unsigned long length;       /* entries left */
+    unsigned long rank;         /* of the current node */
+    Py_ssize_t step;            /* in ranks, negative going backward */
+    Py_ssize_t batch;           /* entries per list, or 0 for one each */
+    unsigned long version;
+} SDT(IterObject);
+
+
+typedef PyObject * (*SD(iterfunc))(SD_SCORE score, PyObject*);
+
+static PyObject * SDI(next_key)(SD_SCORE score, PyObject* value);
+static PyObject * SDI(next_value)(SD_SCORE score, PyObject* value);
+static PyObject * SDI(next_item)(SD_SCORE score, PyObject* value);
+
+static SD(iterfunc) SD(iterators)[3] = { SDI(next_key),
+                                 SDI(next_value),
+                                 SDI(next_item) };
+
+static void SD(read_lock)(SDT(Object) *self);
+
+static PyObject *
+SD(index)(SDT(Object) *self, PyObject *key)
+{
+    PyObject *item;
+    SD_SCORE score;
+    unsigned long rank = 0;
+    int err;
+
+    if (skipdict_lookup(self->mapping, key, &item)) return NULL;
+    if (item) {
+        SD(read_lock)(self);
+        err = SD(score_from)(PyTuple_GET_ITEM(item, 1), &score);
+        if (!err) {
+            rank = SL(GetRank)(self->skiplist, score, (void*) item);
+        }
+        Read_Unlock(self);
+        Py_DECREF(item);
+        if (err) return NULL;
+    }
+    /* The record may have been deleted since the lookup. */
+    if (!rank) {
+        PyErr_SetObject(PyExc_KeyError,
+                        PyObject_Repr(key));
+        return NULL;
+    }
+
+    return PyLong_FromLong(rank - 1);
+}
+
+/* The (key, score, index) tuple of the entry at the node of the given
+   1-based rank. */
+static PyObject *
+SD(neighbour)(SLT(skiplistNode) *x, unsigned long rank)
+{
+    PyObject *item = (PyObject *) x->obj;
+
+    return Py_BuildValue("(ONk)", PyTuple_GET_ITEM(item, 0),
+                         SD(score_to)(x->score), rank - 1);
+}
+
+static PyObject *
+SD(bound)(SDT(Object) *self, PyObject *value, int ceiling)
+{
+    SLT(skiplistNode) *x;
+    unsigned long rank;
+    SD_SCORE score;
+    PyObject *result;
+
+    if (SD(score_from)(value, &score)) return NULL;
+
+    SD(read_lock)(self);
+    x = ceiling ? SL(Ceiling)(self->skiplist, score, &rank)
+                : SL(Floor)(self->skiplist, score, &rank);
+    if (x) {
+        result = SD(neighbour)(x, rank);
+    } else {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    }
+    Read_Unlock(self);
+    return result;
+}
+
+static PyObject *
+SD(floor)(SDT(Object) *self, PyObject *value)
+{
+    return SD(bound)(self, value, 0);
+}
+
+static PyObject *
+SD(ceiling)(SDT(Object) *self, PyObject *value)
+{
+    return SD(bound)(self, value, 1);
+}
+
+/* The k entries nearest to a score, nearest first (the lower score
+   first at equal distance). One descent finds the ceiling, and the
+   search walks outward from there on both sides. */
+static PyObject *
+SD(nearest)(SDT(Object) *self, PyObject *args)
+{
+    SLT(skiplist) *sl = self->skiplist;
+    SLT(skiplistNode) *left, *right;
+    unsigned long lrank, rrank;
+    PyObject *value, *result, *entry;
+    Py_ssize_t k, i;
+    SD_SCORE score;
+
+    if (!PyArg_ParseTuple(args, "On:nearest", &value, &k))
+        return NULL;
+    if (k < 0) {
+        PyErr_SetString(PyExc_ValueError, "k is negative");
+        return NULL;
+    }
+    if (SD(score_from)(value, &score)) return NULL;
+
+    SD(read_lock)(self);
+    if ((unsigned long) k > SL(Length)(sl)) k = (Py_ssize_t) SL(Length)(sl);
+    if (!(result = PyList_New(k))) {
+        Read_Unlock(self);
+        return NULL;
+    }
+    right = SL(Ceiling)(sl, score, &rrank);
+    if (right) {
+        left = right->backward;
+        lrank = rrank - 1;
+    } else {
+        left = sl->tail;
+        lrank = SL(Length)(sl);
+    }
+
+    for (i = 0; i < k; i++) {
+        if (!right || (left && SD(score_distance)(left->score, score) <=
+                               SD(score_distance)(right->score, score))) {
+            entry = SD(neighbour)(left, lrank--);
+            left = left->backward;
+        } else {
+            entry = SD(neighbour)(right, rrank++);
+            right = right->level[0].forward;
+        }
+        if (!entry) {
+            Read_Unlock(self);
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, entry);
+    }
+    Read_Unlock(self);
+    return result;
+}
+
+/* The ranks of several keys, found using the batched (interleaved)
+   lookup of the skiplist. */
+static PyObject *
+SD(index_many)(SDT(Object) *self, PyObject *keys)
+{
+    PyObject *seq, *item, *result = NULL;
+    SD_SCORE *scores = NULL;
+    void **objs = NULL;
+    unsigned long *ranks = NULL;
+    Py_ssize_t i, n;
+
+    seq = PySequence_Fast(keys, "index_many() argument must be iterable");
+    if (!seq) return NULL;
+
+    n = PySequence_Fast_GET_SIZE(seq);
+    scores = PyMem_Malloc((n ? n : 1) * sizeof(SD_SCORE));
+    objs = PyMem_Malloc((n ? n : 1) * sizeof(void *));
+    ranks = PyMem_Malloc((n ? n : 1) * sizeof(unsigned long));
+    if (!scores || !objs || !ranks) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    SD(read_lock)(self);
+    for (i = 0; i < n; i++) {
+        PyObject *key = PySequence_Fast_GET_ITEM(seq, i);
+        item = PyDict_GetItem(self->mapping, key);
+        if (!item) {
+            Read_Unlock(self);
+            PyErr_SetObject(PyExc_KeyError, key);
+            goto done;
+        }
+        if (SD(score_from)(PyTuple_GET_ITEM(item, 1), &scores[i])) {
+            Read_Unlock(self);
+            goto done;
+        }
+        objs[i] = (void *) item;
+    }
+    SL(GetRankMany)(self->skiplist, scores, objs, (unsigned long) n, ranks);
+    Read_Unlock(self);
+
+    result = PyList_New(n);
+    if (!result) goto done;
+    for (i = 0; i < n; i++) {
+        item = PyLong_FromLong(ranks[i] - 1);
+        if (!item) {
+            Py_CLEAR(result);
+            goto done;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+done:
+    PyMem_Free(ranks);
+    PyMem_Free(objs);
+    PyMem_Free(scores);
+    Py_DECREF(seq);
+    return result;
+}
+
+/* Iterators hold on to skiplist nodes; those may be freed (or moved)
+   when the skip dict is mutated, which is detected using the version
+   counter. */
+static int
+SDI(check)(SDT(IterObject) *it)
+{
+    if (it->version != it->skipdict->version) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "skipdict mutated during iteration");
+        return -1;
+    }
+    return 0;
+}
+
+/* Fetches the current entry and moves on by the step: along the links
+   one node at a time, and otherwise by rank. */
+static int
+SDI(fetch)(SDT(IterObject) *it, SD_SCORE *score, PyObject **obj)
+{
+    SLT(skiplist) *sl = it->skipdict->skiplist;
+    PyObject* item;
+    if (!it->length || SL(IterGet)(it->iter, score, (void*) &item)) {
+        PyErr_SetString(PyExc_StopIteration, "");
+        return -1;
+    }
+
+    it->length--;
+    it->rank += it->step;
+    if (it->step == 1 || it->step == -1) {
+        if (SL(IterNext)(it->iter)) {
+            PyErr_SetString(PyExc_TypeError,
+                            "unable to advance the internal iterator");
+            return -1;
+        }
+    } else {
+        it->iter->node = !it->length ? NULL :
+            SL(GetNodeByRank)(sl->header, sl->level - 1, it->rank);
+    }
+
+    *obj = PyTuple_GET_ITEM(item, 0);
+    return 0;
+}
+
+/* Fetches the next batch of entries into a list, taking the lock and
+   checking the version once for the whole batch. The keys are gathered
+   under the lock; values and items are made once it is released. */
+static PyObject *
+SDI(next_batch)(SDT(IterObject) *it)
+{
+    Py_ssize_t i, n = it->batch;
+    SD_SCORE *scores;
+    PyObject *list, *key, *value, *result;
+    int err;
+
+    if ((unsigned long) n > it->length) {
+        n = (Py_ssize_t) it->length;
+    }
+    list = PyList_New(n);
+    scores = PyMem_New(SD_SCORE, n ? n : 1);
+    if (!list || !scores) {
+        Py_XDECREF(list);
+        PyMem_Free(scores);
+        return PyErr_NoMemory();
+    }
+
+    Read_Lock(it->skipdict);
+    err = SDI(check)(it);
+    for (i = 0; !err && i < n; i++) {
+        if (SDI(fetch)(it, &scores[i], &key)) {
+            break;
+        }
+        Py_INCREF(key);
+        PyList_SET_ITEM(list, i, key);
+    }
+    Read_Unlock(it->skipdict);
+
+    if (i < n && !err && PyErr_ExceptionMatches(PyExc_StopIteration)) {
+        PyErr_Clear();
+        err = PyList_SetSlice(list, i, n, NULL);
+        n = i;
+    }
+    if (err || i < n || !n) {
+        Py_DECREF(list);
+        PyMem_Free(scores);
+        return NULL;
+    }
+
+    /* The list's reference to each key moves to its item. */
+    for (i = 0; it->type != KEY && i < n; i++) {
+        key = PyList_GET_ITEM(list, i);
+        value = SD(score_to)(scores[i]);
+        result = value && it->type == ITEM ? PyTuple_New(2) : value;
+        if (!result) {
+            Py_XDECREF(value);
+            Py_DECREF(list);
+            PyMem_Free(scores);
+            return NULL;
+        }
+        if (it->type == ITEM) {
+            PyTuple_SET_ITEM(result, 0, key);
+            PyTuple_SET_ITEM(result, 1, value);
+        } else {
+            Py_DECREF(key);
+        }
+        PyList_SET_ITEM(list, i, result);
+    }
+    PyMem_Free(scores);
+    return list;
+}
+
+static PyObject *
+SDI(next)(SDT(IterObject) *it)
+{
+    SD_SCORE score;
+    PyObject *key;
+
+    if (it->batch) {
+        return SDI(next_batch)(it);
+    }
+
+    Read_Lock(it->skipdict);
+    int err = SDI(check)(it) || \
+        SDI(fetch)(it, &score, &key);
+    if (!err) Py_INCREF(key);
+    Read_Unlock(it->skipdict);
+    if (err) {
+        return NULL;
+    }
+
+    PyObject *result = SD(iterators)[it->type](score, key);
+    Py_DECREF(key);
+    return result;
+}
+
+static PyObject *
+SDI(next_key)(SD_SCORE score, PyObject* key)
+{
+    Py_INCREF(key);
+    return key;
+}
+
+static PyObject *
+SDI(next_value)(SD_SCORE score, PyObject* key)
+{
+    return SD(score_to)(score);
+}
+
+static PyObject *
+SDI(next_item)(SD_SCORE score, PyObject* key)
+{
+    return Py_BuildValue("(ON)", key, SD(score_to)(score));
+}
+
+static void
+SDI(dealloc)(SDT(IterObject) *it)
+{
+    PyObject_GC_UnTrack(it);
+    SL(IterDel)(it->iter);
+    Py_XDECREF(it->skipdict);
+    PyObject_GC_Del(it);
+}
+
+static int
+SDI(traverse)(SDT(IterObject) *it, visitproc visit, void *arg)
+{
+    Py_VISIT(it->skipdict);
+    return 0;
+}
+
+/* In adaptive mode, the header has as many levels as the given length
+   needs, up to maxlevel. It shrinks only once two levels are spare, so
+   that a length going back and forth does not resize it each time. */
+static int
+SD(adapt)(SDT(Object) *self, unsigned long length)
+{
+    SLT(skiplist) *sl = self->skiplist;
+    int levels = slLevelsFor(length, self->p, self->maxlevel);
+
+    if (levels > sl->maxlevel || levels < sl->maxlevel - 1) {
+        if (SL(Resize)(sl, levels)) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Counts a node linked or unlinked, rebalancing the list once their
+   number reaches auto_rebalance times the length. Moving the nodes
+   invalidates iterators. */
+static void
+SD(churned)(SDT(Object) *self)
+{
+    self->churn++;
+    if (self->autorebalance > 0 &&
+        self->churn >= self->autorebalance * SL(Length)(self->skiplist) &&
+        !SL(Rebalance)(self->skiplist, self->p)) {
+        self->version++;
+        self->churn = 0;
+    }
+}
+
+/* Keeps a record until the write lock is released, as dropping its
+   last reference runs the destructors of the key and score. Without
+   the memory for it, the record goes at once. */
+static void
+SD(drop)(SDT(Object) *self, PyObject *item)
+{
+    PyObject *type, *value, *traceback;
+
+    PyErr_Fetch(&type, &value, &traceback);
+    if (!self->dropped) self->dropped = PyList_New(0);
+    if (!self->dropped || PyList_Append(self->dropped, item)) PyErr_Clear();
+    PyErr_Restore(type, value, traceback);
+}
+
+static void
+SD(write_unlock)(SDT(Object) *self)
+{
+    PyObject *dropped = self->dropped;
+
+    self->dropped = NULL;
+    Write_Unlock(self);
+    Py_XDECREF(dropped);
+}
+
+/* Lazy deletes. With lazy_delete set, a deleted entry is only dropped
+   from the mapping; its node stays linked, with the record kept alive
+   by the list of dead entries. These are unlinked together in one
+   sweep once they reach the given fraction of the live entries, or
+   before anything else walks the skiplist. */
+static void
+SD(compact)(SDT(Object) *self)
+{
+    unsigned long i, n = self->ndead;
+
+    if (!n) return;
+    SL(DeleteMany)(self->skiplist, self->dead, n);
+    self->ndead = 0;
+    self->version++;
+    if (self->adaptive) SD(adapt)(self, SL(Length)(self->skiplist));
+    for (i = 0; i < n; i++) {
+        SD(drop)(self, (PyObject *) self->dead[i].obj);
+        Py_DECREF((PyObject *) self->dead[i].obj);
+    }
+}
+
+static int
+SD(bury)(SDT(Object) *self, SD_SCORE score, PyObject *item)
+{
+    SLT(slEntry) *dead = self->dead;
+    unsigned long size = self->deadsize;
+
+    if (self->ndead == size) {
+        size = size ? 2 * size : 64;
+        dead = PyMem_Realloc(dead, size * sizeof(SLT(slEntry)));
+        if (!dead) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->dead = dead;
+        self->deadsize = size;
+    }
+    Py_INCREF(item);
+    dead[self->ndead].score = score;
+    dead[self->ndead++].obj = item;
+    if (self->ndead >= self->lazydelete *
+        (SL(Length)(self->skiplist) - self->ndead)) {
+        SD(compact)(self);
+    }
+    return 0;
+}
+
+/* Takes the read lock for a walk over the skiplist, which must not see
+   the entries deleted lazily. */
+static void
+SD(read_lock)(SDT(Object) *self)
+{
+    Read_Lock(self);
+    while (self->ndead) {
+        Read_Unlock(self);
+        Write_Lock(self);
+        SD(compact)(self);
+        SD(write_unlock)(self);
+        Read_Lock(self);
+    }
+}
+
+/* Per-key expiry. The deadlines map keys to (key, deadline) records,
+   which are also linked into a skip list ordered by deadline; both are
+   created when the first deadline is set. Expired entries are removed
+   by expire() and a few at a time by each mutation, so that they are
+   reclaimed at least as fast as new ones are added. */
+static int
+SD(forget)(SDT(Object) *self, PyObject *key, Py_hash_t hash)
+{
+    PyObject *entry;
+
+    if (!self->deadlines ||
+        !(entry = Dict_GetItemHash(self->deadlines, key, hash))) {
+        return PyErr_Occurred() ? -1 : 0;
+    }
+    slDelete(self->expiry, PyFloat_AS_DOUBLE(PyTuple_GET_ITEM(entry, 1)),
+             (void *) entry, NULL);
+    return Dict_DelItemHash(self->deadlines, key, hash);
+}
+
+static int
+SD(schedule)(SDT(Object) *self, PyObject *key, Py_hash_t hash,
+             double deadline)
+{
+    PyObject *entry;
+    int level = 1;
+
+    if (!self->deadlines && !(self->deadlines = PyDict_New())) {
+        return -1;
+    }
+    if (!self->expiry && !(self->expiry = slCreate(MAXLEVEL))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    if (SD(forget)(self, key, hash)) return -1;
+    entry = Py_BuildValue("(Od)", key, deadline);
+    if (!entry || Dict_SetItemHash(self->deadlines, key, entry, hash)) {
+        Py_XDECREF(entry);
+        return -1;
+    }
+    Py_DECREF(entry);
+
+    while ((random() & 0xffff) < (P * 0xffff) && level < MAXLEVEL)
+        level++;
+    if (!slInsert(self->expiry, deadline, (void *) entry, level)) {
+        Dict_DelItemHash(self->deadlines, key, hash);
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+static int
+SD(delitem)(SDT(Object) *self, PyObject *key, Py_hash_t hash, int delete)
+{
+    PyObject* item = Dict_GetItemHash(self->mapping, key, hash);
+    if (!item) goto Fail;
+    PyObject* value = PyTuple_GET_ITEM(item, 1);
+    SD_SCORE score;
+    if (SD(score_from)(value, &score)) return -1;
+
+    /* The mapping may hold the last reference to the item. */
+    if (self->lazydelete > 0) {
+        if (SD(bury)(self, score, item)) return -1;
+    } else if (!SL(Delete)(self->skiplist, score, (void*) item, NULL)) {
+        goto Fail;
+    }
+    self->version++;
+    if (self->adaptive && !self->ndead) {
+        SD(adapt)(self, SL(Length)(self->skiplist));
+    }
+    SD(churned)(self);
+    if (SD(forget)(self, key, hash)) return -1;
+    if (delete) {
+        SD(drop)(self, item);
+        return Dict_DelItemHash(self->mapping, key, hash);
+    }
+    return 0;
+ Fail:
+    if (!PyErr_Occurred()) PyErr_SetObject(PyExc_KeyError, key);
+    return -1;
+}
+
+/* Removes up to limit entries with a deadline at or before now,
+   returning the number removed, or -1 on error. */
+static Py_ssize_t
+SD(reap)(SDT(Object) *self, double now, Py_ssize_t limit)
+{
+    skiplistNode *x;
+    PyObject *key;
+    Py_hash_t hash;
+    Py_ssize_t removed = 0;
+    int err;
+
+    while (self->expiry && removed < limit &&
+           (x = self->expiry->header->level[0].forward) &&
+           x->score <= now) {
+        /* Deleting the entry drops the record holding the key. The
+           key of an expired entry is only known here, under the lock,
+           so it is hashed here too. */
+        key = PyTuple_GET_ITEM((PyObject *) x->obj, 0);
+        Py_INCREF(key);
+        hash = PyObject_Hash(key);
+        err = hash == -1 || SD(delitem)(self, key, hash, 1);
+        Py_DECREF(key);
+        if (err) return -1;
+        removed++;
+    }
+    return removed;
+}
+
+static int
+SD(tick)(SDT(Object) *self)
+{
+    if (!self->expiry || !slLength(self->expiry)) return 0;
+    return SD(reap)(self, skipdict_now(), REAP_STEP) < 0 ? -1 : 0;
+}
+
+/* The level of a new node from the custom random function, or 0
+   without one. As the function may run arbitrary code, it is called
+   before taking the write lock. Returns -1 on error. */
+static int
+SD(draw)(SDT(Object) *self)
+{
+    PyObject *result;
+    int level, maxlevel;
+
+    if (!self->random) return 0;
+    Read_Lock(self);
+    maxlevel = self->skiplist->maxlevel;
+    Read_Unlock(self);
+
+    result = PyObject_CallFunction(self->random, "i", maxlevel);
+    if (!result) return -1;
+    level = (int) PyInt_AsLong(result);
+    if (level == -1 && PyErr_Occurred()) {
+        PyErr_Format(PyExc_TypeError,
+                     "not an integer: %s",
+                     PyString_AsString(PyObject_Repr(result)));
+        Py_DECREF(result);
+        return -1;
+    }
+    Py_DECREF(result);
+    if (level > maxlevel) {
+        PyErr_Format(PyExc_ValueError,
+                     "level not in range (0-%d): %d",
+                     maxlevel, level);
+        return -1;
+    }
+    return level < 1 ? 1 : level;
+}
+
+/* Sets the entry of a key, given its hash and a level from SD(draw). */
+static int
+SD(insertobj)(SDT(Object) *self, PyObject *key, Py_hash_t hash,
+              PyObject *value, int mode, int level)
+{
+    PyObject *item, *previous, *sum = NULL;
+    SD_SCORE score, s;
+
+    if (SD(score_from)(value, &score)) {
+        return -1;
+    }
+
+    if (self->adaptive &&
+        SD(adapt)(self, SL(Length)(self->skiplist) + 1)) {
+        return -1;
+    }
+
+    if (mode > 0) {
+        if ((item = Dict_GetItemHash(self->mapping, key, hash))) {
+            previous = PyTuple_GET_ITEM(item, 1);
+            if (SD(score_from)(previous, &s)) return -1;
+
+            if (mode == 2) {
+                value = sum = SD(score_add)(value, previous);
+                if (!value || SD(score_from)(value, &score)) {
+                    Py_XDECREF(sum);
+                    return -1;
+                }
+            }
+
+            /* A record shared with a copy is replaced rather than
+               updated in place. */
+            switch (SL(Delete)(self->skiplist, s, (void*) item,
+                               Py_REFCNT(item) == 1 ? &score : NULL)) {
+                case 0:
+                    Py_XDECREF(sum);
+                    return -1;
+                case 1:
+                    self->version++;
+                    SD(drop)(self, item);
+                    break;
+                case 2:
+                    Py_INCREF(value);
+                    PyTuple_SetItem(item, 1, value);
+                    Py_XDECREF(sum);
+                    return 0;
+            }
+        } else if (PyErr_Occurred()) {
+            return -1;
+        }
+    }
+
+    item = PyTuple_Pack(2, key, value);
+    Py_XDECREF(sum);
+    if (!item || Dict_SetItemHash(self->mapping, key, item, hash)) {
+        Py_XDECREF(item);
+        return -1;
+    }
+    Py_DECREF(item);
+
+    if (self->random) {
+        /* The skiplist may have shrunk since the draw. */
+        if (level > self->skiplist->maxlevel) {
+            level = self->skiplist->maxlevel;
+        }
+    } else {
+        level = 1;
+        while((random() & 0xffff) < (self->p * 0xffff))
+            level += 1;
+        level = (level < self->skiplist->maxlevel) \
+            ? level : self->skiplist->maxlevel;
+    }
+    if (!SL(Insert)(self->skiplist, score, (void*) item, level)) {
+        /* The key is gone, along with any node it had before. */
+        Dict_DelItemHash(self->mapping, key, hash);
+        PyErr_NoMemory();
+        return -1;
+    }
+    SD(churned)(self);
+    return 0;
+}
+
+/* Assignment replaces the entry, including any deadline. */
+static int
+SD(assign)(SDT(Object) *self, PyObject *key, Py_hash_t hash,
+           PyObject *value, int level)
+{
+    if (SD(tick)(self) ||
+        SD(insertobj)(self, key, hash, value, 1, level)) {
+        return -1;
+    }
+    return SD(forget)(self, key, hash);
+}
+
+static int
+SD(insertpair)(SDT(Object) *self, PyObject *key, PyObject *value)
+{
+    Py_hash_t hash;
+    int level;
+
+    if ((hash = PyObject_Hash(key)) == -1 ||
+        (level = SD(draw)(self)) < 0) {
+        return -1;
+    }
+    return SD(insertobj)(self, key, hash, value, 2, level);
+}
+
+static int
+SD(insertseq)(SDT(Object) *self, PyObject *seq)
+{
+    return skipdict_foreach(seq, (pairfunc) SD(insertpair), self);
+}
+
+/* Bulk loading first collects the entry records in the mapping
+   (summing duplicates as usual), and then sorts and links them in one
+   pass with the GIL released, splitting the work across threads for
+   large inputs. */
+static int
+SD(collectpair)(SDT(Object) *self, PyObject *key, PyObject *value)
+{
+    PyObject *item;
+    SD_SCORE score;
+    int err;
+
+    if (SD(score_from)(value, &score)) {
+        return -1;
+    }
+
+    if ((item = PyDict_GetItem(self->mapping, key))) {
+        value = SD(score_add)(value, PyTuple_GET_ITEM(item, 1));
+        if (!value) return -1;
+    } else {
+        Py_INCREF(value);
+    }
+
+    item = PyTuple_Pack(2, key, value);
+    Py_DECREF(value);
+    if (!item) return -1;
+    err = PyDict_SetItem(self->mapping, key, item);
+    Py_DECREF(item);
+    return err;
+}
+
+/* Links the entries, whose objects are the entry records in the
+   mapping, into the empty skiplist with the GIL released. */
+static int
+SD(link)(SDT(Object) *self, SLT(slEntry) *entries, unsigned long n,
+         int threads)
+{
+    unsigned long seed;
+    int err;
+
+    if (threads <= 0) {
+        threads = skipdict_bulkthreads(n);
+    }
+    if (self->adaptive && SD(adapt)(self, n)) {
+        return -1;
+    }
+    seed = (unsigned long) random();
+
+    Py_BEGIN_ALLOW_THREADS
+    err = SL(BulkLoad)(self->skiplist, entries, n, self->p, seed, threads);
+    Py_END_ALLOW_THREADS
+
+    if (err) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+/* The entries of the records collected in the mapping, to be linked
+   into the empty skiplist. The array is NULL if there are none. */
+static int
+SD(entries)(SDT(Object) *self, SLT(slEntry) **entries, unsigned long *n)
+{
+    Py_ssize_t pos = 0;
+    PyObject *key, *item;
+    unsigned long i = 0;
+
+    *entries = NULL;
+    *n = (unsigned long) PyDict_Size(self->mapping);
+    if (!*n) return 0;
+
+    *entries = PyMem_Malloc(*n * sizeof(SLT(slEntry)));
+    if (!*entries) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    while (PyDict_Next(self->mapping, &pos, &key, &item)) {
+        if (SD(score_from)(PyTuple_GET_ITEM(item, 1), &(*entries)[i].score)) {
+            PyMem_Free(*entries);
+            *entries = NULL;
+            return -1;
+        }
+        (*entries)[i].obj = (void *) item;
+        i++;
+    }
+    return 0;
+}
+
+static int
+SD(bulkload)(SDT(Object) *self, PyObject *seq, int threads)
+{
+    SLT(slEntry) *entries;
+    unsigned long n;
+    int err;
+
+    if (skipdict_foreach(seq, (pairfunc) SD(collectpair), self) ||
+        SD(entries)(self, &entries, &n)) {
+        return -1;
+    }
+    if (!n) return 0;
+
+    err = SD(link)(self, entries, n, threads);
+    PyMem_Free(entries);
+    return err;
+}
+
+/* The scaled score of a key in the given skip dict. */
+static int
+SD(weighted_score)(PyObject *item, const double *weights, Py_ssize_t i,
+                   SD_SCORE *score)
+{
+    if (SD(score_from)(PyTuple_GET_ITEM(item, 1), score)) return -1;
+    return weights ? SD(score_scale)(score, weights[i]) : 0;
+}
+
+/* union() and intersection() of self and the skip dicts in args. The
+   keys are joined through the key index of each skip dict, and their
+   scores aggregated into an array of entries, which is then sorted and
+   linked in one pass into a new skip dict. */
+static PyObject *
+SD(combine)(SDT(Object) *self, PyObject *args, PyObject *kw, int intersect)
+{
+    static char *kwlist[] = {"aggregate", "weights", NULL};
+    PyObject *aggregateobj = NULL, *weightsobj = Py_None, *empty, *fast;
+    PyObject *key, *item, *value;
+    SDT(Object) *result = NULL, *input, **inputs = NULL;
+    SLT(slEntry) *entries = NULL;
+    double *weights = NULL;
+    char *live = NULL;
+    Py_ssize_t count = PyTuple_GET_SIZE(args) + 1, i, j, n = 0, m, size;
+    Py_ssize_t pos, smallest = 0;
+    SD_SCORE score;
+    int aggregate = AGGREGATE_SUM, err = -1;
+
+    if (!(empty = PyTuple_New(0))) return NULL;
+    i = PyArg_ParseTupleAndKeywords(empty, kw, "|OO", kwlist,
+                                    &aggregateobj, &weightsobj);
+    Py_DECREF(empty);
+    if (!i) return NULL;
+    if (aggregateobj && (aggregate = skipdict_aggregate(aggregateobj)) < 0)
+        return NULL;
+
+    inputs = PyMem_Malloc(count * sizeof(*inputs));
+    if (!inputs) return PyErr_NoMemory();
+    inputs[0] = self;
+    for (i = 1; i < count; i++) {
+        inputs[i] = (SDT(Object) *) PyTuple_GET_ITEM(args, i - 1);
+        if (!PyObject_TypeCheck((PyObject *) inputs[i], &SDT(Type))) {
+            PyErr_SetString(PyExc_TypeError,
+                            "arguments must be " SD_NAME " instances");
+            goto done;
+        }
+    }
+
+    if (weightsobj != Py_None) {
+        fast = PySequence_Fast(weightsobj, "weights must be a sequence");
+        if (!fast) goto done;
+        if (PySequence_Fast_GET_SIZE(fast) != count) {
+            Py_DECREF(fast);
+            PyErr_SetString(PyExc_ValueError,
+                            "weights must have one number per skip dict");
+            goto done;
+        }
+        weights = PyMem_Malloc(count * sizeof(double));
+        for (i = 0; weights && i < count; i++) {
+            weights[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(fast, i));
+            if (weights[i] == -1.0 && PyErr_Occurred()) break;
+        }
+        Py_DECREF(fast);
+        if (!weights) {
+            PyErr_NoMemory();
+            goto done;
+        }
+        if (i < count) goto done;
+    }
+
+    /* A union has up to as many keys as all the skip dicts together,
+       an intersection no more than the smallest one. */
+    size = 0;
+    for (i = 0; i < count; i++) {
+        Py_ssize_t length = PyDict_Size(inputs[i]->mapping);
+        if (!intersect) size += length;
+        else if (length < PyDict_Size(inputs[smallest]->mapping))
+            smallest = i;
+    }
+    if (intersect) size = PyDict_Size(inputs[smallest]->mapping);
+
+    result = (SDT(Object) *) PyObject_CallObject((PyObject *) Py_TYPE(self),
+                                                 NULL);
+    if (!result) goto done;
+    entries = PyMem_Malloc((size ? size : 1) * sizeof(SLT(slEntry)));
+    live = PyMem_Malloc(size ? size : 1);
+    if (!entries || !live) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    if (!intersect) {
+        /* The result's mapping holds the index of each key's entry
+           until the entry records are made. */
+        for (i = 0; i < count; i++) {
+            input = inputs[i];
+            Read_Lock(input);
+            pos = 0;
+            while (PyDict_Next(input->mapping, &pos, &key, &item)) {
+                if (SD(weighted_score)(item, weights, i, &score)) {
+                    Read_Unlock(input);
+                    goto done;
+                }
+                value = PyDict_GetItem(result->mapping, key);
+                if (value) {
+                    j = PyNumber_AsSsize_t(value, NULL);
+                    if (SD(score_aggregate)(&entries[j].score, score,
+                                            aggregate)) {
+                        Read_Unlock(input);
+                        goto done;
+                    }
+                    continue;
+                }
+                value = PyInt_FromSsize_t(n);
+                if (!value || PyDict_SetItem(result->mapping, key, value)) {
+                    Py_XDECREF(value);
+                    Read_Unlock(input);
+                    goto done;
+                }
+                Py_DECREF(value);
+                entries[n].score = score;
+                entries[n].obj = (void *) key;
+                live[n++] = 1;
+            }
+            Read_Unlock(input);
+        }
+    } else if (count) {
+        input = inputs[smallest];
+        Read_Lock(input);
+        pos = 0;
+        while (PyDict_Next(input->mapping, &pos, &key, &item)) {
+            if (SD(weighted_score)(item, weights, smallest, &score)) {
+                Read_Unlock(input);
+                goto done;
+            }
+            Py_INCREF(key);
+            entries[n].score = score;
+            entries[n].obj = (void *) key;
+            live[n++] = 1;
+        }
+        Read_Unlock(input);
+
+        for (i = 0; i < count; i++) {
+            if (i == smallest) continue;
+            input = inputs[i];
+            Read_Lock(input);
+            for (j = 0; j < n; j++) {
+                if (!live[j]) continue;
+                item = PyDict_GetItem(input->mapping, (PyObject *) entries[j].obj);
+                if (!item) {
+                    live[j] = 0;
+                    continue;
+                }
+                if (SD(weighted_score)(item, weights, i, &score)) {
+                    Read_Unlock(input);
+                    goto done;
+                }
+                if (SD(score_aggregate)(&entries[j].score, score,
+                                        aggregate)) {
+                    Read_Unlock(input);
+                    goto done;
+                }
+            }
+            Read_Unlock(input);
+        }
+    }
+
+    /* Replace the keys with entry records, in place. */
+    for (j = m = 0; j < n; j++) {
+        if (!live[j]) continue;
+        key = (PyObject *) entries[j].obj;
+        value = SD(score_to)(entries[j].score);
+        item = value ? PyTuple_Pack(2, key, value) : NULL;
+        Py_XDECREF(value);
+        if (!item || PyDict_SetItem(result->mapping, key, item)) {
+            Py_XDECREF(item);
+            goto done;
+        }
+        Py_DECREF(item);
+        entries[m].score = entries[j].score;
+        entries[m++].obj = (void *) item;
+        /* The entry record holds on to the key now. */
+        if (intersect) {
+            Py_DECREF(key);
+            live[j] = 0;
+        }
+    }
+    n = m;
+    if (n && SD(link)(result, entries, (unsigned long) n, 0)) {
+        n = 0;
+        goto done;
+    }
+    n = 0;
+    err = 0;
+
+done:
+    if (intersect) {
+        /* Keys collected but not (yet) in the result. */
+        for (j = 0; j < n; j++)
+            if (live[j]) Py_DECREF((PyObject *) entries[j].obj);
+    }
+    PyMem_Free(live);
+    PyMem_Free(entries);
+    PyMem_Free(weights);
+    PyMem_Free(inputs);
+    if (err) {
+        Py_XDECREF(result);
+        return NULL;
+    }
+    return (PyObject *) result;
+}
+
+static PyObject *
+SD(union)(SDT(Object) *self, PyObject *args, PyObject *kw)
+{
+    return SD(combine)(self, args, kw, 0);
+}
+
+static PyObject *
+SD(intersection)(SDT(Object) *self, PyObject *args, PyObject *kw)
+{
+    return SD(combine)(self, args, kw, 1);
+}
+
+static PyObject *
+SD(change)(SDT(Object) *self, PyObject *args)
+{
+    PyObject *key, *change;
+    Py_hash_t hash;
+    int level;
+
+    if (!PyArg_ParseTuple(args, "OO:change", &key, &change)) {
+        return NULL;
+    }
+    if ((hash = PyObject_Hash(key)) == -1 ||
+        (level = SD(draw)(self)) < 0) {
+        return NULL;
+    }
+
+    Write_Lock(self);
+    int err = SD(tick)(self) ||
+        SD(insertobj)(self, key, hash, change, 2, level);
+    SD(write_unlock)(self);
+    if (err) return NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static int
+SD(setup)(SDT(Object) *self, int maxlevel, double p, int adaptive,
+               double autorebalance, PyObject *rnd, PyObject *seq,
+               int threads)
+{
+    int err = 0;
+    self->random = rnd;
+    Py_XINCREF(rnd);
+    self->mapping = NULL;
+    self->skiplist = NULL;
+    self->version = 0;
+    self->p = p;
+    self->maxlevel = maxlevel;
+    self->adaptive = adaptive;
+    self->autorebalance = autorebalance;
+    self->churn = 0;
+    self->expiry = NULL;
+    self->deadlines = NULL;
+    self->lazydelete = 0.0;
+    self->dead = NULL;
+    self->ndead = self->deadsize = 0;
+    self->dropped = NULL;
+    self->rng = ((uint64_t) random() << 32) ^ (uint64_t) random();
+#ifdef Py_GIL_DISABLED
+    pthread_rwlock_init(&self->lock, NULL);
+#endif
+    self->skiplist = SL(Create)(adaptive ? slLevelsFor(0, p, maxlevel)
+                                         : maxlevel);
+    if (!self->skiplist) {
+        return -1;
+    }
+
+    self->mapping = PyDict_New();
+
+    if (seq) {
+        /* A custom random function is called for each insert. */
+        if (rnd) {
+            err = SD(insertseq)(self, seq);
+        } else {
+            err = SD(bulkload)(self, seq, threads);
+        }
+        if (err) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+SD(init)(SDT(Object) *self, PyObject *args, PyObject *kw)
+{
+    int maxlevel = MAXLEVEL;
+    int threads = 0;
+    int adaptive = 0;
+    double p = P;
+    double autorebalance = 0.0;
+    double lazydelete = 0.0;
+    PyObject *rnd = NULL;
+    PyObject *seq = NULL;
+    PyObject *scoretype = NULL;
+    static char *kwlist[] = {
+        "sequence", "maxlevel", "random", "threads", "score_type", "p",
+        "adaptive", "auto_rebalance", "lazy_delete", NULL
+    };
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|OiOiOdidd:SkipDict", kwlist,
+                                     &seq, &maxlevel, &rnd, &threads,
+                                     &scoretype, &p, &adaptive,
+                                     &autorebalance, &lazydelete)) {
+        return -1;
+    }
+    if (autorebalance < 0) {
+        PyErr_SetString(PyExc_ValueError, "auto_rebalance is negative");
+        return -1;
+    }
+    if (lazydelete < 0) {
+        PyErr_SetString(PyExc_ValueError, "lazy_delete is negative");
+        return -1;
+    }
+    if (!(p > 0.0 && p < 1.0)) {
+        PyErr_SetString(PyExc_ValueError, "p not in range (0-1)");
+        return -1;
+    }
+    if (rnd == Py_None) {
+        rnd = NULL;
+    }
+    if (scoretype && scoretype != Py_None &&
+        skipdict_scoretype(scoretype) != &SDT(Type)) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(PyExc_ValueError,
+                            "score_type does not match the skip dict type");
+        }
+        return -1;
+    }
+    if (SD(setup)(self, maxlevel, p, adaptive, autorebalance, rnd, seq,
+                  threads)) {
+        return -1;
+    }
+    self->lazydelete = lazydelete;
+    return 0;
+}
+
+static void
+SD(dealloc)(SDT(Object)* self)
+{
+    /* The skiplist is missing if initialization failed. */
+    if (self->skiplist) {
+        SL(Free)(self->skiplist);
+    }
+    while (self->ndead) {
+        PyObject *item = self->dead[--self->ndead].obj;
+        Py_DECREF(item);
+    }
+    PyMem_Free(self->dead);
+    if (self->expiry) {
+        slFree(self->expiry);
+    }
+    Py_XDECREF(self->deadlines);
+    if (self->mapping) {
+        PyDict_Clear(self->mapping);
+        Py_DECREF(self->mapping);
+    }
+    Py_XDECREF(self->random);
+    Py_XDECREF(self->dropped);
+#ifdef Py_GIL_DISABLED
+    pthread_rwlock_destroy(&self->lock);
+#endif
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/* An iterator over length entries, from the node of the skiplist
+   iterator at the given rank on, step ranks apart. Without a skiplist
+   iterator, it goes over the whole skip dict. */
+static PyObject *
+SD(iterator)(SDT(Object) *self, SLT(skiplistiter) *iter, itertype type,
+             unsigned long rank, unsigned long length, Py_ssize_t step)
+{
+    SDT(IterObject) *it = NULL;
+    if (!PyObject_TypeCheck(self, &SDT(Type))) {
+        PyErr_BadInternalCall();
+        return NULL;
+    }
+
+    SD(read_lock)(self);
+    if (!iter) {
+        iter = SL(IterNewFromHead)(self->skiplist);
+        rank = 1;
+        length = SL(Length)(self->skiplist);
+        step = 1;
+    }
+    unsigned long version = self->version;
+    Read_Unlock(self);
+
+    if (!iter) {
+        return NULL;
+    }
+
+    it = PyObject_GC_New(SDT(IterObject), &SDT(IterType));
+    if (!it) {
+        SL(IterDel)(iter);
+        return NULL;
+    }
+
+    Py_INCREF(self);
+
+    it->skipdict = self;
+    it->iter = iter;
+    it->type = type;
+    it->version = version;
+    it->length = length;
+    it->rank = rank;
+    it->step = step;
+    it->batch = 0;
+    PyObject_GC_Track(it);
+
+    return (PyObject *)it;
+}
+
+static PyObject *
+SD(iter)(SDT(Object) *skipdict)
+{
+    return SD(iterator)(skipdict, NULL, KEY, 0, 0, 0);
+}
+
+/* A new iterator over length entries from the given rank on, step
+   ranks apart. Nodes only have as many levels as their height, so the
+   first node is looked up from the header by its rank. Iterators
+   derived from another one check that it is still valid. */
+static PyObject *
+SDI(derive)(SDT(Object) *skipdict, SDT(IterObject) *from, itertype type,
+            unsigned long rank, unsigned long length, Py_ssize_t step)
+{
+    SLT(skiplist) *sl = skipdict->skiplist;
+    SLT(skiplistiter) *iter;
+    unsigned long version;
+    PyObject *it;
+
+    SD(read_lock)(skipdict);
+    if (from && SDI(check)(from)) {
+        Read_Unlock(skipdict);
+        return NULL;
+    }
+    iter = SL(IterNew)(sl, !length ? NULL :
+                       SL(GetNodeByRank)(sl->header, sl->level - 1, rank));
+    if (iter && sl->tail) {
+        /* The length bounds the iteration rather than the scores. */
+        iter->forward = step > 0;
+        iter->min = sl->header->level[0].forward->score;
+        iter->max = sl->tail->score;
+    }
+    version = skipdict->version;
+    Read_Unlock(skipdict);
+
+    if (!iter) {
+        return PyErr_NoMemory();
+    }
+    it = SD(iterator)(skipdict, iter, type, rank, length, step);
+    if (!it) {
+        SL(IterDel)(iter);
+    } else {
+        ((SDT(IterObject) *) it)->version = version;
+    }
+    return it;
+}
+
+static PyObject *
+SDI(item)(SDT(IterObject) *self, Py_ssize_t index)
+{
+    SLT(skiplist) *sl = self->skipdict->skiplist;
+
+    if (index < 0) {
+        index += (Py_ssize_t) self->length;
+    }
+    if (index < 0 || (unsigned long) index >= self->length) {
+        PyErr_SetString(PyExc_IndexError, "index out of range");
+        return NULL;
+    }
+
+    Read_Lock(self->skipdict);
+    if (SDI(check)(self)) {
+        Read_Unlock(self->skipdict);
+        return NULL;
+    }
+
+    SLT(skiplistNode)* node = SL(GetNodeByRank)(
+        sl->header, sl->level - 1, self->rank + self->step * index);
+
+    if (!node) {
+        Read_Unlock(self->skipdict);
+        PyErr_SetString(PyExc_IndexError, "index out of range");
+        return NULL;
+    }
+
+    SD_SCORE score = node->score;
+    PyObject *obj = PyTuple_GET_ITEM(node->obj, 0);
+    Py_INCREF(obj);
+    Read_Unlock(self->skipdict);
+
+    PyObject *result = SD(iterators)[self->type](score, obj);
+    Py_DECREF(obj);
+    return result;
+}
+
+static PyObject *
+SDI(slice)(SDT(IterObject) *self, PyObject* item)
+{
+    if (self->batch) {
+        PyErr_SetString(PyExc_TypeError,
+                        "batch iterators are not subscriptable");
+        return NULL;
+    }
+
+    if (PyIndex_Check(item)) {
+        Py_ssize_t index = PyNumber_AsSsize_t(item, PyExc_IndexError);
+        if (index == -1 && PyErr_Occurred())
+            return NULL;
+        return SDI(item)(self, index);
+    }
+
+    if (!PySlice_Check(item)) {
+        PyErr_Format(PyExc_TypeError,
+                     "range indices must be integers or slices, not %.200s",
+                     Py_TYPE(item)->tp_name);
+        return NULL;
+    }
+
+    Py_ssize_t ilow;
+    Py_ssize_t ihigh;
+    Py_ssize_t step;
+    Py_ssize_t length;
+
+    if (PySlice_GetIndicesEx((PySliceObject *)item,
+                             (Py_ssize_t) self->length,
+                             &ilow, &ihigh, &step, &length)) {
+        return NULL;
+    }
+
+    /* Slicing is relative to the entries left, in their order. */
+    return SDI(derive)(self->skipdict, self, self->type,
+                       self->rank + self->step * ilow,
+                       (unsigned long) length,
+                       length > 1 ? self->step * step
+                                  : (self->step * step > 0 ? 1 : -1));
+}
+
+/* The number of entries left, or of batches for a batch iterator. */
+static Py_ssize_t
+SDI(length)(SDT(IterObject) *self)
+{
+    if (self->batch) {
+        return (Py_ssize_t) ((self->length + self->batch - 1) / self->batch);
+    }
+    return (Py_ssize_t) self->length;
+}
+
+static PyObject *
+SDI(length_hint)(SDT(IterObject) *self)
+{
+    return PyInt_FromSsize_t(SDI(length)(self));
+}
+
+static PyObject *
+SDI(reversed)(SDT(IterObject) *self)
+{
+    PyObject *it = SDI(derive)(
+        self->skipdict, self, self->type,
+        self->rank + self->step * ((Py_ssize_t) self->length - 1),
+        self->length, -self->step);
+    if (it) {
+        ((SDT(IterObject) *) it)->batch = self->batch;
+    }
+    return it;
+}
+
+static PyObject *
+SD(reversed)(SDT(Object) *self)
+{
+    SD(read_lock)(self);
+    unsigned long length = SL(Length)(self->skiplist);
+    Read_Unlock(self);
+    return SDI(derive)(self, NULL, KEY, length, length, -1);
+}
+
+static Py_ssize_t
+SD(length)(SDT(Object) *self)
+{
+    Read_Lock(self);
+    Py_ssize_t len = SL(Length)(self->skiplist) - self->ndead;
+    Read_Unlock(self);
+    return len;
+}
+
+static int
+SD(contains)(SDT(Object) *self, PyObject *key)
+{
+    return PyDict_Contains(self->mapping, key);
+}
+
+/* The record is looked up before taking the lock, which only guards
+   the score; an update in place swaps it under the write lock. */
+static PyObject *
+SD(getitem)(SDT(Object) *self, PyObject *key)
+{
+    PyObject *item, *value;
+
+    if (skipdict_lookup(self->mapping, key, &item)) return NULL;
+    if (!item) {
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+    Read_Lock(self);
+    value = PyTuple_GET_ITEM(item, 1);
+    Py_INCREF(value);
+    Read_Unlock(self);
+    Py_DECREF(item);
+    return value;
+}
+
+static int
+SD(ass_sub)(SDT(Object) *self, PyObject *key, PyObject *value)
+{
+    Py_hash_t hash;
+    int err, level = 0;
+
+    if ((hash = PyObject_Hash(key)) == -1 ||
+        (value && (level = SD(draw)(self)) < 0)) {
+        return -1;
+    }
+
+    Write_Lock(self);
+    if (value) {
+        err = SD(assign)(self, key, hash, value, level);
+    } else {
+        err = SD(tick)(self) || SD(delitem)(self, key, hash, 1);
+    }
+    SD(write_unlock)(self);
+    return err ? -1 : 0;
+}
+
+static PyObject *
+SD(get)(SDT(Object) *self, PyObject *args)
+{
+    PyObject *key, *item, *value;
+    PyObject *failobj = Py_None;
+
+    if (!PyArg_UnpackTuple(args, "get", 1, 2, &key, &failobj))
+        return NULL;
+    if (skipdict_lookup(self->mapping, key, &item))
+        return NULL;
+
+    Read_Lock(self);
+    if (item) {
+        value = PyTuple_GET_ITEM(item, 1);
+    } else {
+        value = failobj;
+    }
+
+    Py_INCREF(value);
+    Read_Unlock(self);
+    Py_XDECREF(item);
+    return value;
+}
+
+static PyObject *
+SD(get_many)(SDT(Object) *self, PyObject *args)
+{
+    PyObject *keys, *seq, *result = NULL, *value;
+    PyObject *failobj = Py_None;
+    PyObject **items = NULL;
+    Py_ssize_t i, n;
+
+    if (!PyArg_UnpackTuple(args, "get_many", 1, 2, &keys, &failobj))
+        return NULL;
+
+    seq = PySequence_Fast(keys, "get_many() argument must be iterable");
+    if (!seq) return NULL;
+
+    n = PySequence_Fast_GET_SIZE(seq);
+    items = PyMem_Malloc((n ? n : 1) * sizeof(PyObject *));
+    if (!items) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < n; i++) {
+        if (skipdict_lookup(self->mapping,
+                            PySequence_Fast_GET_ITEM(seq, i), &items[i])) {
+            goto done;
+        }
+    }
+    if (!(result = PyList_New(n))) goto done;
+
+    Read_Lock(self);
+    for (i = 0; i < n; i++) {
+        value = items[i] ? PyTuple_GET_ITEM(items[i], 1) : failobj;
+        Py_INCREF(value);
+        PyList_SET_ITEM(result, i, value);
+    }
+    Read_Unlock(self);
+
+ done:
+    while (items && i-- > 0) {
+        Py_XDECREF(items[i]);
+    }
+    PyMem_Free(items);
+    Py_DECREF(seq);
+    return result;
+}
+
+PyObject *
+SD(setdefault)(SDT(Object) *self, PyObject *args)
+{
+    PyObject *key, *value;
+    PyObject *defaultobj = Py_None;
+    Py_hash_t hash;
+    int level;
+
+    if (!PyArg_UnpackTuple(args, "setdefault", 1, 2, &key, &defaultobj))
+        return NULL;
+    if ((hash = PyObject_Hash(key)) == -1 ||
+        (level = SD(draw)(self)) < 0) {
+        return NULL;
+    }
+
+    Write_Lock(self);
+    if (SD(tick)(self)) {
+        SD(write_unlock)(self);
+        return NULL;
+    }
+    PyObject *item = Dict_GetItemHash(self->mapping, key, hash);
+    if (!item) {
+        if (PyErr_Occurred() ||
+            SD(insertobj)(self, key, hash, defaultobj, 0, level)) {
+            SD(write_unlock)(self);
+            return NULL;
+        }
+        value = defaultobj;
+    } else {
+        value = PyTuple_GET_ITEM(item, 1);
+    }
+
+    Py_XINCREF(value);
+    SD(write_unlock)(self);
+    return value;
+}
+
+static PyObject *
+SD(set)(SDT(Object) *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = {"key", "score", "ttl", NULL};
+    PyObject *key, *value, *ttlobj = Py_None;
+    double ttl = 0.0;
+    Py_hash_t hash;
+    int err, level;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "OO|O:set", kwlist,
+                                     &key, &value, &ttlobj))
+        return NULL;
+
+    float_Convert(ttl, ttlobj);
+    if (ttl < 0) {
+        PyErr_SetString(PyExc_ValueError, "ttl is negative");
+        return NULL;
+    }
+    if ((hash = PyObject_Hash(key)) == -1 ||
+        (level = SD(draw)(self)) < 0) {
+        return NULL;
+    }
+
+    Write_Lock(self);
+    if (!ttlobj) {
+        err = SD(assign)(self, key, hash, value, level);
+    } else {
+        err = SD(tick)(self) ||
+            SD(insertobj)(self, key, hash, value, 1, level) ||
+            SD(schedule)(self, key, hash, skipdict_now() + ttl);
+    }
+    SD(write_unlock)(self);
+    if (err) return NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+SD(expire)(SDT(Object) *self, PyObject *args)
+{
+    PyObject *nowobj = Py_None;
+    double now = 0.0;
+
+    if (!PyArg_UnpackTuple(args, "expire", 0, 1, &nowobj))
+        return NULL;
+
+    float_Convert(now, nowobj);
+    if (!nowobj) now = skipdict_now();
+
+    Write_Lock(self);
+    Py_ssize_t removed = SD(reap)(self, now, PY_SSIZE_T_MAX);
+    SD(write_unlock)(self);
+    if (removed < 0) return NULL;
+    return PyInt_FromSsize_t(removed);
+}
+
+/* The seconds left before the key expires, or None. */
+static PyObject *
+SD(ttl)(SDT(Object) *self, PyObject *key)
+{
+    PyObject *entry = NULL;
+    double left = 0.0;
+
+    Read_Lock(self);
+    if (!PyDict_GetItem(self->mapping, key)) {
+        Read_Unlock(self);
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+    if (self->deadlines) {
+        entry = PyDict_GetItem(self->deadlines, key);
+    }
+    if (entry) {
+        left = PyFloat_AS_DOUBLE(PyTuple_GET_ITEM(entry, 1)) -
+            skipdict_now();
+    }
+    Read_Unlock(self);
+
+    if (!entry) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return PyFloat_FromDouble(left > 0 ? left : 0.0);
+}
+
+static PyObject *
+SD(seed)(SDT(Object) *self, PyObject *args)
+{
+    PyObject *value = Py_None;
+    uint64_t seed;
+
+    if (!PyArg_UnpackTuple(args, "seed", 0, 1, &value))
+        return NULL;
+
+    if (value == Py_None) {
+        seed = ((uint64_t) random() << 32) ^ (uint64_t) random();
+    } else {
+        /* Python 2 ints need to be converted to long first. */
+        PyObject *index = PyNumber_Index(value), *number;
+        if (!index) return NULL;
+        number = PyNumber_Long(index);
+        Py_DECREF(index);
+        if (!number) return NULL;
+        seed = PyLong_AsUnsignedLongLongMask(number);
+        Py_DECREF(number);
+        if (seed == (uint64_t) -1 && PyErr_Occurred()) return NULL;
+    }
+
+    Write_Lock(self);
+    self->rng = seed;
+    SD(write_unlock)(self);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+/* k distinct keys chosen uniformly. For small samples, random ranks
+   are drawn (again for any duplicates) and looked up by rank; larger
+   ones are selected in a single walk (Knuth's algorithm S). Either way
+   the result is shuffled. */
+static PyObject *
+SD(sample)(SDT(Object) *self, PyObject *args)
+{
+    SLT(skiplist) *sl = self->skiplist;
+    SLT(skiplistNode) *x;
+    PyObject *result, *key;
+    unsigned long *ranks;
+    Py_ssize_t k, n, i, j, count;
+
+    if (!PyArg_ParseTuple(args, "n:sample", &k))
+        return NULL;
+
+    /* Sampling advances the generator. */
+    Write_Lock(self);
+    SD(compact)(self);
+    n = (Py_ssize_t) SL(Length)(sl);
+    if (k < 0 || k > n) {
+        SD(write_unlock)(self);
+        PyErr_SetString(PyExc_ValueError,
+                        "sample larger than population or is negative");
+        return NULL;
+    }
+    ranks = PyMem_Malloc((k ? k : 1) * sizeof(unsigned long));
+    result = ranks ? PyList_New(k) : PyErr_NoMemory();
+    if (!result) {
+        SD(write_unlock)(self);
+        PyMem_Free(ranks);
+        return NULL;
+    }
+
+    if (k > n / 4) {
+        x = sl->header->level[0].forward;
+        for (i = 0, count = 0; count < k; i++, x = x->level[0].forward) {
+            if ((n - i) * skipdict_uniform(&self->rng) < k - count) {
+                key = PyTuple_GET_ITEM((PyObject *) x->obj, 0);
+                Py_INCREF(key);
+                PyList_SET_ITEM(result, count++, key);
+            }
+        }
+    } else {
+        for (count = 0; count < k; ) {
+            for (i = count; i < k; i++)
+                ranks[i] = 1 + (unsigned long)
+                    (skipdict_uniform(&self->rng) * n);
+            qsort(ranks, k, sizeof(unsigned long), skipdict_rank_compare);
+            for (i = count = 0; i < k; i++)
+                if (!count || ranks[i] != ranks[count - 1])
+                    ranks[count++] = ranks[i];
+        }
+        for (i = 0; i < k; i++) {
+            x = SL(GetNodeByRank)(sl->header, sl->level - 1, ranks[i]);
+            key = PyTuple_GET_ITEM((PyObject *) x->obj, 0);
+            Py_INCREF(key);
+            PyList_SET_ITEM(result, i, key);
+        }
+    }
+
+    for (i = k - 1; i > 0; i--) {
+        j = (Py_ssize_t) (skipdict_uniform(&self->rng) * (i + 1));
+        key = PyList_GET_ITEM(result, i);
+        PyList_SET_ITEM(result, i, PyList_GET_ITEM(result, j));
+        PyList_SET_ITEM(result, j, key);
+    }
+    SD(write_unlock)(self);
+
+    PyMem_Free(ranks);
+    return result;
+}
+
+/* k keys chosen with replacement, each with a probability in
+   proportion to its score (the primary score for pairs), using the
+   weight sums kept on the skiplist links. */
+static PyObject *
+SD(weighted_sample)(SDT(Object) *self, PyObject *args)
+{
+    SLT(skiplist) *sl = self->skiplist;
+    SLT(skiplistNode) *x;
+    PyObject *result, *key;
+    Py_ssize_t k, i;
+    const char *error = NULL;
+
+    if (!PyArg_ParseTuple(args, "n:weighted_sample", &k))
+        return NULL;
+    if (k < 0) {
+        PyErr_SetString(PyExc_ValueError, "sample size is negative");
+        return NULL;
+    }
+    if (!(result = PyList_New(k)))
+        return NULL;
+
+    Write_Lock(self);
+    SD(compact)(self);
+    if (k && !SL(Length)(sl)) {
+        error = "cannot sample from an empty skip dict";
+    } else if (k && sl->header->level[0].weight < 0) {
+        /* The lowest score comes first. */
+        error = "scores must not be negative";
+    } else if (k && !(sl->weight > 0)) {
+        error = "total of scores must be greater than zero";
+    }
+    for (i = 0; !error && i < k; i++) {
+        x = SL(GetNodeByWeight)(sl, skipdict_uniform(&self->rng) * sl->weight);
+        key = PyTuple_GET_ITEM((PyObject *) x->obj, 0);
+        Py_INCREF(key);
+        PyList_SET_ITEM(result, i, key);
+    }
+    SD(write_unlock)(self);
+
+    if (error) {
+        Py_DECREF(result);
+        PyErr_SetString(PyExc_ValueError, error);
+        return NULL;
+    }
+    return result;
+}
+
+/* The number of entries between each pair of consecutive edges, from
+   one rank lookup per edge, and optionally the sum of their scores
+   (the primary score for pairs) from the weight sums of the links. */
+static PyObject *
+SD(histogram)(SDT(Object) *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"edges", "sums", NULL};
+    PyObject *edgesobj, *sumsobj = Py_False, *seq, *counts = NULL;
+    PyObject *sums = NULL, *result = NULL, *item;
+    SD_SCORE *edges = NULL;
+    unsigned long *ncounts = NULL;
+    double *nsums = NULL;
+    Py_ssize_t n, i;
+    int withsums, err;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O:histogram", kwlist,
+                                     &edgesobj, &sumsobj))
+        return NULL;
+    if ((withsums = PyObject_IsTrue(sumsobj)) < 0) return NULL;
+    seq = PySequence_Fast(edgesobj, "edges must be a sequence");
+    if (!seq) return NULL;
+
+    n = PySequence_Fast_GET_SIZE(seq);
+    edges = PyMem_Malloc((n ? n : 1) * sizeof(SD_SCORE));
+    ncounts = PyMem_Malloc((n ? n : 1) * sizeof(unsigned long));
+    nsums = PyMem_Malloc((n ? n : 1) * sizeof(double));
+    if (!edges || !ncounts || !nsums) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < n; i++)
+        if (SD(score_from)(PySequence_Fast_GET_ITEM(seq, i), &edges[i]))
+            goto done;
+
+    SD(read_lock)(self);
+    err = SL(Histogram)(self->skiplist, edges, (unsigned long) n, ncounts,
+                        withsums ? nsums : NULL);
+    Read_Unlock(self);
+    if (err) {
+        PyErr_SetString(PyExc_ValueError, "edges must be in order");
+        goto done;
+    }
+
+    n = n > 1 ? n - 1 : 0;
+    if (!(counts = PyList_New(n)) || (withsums && !(sums = PyList_New(n))))
+        goto done;
+    for (i = 0; i < n; i++) {
+        if (!(item = PyLong_FromUnsignedLong(ncounts[i]))) goto done;
+        PyList_SET_ITEM(counts, i, item);
+        if (!withsums) continue;
+        if (!(item = PyFloat_FromDouble(nsums[i]))) goto done;
+        PyList_SET_ITEM(sums, i, item);
+    }
+    if (withsums) {
+        result = PyTuple_Pack(2, counts, sums);
+    } else {
+        result = counts;
+        Py_INCREF(result);
+    }
+
+done:
+    Py_XDECREF(counts);
+    Py_XDECREF(sums);
+    Py_DECREF(seq);
+    PyMem_Free(edges);
+    PyMem_Free(ncounts);
+    PyMem_Free(nsums);
+    return result;
+}
+
+static PyObject *
+SD(iterator_from_range)(SDT(Object) *self,
+                             PyObject *args, PyObject *kw,
+                             itertype type)
+{
+    PyObject *min = NULL;
+    PyObject *max = NULL;
+
+    static char *kwlist[] = {"min", "max", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|OO:SkipDict", kwlist,
+                                     &min, &max)) {
+        return NULL;
+    }
+
+    PyObject *it = NULL;
+    SLT(skiplistiter) *iter;
+    unsigned long version;
+    SD_SCORE dmin = {0}, dmax = {0};
+
+    if (min == Py_None) min = NULL;
+    if (max == Py_None) max = NULL;
+    if ((min && SD(score_from)(min, &dmin)) ||
+        (max && SD(score_from)(max, &dmax))) {
+        return NULL;
+    }
+
+    SD(read_lock)(self);
+    if (!self->skiplist->tail) {
+        Read_Unlock(self);
+        return SD(iterator)(self, NULL, type, 0, 0, 0);
+    }
+
+    if (!(min || max)) {
+        iter = SL(IterNewFromHead)(self->skiplist);
+    } else {
+        if (!min) dmin = self->skiplist->header->level[0].forward->score;
+        if (!max) dmax = self->skiplist->tail->score;
+        iter = SL(IterNewFromRange)(self->skiplist, dmin, dmax);
+    }
+    version = self->version;
+    Read_Unlock(self);
+
+    if (!iter) {
+        return NULL;
+    }
+    it = SD(iterator)(self, iter, type, iter->rank, iter->length,
+                      iter->forward ? 1 : -1);
+    if (!it) {
+        SL(IterDel)(iter);
+    } else {
+        ((SDT(IterObject) *) it)->version = version;
+    }
+    return it;
+}
+
+static PyObject *
+SD(keys)(SDT(Object) *self, PyObject *args, PyObject *kw)
+{
+    return SD(iterator_from_range)(self, args, kw, KEY);
+}
+
+static PyObject *
+SD(values)(SDT(Object) *self, PyObject *args, PyObject *kw)
+{
+    return SD(iterator_from_range)(self, args, kw, VALUE);
+}
+
+static PyObject *
+SD(items)(SDT(Object) *self, PyObject *args, PyObject *kw)
+{
+    return SD(iterator_from_range)(self, args, kw, ITEM);
+}
+
+/* Iterates over the entries (or a range of them, as for items()) in
+   lists of up to size items each. */
+static PyObject *
+SD(iter_batches)(SDT(Object) *self, PyObject *args, PyObject *kw)
+{
+    Py_ssize_t size;
+    PyObject *min = Py_None, *max = Py_None, *range, *it, *reversed;
+    int reverse = 0;
+
+    static char *kwlist[] = {"size", "min", "max", "reverse", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "n|OOi:iter_batches", kwlist,
+                                     &size, &min, &max, &reverse)) {
+        return NULL;
+    }
+    if (size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be positive");
+        return NULL;
+    }
+
+    range = Py_BuildValue("(OO)", min, max);
+    if (!range) {
+        return NULL;
+    }
+    it = SD(iterator_from_range)(self, range, NULL, ITEM);
+    Py_DECREF(range);
+    if (it && reverse) {
+        reversed = SDI(reversed)((SDT(IterObject) *) it);
+        Py_DECREF(it);
+        it = reversed;
+    }
+    if (it) {
+        ((SDT(IterObject) *) it)->batch = size;
+    }
+    return it;
+}
+
+static PyObject *
+SD(repr)(SDT(Object) *self)
+{
+    Py_ssize_t i;
+    PyObject *s, *temp, *colon = NULL;
+    PyObject *pieces = NULL, *result = NULL;
+    PyObject *key, *value;
+    SDT(IterObject) * it = NULL;
+    SD_SCORE score;
+
+    i = Py_ReprEnter((PyObject *)self);
+    if (i != 0) {
+        return i > 0 ? PyString_FromString("{...}") : NULL;
+    }
+
+    if (SD(length)(self) == 0) {
+        result = PyString_FromString("{}");
+        goto Done;
+    }
+
+    pieces = PyList_New(0);
+    if (pieces == NULL)
+        goto Done;
+
+    colon = PyString_FromString(": ");
+    if (colon == NULL)
+        goto Done;
+
+    it = (SDT(IterObject)* ) SD(iterator)(self, NULL, ITEM, 0, 0, 0);
+
+    /* Do repr() on each key+value pair, and insert ": " between them.
+       Note that repr may mutate the dict. */
+    i = 0;
+    while (1) {
+        Read_Lock(self);
+        int err = SDI(check)(it) || \
+            SDI(fetch)(it, &score, &key);
+        if (!err) Py_INCREF(key);
+        Read_Unlock(self);
+        if (err) {
+            if (!PyErr_ExceptionMatches(PyExc_StopIteration))
+                goto Done;
+            break;
+        }
+        value = SD(score_to)(score);
+        int status;
+        s = PyObject_Repr(key);
+        Py_DECREF(key);
+        PyString_Concat(&s, colon);
+        PyString_ConcatAndDel(&s, PyObject_Repr(value));
+        Py_DECREF(value);
+        if (s == NULL)
+            goto Done;
+        status = PyList_Append(pieces, s);
+        Py_DECREF(s);  /* append created a new ref */
+        if (status < 0)
+            goto Done;
+    }
+
+    PyErr_Clear();
+
+    /* Add "{}" decorations to the first and last items. */
+    assert(PyList_GET_SIZE(pieces) > 0);
+    s = PyString_FromString("{");
+    if (s == NULL)
+        goto Done;
+
+    temp = PyList_GET_ITEM(pieces, 0);
+    PyString_ConcatAndDel(&s, temp);
+    PyList_SET_ITEM(pieces, 0, s);
+    if (s == NULL)
+        goto Done;
+
+    s = PyString_FromString("}");
+    if (s == NULL)
+        goto Done;
+    temp = PyList_GET_ITEM(pieces, PyList_GET_SIZE(pieces) - 1);
+    PyString_ConcatAndDel(&temp, s);
+    PyList_SET_ITEM(pieces, PyList_GET_SIZE(pieces) - 1, temp);
+    if (temp == NULL)
+        goto Done;
+
+    /* Paste them all together with ", " between. */
+    s = PyString_FromString(", ");
+    if (s == NULL)
+        goto Done;
+    result = _PyString_Join(s, pieces);
+    Py_DECREF(s);
+Done:
+    Py_XDECREF(pieces);
+    Py_XDECREF(colon);
+    Py_XDECREF(it);
+    Py_ReprLeave((PyObject *)self);
+    return result;
+}
+
+static PyObject *
+SD(maxlevel)(SDT(Object) *self)
+{
+    return PyInt_FromLong(self->maxlevel);
+}
+
+static PyObject *
+SD(p)(SDT(Object) *self)
+{
+    return PyFloat_FromDouble(self->p);
+}
+
+static PyObject *
+SD(adaptive)(SDT(Object) *self)
+{
+    return PyBool_FromLong(self->adaptive);
+}
+
+static PyObject *
+SD(score_type)(SDT(Object) *self)
+{
+    return PyString_FromString(SD_SCORE_TYPE);
+}
+
+/* The size of the entry records and the skip list, in addition to the
+   object itself and the key index; the keys and scores are not counted,
+   as with dict.__sizeof__. */
+static Py_ssize_t
+SD(memory)(SDT(Object) *self)
+{
+    PyObject *result = PyObject_CallMethod(self->mapping, "__sizeof__", NULL);
+    if (!result) return -1;
+    Py_ssize_t size = PyNumber_AsSsize_t(result, PyExc_OverflowError);
+    Py_DECREF(result);
+    if (size == -1 && PyErr_Occurred()) return -1;
+
+    size += Py_TYPE(self)->tp_basicsize;
+    size += SL(MemoryUsage)(self->skiplist);
+    size += self->deadsize * sizeof(SLT(slEntry));
+    size += self->skiplist->length *
+        (PyTuple_Type.tp_basicsize + 2 * PyTuple_Type.tp_itemsize);
+    if (self->deadlines) {
+        result = PyObject_CallMethod(self->deadlines, "__sizeof__", NULL);
+        if (!result) return -1;
+        Py_ssize_t index = PyNumber_AsSsize_t(result, PyExc_OverflowError);
+        Py_DECREF(result);
+        if (index == -1 && PyErr_Occurred()) return -1;
+        size += index + slMemoryUsage(self->expiry);
+        size += slLength(self->expiry) *
+            (PyTuple_Type.tp_basicsize + 2 * PyTuple_Type.tp_itemsize +
+             PyFloat_Type.tp_basicsize);
+    }
+    return size;
+}
+
+static PyObject *
+SD(sizeof)(SDT(Object) *self)
+{
+    Read_Lock(self);
+    Py_ssize_t size = SD(memory)(self);
+    Read_Unlock(self);
+    if (size == -1) return NULL;
+    return PyInt_FromSsize_t(size);
+}
+
+static PyObject *
+SD(stats)(SDT(Object) *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"paths", NULL};
+    PyObject *paths = Py_True;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O:stats", kwlist,
+                                     &paths))
+        return NULL;
+
+    int walk = PyObject_IsTrue(paths);
+    if (walk < 0) return NULL;
+
+    SD(read_lock)(self);
+    SLT(skiplist) *sl = self->skiplist;
+    unsigned long length = sl->length, total = 0, max = 0;
+    Py_ssize_t size = SD(memory)(self);
+    PyObject *levels = size == -1 ? NULL : PyList_New(sl->level);
+    if (!levels) {
+        Read_Unlock(self);
+        return NULL;
+    }
+    int i;
+    for (i = 0; i < sl->level; i++) {
+        PyObject *count = PyLong_FromUnsignedLong(sl->levels[i]);
+        if (!count) {
+            Read_Unlock(self);
+            Py_DECREF(levels);
+            return NULL;
+        }
+        PyList_SET_ITEM(levels, i, count);
+    }
+    if (walk) SL(PathStats)(sl, &total, &max);
+    int level = sl->level, header = sl->maxlevel;
+    size_t slab = sl->slabSize, slabfree = sl->slabFree;
+    Read_Unlock(self);
+
+    PyObject *result = Py_BuildValue(
+        "{s:k,s:i,s:i,s:i,s:N,s:n,s:d,s:n,s:d}",
+        "length", length,
+        "level", level,
+        "maxlevel", self->maxlevel,
+        "header", header,
+        "levels", levels,
+        "bytes", size,
+        "bytes_per_entry", length ? (double) size / length : 0.0,
+        "slab_bytes", (Py_ssize_t) slab,
+        "slab_utilization", slab ? 1.0 - (double) slabfree / slab : 0.0);
+    if (!result || !walk) return result;
+
+    PyObject *avg = PyFloat_FromDouble(length ? (double) total / length : 0.0);
+    PyObject *longest = PyLong_FromUnsignedLong(max);
+    if (!avg || !longest ||
+        PyDict_SetItemString(result, "avg_path", avg) ||
+        PyDict_SetItemString(result, "max_path", longest)) {
+        Py_CLEAR(result);
+    }
+    Py_XDECREF(avg);
+    Py_XDECREF(longest);
+    return result;
+}
+
+static PyObject *
+SD(rebalance)(SDT(Object) *self)
+{
+    Write_Lock(self);
+    SD(compact)(self);
+    int err = SL(Rebalance)(self->skiplist, self->p);
+    if (!err) {
+        self->version++;
+        self->churn = 0;
+    }
+    SD(write_unlock)(self);
+    if (err) return PyErr_NoMemory();
+    Py_RETURN_NONE;
+}
+
+/* Gives each node of a copied skiplist a record of its own, with the
+   key and value deep-copied, in a new key index. The ties are sorted
+   last, since they are ordered by the address of the record. */
+static int
+SD(deeprecords)(SDT(Object) *copy, PyObject *deepcopy, PyObject *memo)
+{
+    SLT(skiplistNode) *x;
+    PyObject *mapping, *key, *value, *item;
+
+    if (!(mapping = PyDict_New())) return -1;
+
+    for (x = copy->skiplist->header->level[0].forward; x;
+         x = x->level[0].forward) {
+        key = PyObject_CallFunctionObjArgs(
+            deepcopy, PyTuple_GET_ITEM((PyObject *) x->obj, 0), memo, NULL);
+        value = key ? PyObject_CallFunctionObjArgs(
+            deepcopy, PyTuple_GET_ITEM((PyObject *) x->obj, 1), memo,
+            NULL) : NULL;
+        item = value ? PyTuple_Pack(2, key, value) : NULL;
+        Py_XDECREF(key);
+        Py_XDECREF(value);
+        if (!item || PyDict_SetItem(mapping, PyTuple_GET_ITEM(item, 0), item)) {
+            Py_XDECREF(item);
+            goto fail;
+        }
+        x->obj = (void *) item;
+        Py_DECREF(item);
+    }
+
+    if (SL(SortTies)(copy->skiplist)) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    Py_DECREF(copy->mapping);
+    copy->mapping = mapping;
+    return 0;
+
+fail:
+    /* The copy is discarded, which does not look at the nodes. */
+    Py_DECREF(mapping);
+    return -1;
+}
+
+/* The nodes are copied with their heights and spans into one block and
+   the key index as a whole. The entry records are shared until a score
+   changes (see SD(insertobj)); deadline records never change. */
+static PyObject *
+SD(copy)(SDT(Object) *self)
+{
+    SDT(Object) *copy;
+    int err;
+
+    copy = (SDT(Object) *) Py_TYPE(self)->tp_alloc(Py_TYPE(self), 0);
+    if (!copy) return NULL;
+
+    SD(read_lock)(self);
+    err = SD(setup)(copy, self->maxlevel, self->p, self->adaptive,
+                    self->autorebalance, self->random, NULL, 0);
+    if (!err) {
+        SL(Free)(copy->skiplist);
+        Py_DECREF(copy->mapping);
+        copy->skiplist = SL(Copy)(self->skiplist);
+        copy->mapping = PyDict_Copy(self->mapping);
+        copy->churn = self->churn;
+        copy->rng = self->rng;
+        copy->lazydelete = self->lazydelete;
+        if (self->expiry) {
+            copy->expiry = slCopy(self->expiry);
+            copy->deadlines = PyDict_Copy(self->deadlines);
+            err = !copy->expiry || !copy->deadlines;
+        }
+        err = err || !copy->skiplist || !copy->mapping;
+    }
+    Read_Unlock(self);
+
+    if (err) {
+        if (!PyErr_Occurred()) PyErr_NoMemory();
+        Py_DECREF(copy);
+        return NULL;
+    }
+    return (PyObject *) copy;
+}
+
+static PyObject *
+SD(deepcopy)(SDT(Object) *self, PyObject *memo)
+{
+    SDT(Object) *copy;
+    skiplistNode *x;
+    PyObject *module, *deepcopy, *deadlines = NULL, *key, *item, *id;
+    int err = -1;
+
+    if (!(module = PyImport_ImportModule("copy"))) return NULL;
+    deepcopy = PyObject_GetAttrString(module, "deepcopy");
+    Py_DECREF(module);
+    if (!deepcopy) return NULL;
+
+    if (!(copy = (SDT(Object) *) SD(copy)(self))) {
+        Py_DECREF(deepcopy);
+        return NULL;
+    }
+    if (PyDict_Check(memo)) {
+        if (!(id = PyLong_FromVoidPtr(self)) ||
+            PyDict_SetItem(memo, id, (PyObject *) copy)) {
+            Py_XDECREF(id);
+            goto done;
+        }
+        Py_DECREF(id);
+    }
+    if (SD(deeprecords)(copy, deepcopy, memo)) goto done;
+
+    /* The deadline records hold the keys, too. */
+    if (copy->deadlines) {
+        if (!(deadlines = PyDict_New())) goto done;
+        for (x = copy->expiry->header->level[0].forward; x;
+             x = x->level[0].forward) {
+            key = PyObject_CallFunctionObjArgs(
+                deepcopy, PyTuple_GET_ITEM((PyObject *) x->obj, 0), memo,
+                NULL);
+            item = key ? PyTuple_Pack(2, key,
+                                      PyTuple_GET_ITEM((PyObject *) x->obj, 1))
+                       : NULL;
+            Py_XDECREF(key);
+            if (!item || PyDict_SetItem(deadlines, PyTuple_GET_ITEM(item, 0),
+                                        item)) {
+                Py_XDECREF(item);
+                goto done;
+            }
+            x->obj = (void *) item;
+            Py_DECREF(item);
+        }
+        if (slSortTies(copy->expiry)) {
+            PyErr_NoMemory();
+            goto done;
+        }
+        Py_DECREF(copy->deadlines);
+        copy->deadlines = deadlines;
+        deadlines = NULL;
+    }
+    err = 0;
+
+done:
+    Py_XDECREF(deadlines);
+    Py_DECREF(deepcopy);
+    if (err) {
+        Py_DECREF(copy);
+        return NULL;
+    }
+    return (PyObject *) copy;
+}
+
+static PyObject *
+SD(counting)(SDT(Object) *self)
+{
+    return PyBool_FromLong(self->skiplist->counters != NULL);
+}
+
+static int
+SD(set_counting)(SDT(Object) *self, PyObject *value)
+{
+    if (!value) {
+        PyErr_SetString(PyExc_TypeError, "can't delete attribute");
+        return -1;
+    }
+    int enable = PyObject_IsTrue(value);
+    if (enable < 0) return -1;
+
+    Write_Lock(self);
+    int err = SL(EnableCounters)(self->skiplist, enable);
+    SD(write_unlock)(self);
+    if (err) {
+#ifdef SKIPLIST_COUNTERS
+        PyErr_NoMemory();
+#else
+        PyErr_SetString(PyExc_NotImplementedError,
+                        "built without SKIPLIST_COUNTERS");
+#endif
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+SD(counters)(SDT(Object) *self)
+{
+    static const char *ops[SL_OPS] = {"insert", "delete", "rank", "range"};
+    slCounters c;
+
+    Read_Lock(self);
+    int counting = self->skiplist->counters != NULL;
+    if (counting) c = *self->skiplist->counters;
+    Read_Unlock(self);
+    if (!counting) Py_RETURN_NONE;
+
+    PyObject *result = Py_BuildValue(
+        "{s:k,s:k,s:k,s:k}",
+        "allocs", c.allocs,
+        "frees", c.frees,
+        "inplace", c.inplace,
+        "relinks", c.relinks);
+    if (!result) return NULL;
+
+    int i, j;
+    for (i = 0; i < SL_OPS; i++) {
+        PyObject *latency = PyList_New(SL_LATENCY_BUCKETS);
+        if (!latency) goto Error;
+        for (j = 0; j < SL_LATENCY_BUCKETS; j++) {
+            PyObject *count = PyLong_FromUnsignedLong(c.latency[i][j]);
+            if (!count) {
+                Py_DECREF(latency);
+                goto Error;
+            }
+            PyList_SET_ITEM(latency, j, count);
+        }
+        PyObject *op = Py_BuildValue("{s:k,s:k,s:N}",
+                                     "calls", c.calls[i],
+                                     "steps", c.steps[i],
+                                     "latency", latency);
+        if (!op) goto Error;
+        int err = PyDict_SetItemString(result, ops[i], op);
+        Py_DECREF(op);
+        if (err) goto Error;
+    }
+    return result;
+
+Error:
+    Py_DECREF(result);
+    return NULL;
+}
+
+static PyObject *
+SD(reset_counters)(SDT(Object) *self)
+{
+    Write_Lock(self);
+    SL(ResetCounters)(self->skiplist);
+    SD(write_unlock)(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+SDI(repr)(SDT(IterObject) *self)
+{
+    char* min = SD(score_str)(self->iter->min);
+    char* max = SD(score_str)(self->iter->max);
+    PyObject *repr = PyString_FromFormat("<" SD_NAME "Iterator "
+                                         "type=\"%s\" "
+                                         "forward=%s "
+                                         "min=%s "
+                                         "max=%s "
+                                         "at %p>",
+                                         iterator_names[self->type],
+                                         booleans[self->iter->forward],
+                                         min,
+                                         max,
+                                         self->skipdict);
+    PyMem_Free(min);
+    PyMem_Free(max);
+    return repr;
+}
+
+static PyObject *
+SD(richcompare)(SDT(Object) *self, PyObject* other, int op)
+{
+    PyObject *mapping;
+    if (PyDict_Check(other)) {
+        mapping = other;
+    } else {
+        if (!skipdict_Check(other)) {
+            PyObject *repr = PyObject_Repr(other);
+            PyErr_Format(PyExc_TypeError,
+                         "can't compare with %s",
+                         PyString_AsString(repr));
+            Py_DECREF(repr);
+            return NULL;
+        }
+        SDT(Object)* obj = (SDT(Object)*) other;
+        mapping = obj->mapping;
+    }
+
+    /* Entry records may be updated in place by a concurrent writer; the
+       locks are taken in address order to avoid deadlocks. */
+    SDT(Object) *first = self, *second = NULL;
+    if (mapping != other && other != (PyObject *) self) {
+        second = (SDT(Object) *) other;
+        if ((void *) second < (void *) first) {
+            second = self;
+            first = (SDT(Object) *) other;
+        }
+    }
+    Read_Lock(first);
+    if (second) Read_Lock(second);
+    PyObject *result = PyDict_Type.tp_richcompare(self->mapping, mapping, op);
+    if (second) Read_Unlock(second);
+    Read_Unlock(first);
+    return result;
+}
+
+static PyMethodDef SD(methods)[] = {
+    {"get", (PyCFunction)SD(get), METH_VARARGS, NULL},
+    {"setdefault", (PyCFunction)SD(setdefault), METH_VARARGS, NULL},
+    {"keys", (PyCFunction)SD(keys), METH_VARARGS | METH_KEYWORDS, NULL},
+    {"values", (PyCFunction)SD(values), METH_VARARGS | METH_KEYWORDS, NULL},
+    {"items", (PyCFunction)SD(items), METH_VARARGS | METH_KEYWORDS, NULL},
+    {"iter_batches", (PyCFunction)SD(iter_batches),
+     METH_VARARGS | METH_KEYWORDS, NULL},
+    {"get_many", (PyCFunction)SD(get_many), METH_VARARGS, NULL},
+    {"index", (PyCFunction)SD(index), METH_O, NULL},
+    {"index_many", (PyCFunction)SD(index_many), METH_O, NULL},
+    {"floor", (PyCFunction)SD(floor), METH_O, NULL},
+    {"ceiling", (PyCFunction)SD(ceiling), METH_O, NULL},
+    {"nearest", (PyCFunction)SD(nearest), METH_VARARGS, NULL},
+    {"histogram", (PyCFunction)SD(histogram), METH_VARARGS | METH_KEYWORDS,
+     NULL},
+    {"change", (PyCFunction)SD(change), METH_VARARGS, NULL},
+    {"set", (PyCFunction)SD(set), METH_VARARGS | METH_KEYWORDS, NULL},
+    {"expire", (PyCFunction)SD(expire), METH_VARARGS, NULL},
+    {"ttl", (PyCFunction)SD(ttl), METH_O, NULL},
+    {"seed", (PyCFunction)SD(seed), METH_VARARGS, NULL},
+    {"union", (PyCFunction)SD(union), METH_VARARGS | METH_KEYWORDS, NULL},
+    {"intersection", (PyCFunction)SD(intersection),
+     METH_VARARGS | METH_KEYWORDS, NULL},
+    {"sample", (PyCFunction)SD(sample), METH_VARARGS, NULL},
+    {"weighted_sample", (PyCFunction)SD(weighted_sample), METH_VARARGS,
+     NULL},
+    {"stats", (PyCFunction)SD(stats), METH_VARARGS | METH_KEYWORDS, NULL},
+    {"rebalance", (PyCFunction)SD(rebalance), METH_NOARGS, NULL},
+    {"copy", (PyCFunction)SD(copy), METH_NOARGS, NULL},
+    {"__reversed__", (PyCFunction)SD(reversed), METH_NOARGS, NULL},
+    {"__copy__", (PyCFunction)SD(copy), METH_NOARGS, NULL},
+    {"__deepcopy__", (PyCFunction)SD(deepcopy), METH_O, NULL},
+    {"__sizeof__", (PyCFunction)SD(sizeof), METH_NOARGS, NULL},
+    {"counters", (PyCFunction)SD(counters), METH_NOARGS, NULL},
+    {"reset_counters", (PyCFunction)SD(reset_counters), METH_NOARGS, NULL},
+    {NULL}
+};
+
+static PyGetSetDef SD(getset)[] = {
+    {"maxlevel", (getter)SD(maxlevel), NULL, "maxlevel", NULL},
+    {"score_type", (getter)SD(score_type), NULL, "score_type", NULL},
+    {"p", (getter)SD(p), NULL, "p", NULL},
+    {"adaptive", (getter)SD(adaptive), NULL, "adaptive", NULL},
+    {"counting", (getter)SD(counting), (setter)SD(set_counting), "counting",
+     NULL},
+    {NULL}
+};
+
+static PyMappingMethods SD(as_mapping) = {
+    (lenfunc)SD(length),                   /*mp_length*/
+    (binaryfunc)SD(getitem),               /*mp_subscript*/
+    (objobjargproc)SD(ass_sub),            /*mp_ass_subscript*/
+};
+
+static PySequenceMethods SD(as_sequence) = {
+    (lenfunc)SD(length),                   /*sq_length*/
+    0,                                     /*sq_concat*/
+    0,                                     /*sq_repeat*/
+    0,                                     /*sq_item*/
+ 	0,                                     /*sq_slice*/
+    0,                                     /*sq_ass_item*/
+    0,                                     /*sq_ass_slice*/
+    (objobjproc)SD(contains),              /*sq_contains*/
+    0,                                     /*sq_inplace_concat*/
+    0,                                     /*sq_inplace_repeat*/
+};
+
+static PyTypeObject SDT(Type) = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "skipdict." SD_NAME,                   /* tp_name */
+    sizeof(SDT(Object)),                   /* tp_basicsize */
+    0,                                     /* tp_itemsize */
+    (destructor)SD(dealloc),               /* tp_dealloc */
+    0,                                     /* tp_print */
+    0,                                     /* tp_getattr */
+    0,                                     /* tp_setattr */
+    0,                                     /* tp_compare */
+    (reprfunc)SD(repr),                    /* tp_repr */
+    0,                                     /* tp_as_number */
+    &SD(as_sequence),                      /* tp_as_sequence*/
+    &SD(as_mapping),                       /* tp_as_mapping */
+    (hashfunc)PyObject_HashNotImplemented, /* tp_hash */
+    0,                                     /* tp_call */
+    0,                                     /* tp_str */
+    0,                                     /* tp_getattro */
+    0,                                     /* tp_setattro */
+    0,                                     /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE,/* tp_flags */
+    0,                                     /* tp_doc */
+    0,		                               /* tp_traverse */
+    0,		                               /* tp_clear */
+    (richcmpfunc)SD(richcompare),          /* tp_richcompare */
+    0,		                               /* tp_weaklistoffset */
+    (getiterfunc)SD(iter),                 /* tp_iter */
+    0,		                               /* tp_iternext */
+    SD(methods),                           /* tp_methods */
+    0,                                     /* tp_members */
+    SD(getset),                            /* tp_getset */
+    0,                                     /* tp_base */
+    0,                                     /* tp_dict */
+    0,                                     /* tp_descr_get */
+    0,                                     /* tp_descr_set */
+    0,                                     /* tp_dictoffset */
+    (initproc)SD(init),                    /* tp_init */
+    PyType_GenericAlloc,                   /* tp_alloc */
+    skipdict_new,                          /* tp_new */
+    PyObject_Del,                          /* tp_free */
+    0,                                     /* tp_is_gc */
+};
+
+static PyMethodDef SDI(methods)[] = {
+    {"__length_hint__", (PyCFunction)SDI(length_hint), METH_NOARGS, NULL},
+    {"__reversed__", (PyCFunction)SDI(reversed), METH_NOARGS, NULL},
+    {NULL, NULL}
+};
+
+static PyMappingMethods SDI(as_mapping) = {
+    (lenfunc)SDI(length),                  /*mp_length*/
+    (binaryfunc)SDI(slice),                /*mp_subscript*/
+    0,                                     /*mp_ass_subscript*/
+};
+
+static PyTypeObject SDT(IterType) = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "skipdict." SD_NAME "Iterator",         /* tp_name */
+    sizeof(SDT(IterObject)),                /* tp_basicsize */
+    0,                                      /* tp_itemsize */
+    /* methods */
+    (destructor)SDI(dealloc),               /* tp_dealloc */
+    0,                                      /* tp_print */
+    0,                                      /* tp_getattr */
+    0,                                      /* tp_setattr */
+    0,                                      /* tp_compare */
+    (reprfunc)SDI(repr),                    /* tp_repr */
+    0,                                      /* tp_as_number */
+    0,                                      /* tp_as_sequence */
+    &SDI(as_mapping),                       /* tp_as_mapping */
+    0,                                      /* tp_hash */
+    0,                                      /* tp_call */
+    0,                                      /* tp_str */
+    PyObject_GenericGetAttr,                /* tp_getattro */
+    0,                                      /* tp_setattro */
+    0,                                      /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_HAVE_GC,  /* tp_flags */
+    0,                                      /* tp_doc */
+    (traverseproc)SDI(traverse),            /* tp_traverse */
+    0,                                      /* tp_clear */
+    0,                                      /* tp_richcompare */
+    0,                                      /* tp_weaklistoffset */
+    PyObject_SelfIter,                      /* tp_iter */
+    (iternextfunc)SDI(next),                /* tp_iternext */
+    SDI(methods),                           /* tp_methods */
+};
+
+#undef SD
+#undef SDI
+#undef SDT
+#undef SL_SUFFIX
+#undef SD_SCORE
+#undef SD_NAME
+#undef SD_SCORE_TYPE
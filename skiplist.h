@@ -1,51 +1,79 @@
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
 #include <stdlib.h>
+#include <stdint.h>
+
+/* The C API is also built as a standalone library (libskiplist, see
+ * CMakeLists.txt). Objects are opaque pointers owned by the caller. */
+#define SKIPLIST_VERSION_MAJOR 1
+#define SKIPLIST_VERSION_MINOR 0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The skiplist is specialized at compile time for each score type:
+ * skiplist_tmpl.h declares (and skiplist_impl.h defines) the types and
+ * functions for SL_SCORE, with names suffixed by SL_SUFFIX. The double
+ * instantiation has no suffix, i.e. skiplist, slInsert() and so on;
+ * the others are skiplistI64, slI64Insert() and skiplistPair,
+ * slPairInsert(). Entries are ordered by score and then by object,
+ * using the comparator given to slCreateWithCompare() if any. */
 
-typedef struct skiplistNode {
-    void *obj;
-    double score;
-    struct skiplistNode *backward;
-    struct skiplistLevel {
-        struct skiplistNode *forward;
-        unsigned int span;
-    }level[];
-} skiplistNode;
-
-typedef struct skiplist {
-    struct skiplistNode *header, *tail;
-    unsigned long length;
-    int level;
-    int maxlevel;
-} skiplist;
-
-typedef struct skiplistiter {
-    skiplist *parent;
-    skiplistNode *node;
-    int forward;
-    double min;
-    double max;
-} skiplistiter;
+#define SL_CAT_(a, b) a##b
+#define SL_CAT(a, b) SL_CAT_(a, b)
+#define SLT(name) SL_CAT(name, SL_SUFFIX)
+#define SL(name) SL_CAT(SL_CAT(sl, SL_SUFFIX), name)
+
+/* Composite score, e.g. points and then a timestamp. */
+typedef struct slPairScore {
+    double primary;
+    double secondary;
+} slPairScore;
 
 typedef void (*slDeleteCb) (void *ud, void *obj);
-void* slCreateObj(const char* ptr, size_t length);
-void slFreeObj(void *obj);
-
-skiplist *slCreate(int maxlevel);
-void slFree(skiplist *sl);
-void slDump(skiplist *sl);
-
-void slInsert(skiplist *sl, double score, void *obj, int level);
-int slDelete(skiplist *sl, double score, void *obj, double change);
-unsigned long slLength(skiplist *sl);
-unsigned long slDeleteByRank(skiplist *sl, unsigned int start, unsigned int end, slDeleteCb cb, void* ud);
-
-unsigned long slGetRank(skiplist *sl, double score, void *o);
-skiplistNode* slGetNodeByRank(skiplistNode* x, int level, unsigned long rank);
-skiplistNode *slFirstInRange(skiplist *sl, double min, double max);
-skiplistNode *slLastInRange(skiplist *sl, double min, double max);
-
-skiplistiter *slIterNew(skiplist *sl, skiplistNode* head);
-skiplistiter* slIterNewFromHead(skiplist *sl);
-skiplistiter *slIterNewFromRange(skiplist *sl, double min, double max);
-void slIterDel(skiplistiter *it);
-int slIterGet(skiplistiter *it, double *score, const void **obj);
-int slIterNext(skiplistiter *it);
+
+/* Orders objects with equal scores: returns a negative, zero or positive
+ * value like strcmp(). Objects that compare equal are ordered by
+ * address. Lists created without a comparator use the address only. */
+typedef int (*slCompareFn) (const void *a, const void *b, void *ud);
+
+/* Hot-path instrumentation. The counting code is only compiled in with
+ * SKIPLIST_COUNTERS defined, and a list only counts once enabled with
+ * slEnableCounters(). Steps are the forward moves taken by a search;
+ * latency bucket i counts operations that took [2^i, 2^(i+1))
+ * nanoseconds (bucket 0 includes anything faster). */
+enum { SL_OP_INSERT, SL_OP_DELETE, SL_OP_RANK, SL_OP_RANGE, SL_OPS };
+
+#define SL_LATENCY_BUCKETS 32
+
+typedef struct slCounters {
+    unsigned long calls[SL_OPS];
+    unsigned long steps[SL_OPS];
+    unsigned long latency[SL_OPS][SL_LATENCY_BUCKETS];
+    unsigned long allocs;       /* nodes allocated */
+    unsigned long frees;        /* nodes freed */
+    unsigned long inplace;      /* score changes that kept their node */
+    unsigned long relinks;      /* score changes that deleted the node */
+} slCounters;
+
+#define SL_SCORE double
+#define SL_SUFFIX
+#include "skiplist_tmpl.h"
+
+#define SL_SCORE int64_t
+#define SL_SUFFIX I64
+#include "skiplist_tmpl.h"
+
+#define SL_SCORE slPairScore
+#define SL_SUFFIX Pair
+#include "skiplist_tmpl.h"
+
+int slLevelsFor(unsigned long length, double p, int limit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
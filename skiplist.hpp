@@ -0,0 +1,540 @@
+#ifndef SKIPLIST_HPP
+#define SKIPLIST_HPP
+
+/* Header-only C++ counterpart of the skiplist core (skiplist.h).
+ *
+ * SkipList<Key, Score, Compare, MaxLevel, Allocator> keeps (key, score)
+ * entries ordered by score using Compare, and then by key, and supports
+ * the same rank queries as the C core: insert() and erase() mirror
+ * slInsert() and slDelete(), update() moves an entry to a new score
+ * (in place if its position does not change), rank() and nth() mirror
+ * slGetRank() and slGetNodeByRank(), and lower_bound(), upper_bound()
+ * and range() correspond to the range iterators.
+ *
+ * Nodes are allocated with a height drawn from a geometric
+ * distribution (p = 1/4) and own their entry. The list is move-only;
+ * a moved-from list may only be assigned to or destroyed. */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace skipdict {
+
+template <typename Key,
+          typename Score = double,
+          typename Compare = std::less<Score>,
+          int MaxLevel = 32,
+          typename Allocator = std::allocator<std::pair<Key, Score> > >
+class SkipList {
+    static_assert(MaxLevel >= 1 && MaxLevel <= 64,
+                  "MaxLevel must be in the range 1-64");
+
+    struct Node;
+
+    struct Level {
+        Node *forward;
+        std::size_t span;
+    };
+
+    struct Node {
+        typename std::aligned_storage<sizeof(std::pair<Key, Score>),
+                                      alignof(std::pair<Key, Score>)>::type
+            storage;
+        Node *backward;
+        int height;
+        Level level[1];
+
+        std::pair<Key, Score> &entry() {
+            return *reinterpret_cast<std::pair<Key, Score> *>(&storage);
+        }
+        const std::pair<Key, Score> &entry() const {
+            return *reinterpret_cast<const std::pair<Key, Score> *>(&storage);
+        }
+        const Key &key() const { return entry().first; }
+        const Score &score() const { return entry().second; }
+    };
+
+    typedef typename std::allocator_traits<Allocator>::template
+        rebind_alloc<Node> NodeAllocator;
+    typedef std::allocator_traits<NodeAllocator> NodeTraits;
+
+public:
+    typedef Key key_type;
+    typedef Score score_type;
+    typedef std::pair<Key, Score> value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Compare score_compare;
+    typedef Allocator allocator_type;
+    typedef const value_type &reference;
+    typedef const value_type &const_reference;
+
+    static constexpr int max_level = MaxLevel;
+    static constexpr size_type npos = static_cast<size_type>(-1);
+
+    /* Entries are immutable through an iterator since changing the key
+     * or score would break the ordering; use update() instead. */
+    class const_iterator {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef SkipList::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type *pointer;
+        typedef const value_type &reference;
+
+        const_iterator() : list_(nullptr), node_(nullptr) {}
+
+        reference operator*() const { return node_->entry(); }
+        pointer operator->() const { return &node_->entry(); }
+
+        const_iterator &operator++() {
+            node_ = node_->level[0].forward;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator it = *this;
+            ++*this;
+            return it;
+        }
+        const_iterator &operator--() {
+            node_ = node_ ? node_->backward : list_->tail_;
+            return *this;
+        }
+        const_iterator operator--(int) {
+            const_iterator it = *this;
+            --*this;
+            return it;
+        }
+
+        bool operator==(const const_iterator &other) const {
+            return node_ == other.node_;
+        }
+        bool operator!=(const const_iterator &other) const {
+            return node_ != other.node_;
+        }
+
+    private:
+        friend class SkipList;
+        const_iterator(const SkipList *list, Node *node)
+            : list_(list), node_(node) {}
+
+        const SkipList *list_;
+        Node *node_;
+    };
+
+    typedef const_iterator iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
+
+    explicit SkipList(const Compare &comp = Compare(),
+                      const Allocator &alloc = Allocator(),
+                      std::uint64_t seed = 0x2545f4914f6cdd1dULL)
+        : alloc_(alloc), comp_(comp), header_(nullptr), tail_(nullptr),
+          length_(0), level_(1), state_(seed ? seed : 1) {
+        header_ = createNode(MaxLevel);
+        for (int i = 0; i < MaxLevel; i++) {
+            header_->level[i].forward = nullptr;
+            header_->level[i].span = 0;
+        }
+        header_->backward = nullptr;
+    }
+
+    SkipList(const SkipList &) = delete;
+    SkipList &operator=(const SkipList &) = delete;
+
+    SkipList(SkipList &&other) noexcept
+        : alloc_(std::move(other.alloc_)), comp_(std::move(other.comp_)),
+          header_(other.header_), tail_(other.tail_),
+          length_(other.length_), level_(other.level_),
+          state_(other.state_) {
+        other.header_ = nullptr;
+        other.tail_ = nullptr;
+        other.length_ = 0;
+        other.level_ = 1;
+    }
+
+    SkipList &operator=(SkipList &&other) noexcept {
+        if (this != &other) {
+            destroy();
+            alloc_ = std::move(other.alloc_);
+            comp_ = std::move(other.comp_);
+            header_ = other.header_;
+            tail_ = other.tail_;
+            length_ = other.length_;
+            level_ = other.level_;
+            state_ = other.state_;
+            other.header_ = nullptr;
+            other.tail_ = nullptr;
+            other.length_ = 0;
+            other.level_ = 1;
+        }
+        return *this;
+    }
+
+    ~SkipList() { destroy(); }
+
+    size_type size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    int level() const { return level_; }
+
+    const_iterator begin() const {
+        return const_iterator(this, header_ ? header_->level[0].forward
+                                            : nullptr);
+    }
+    const_iterator end() const { return const_iterator(this, nullptr); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    const_reference front() const {
+        return header_->level[0].forward->entry();
+    }
+    const_reference back() const { return tail_->entry(); }
+
+    /* Insert an entry with a random height. As with slInsert(), the
+     * caller makes sure that the entry is not already in the list. */
+    const_iterator insert(Key key, Score score) {
+        return insert(std::move(key), std::move(score), randomLevel());
+    }
+
+    const_iterator insert(Key key, Score score, int height) {
+        if (height < 1) height = 1;
+        if (height > MaxLevel) height = MaxLevel;
+
+        Node *x = createNode(height);
+        try {
+            ::new (static_cast<void *>(&x->storage))
+                value_type(std::move(key), std::move(score));
+        } catch (...) {
+            freeNode(x);
+            throw;
+        }
+        link(x);
+        return const_iterator(this, x);
+    }
+
+    /* Remove the entry; returns false if it is not in the list. */
+    bool erase(const Key &key, const Score &score) {
+        Node *prev[MaxLevel];
+        Node *x = find(key, score, prev);
+
+        if (!x) return false;
+        unlink(x, prev);
+        destroyNode(x);
+        return true;
+    }
+
+    const_iterator erase(const_iterator pos) {
+        const_iterator next = std::next(pos);
+        erase(pos->first, pos->second);
+        return next;
+    }
+
+    /* Move the entry to a new score. As with slDelete(), the node is
+     * updated in place if it keeps its position; otherwise it is
+     * unlinked and linked again at its new position. */
+    bool update(const Key &key, const Score &score, Score newscore) {
+        Node *prev[MaxLevel];
+        Node *x = find(key, score, prev);
+
+        if (!x) return false;
+        Node *next = x->level[0].forward;
+        if ((!x->backward || before(x->backward, newscore, key)) &&
+            (!next || !before(next, newscore, key))) {
+            x->entry().second = std::move(newscore);
+            return true;
+        }
+        unlink(x, prev);
+        x->entry().second = std::move(newscore);
+        link(x);
+        return true;
+    }
+
+    void clear() {
+        if (!header_) return;
+        Node *x = header_->level[0].forward;
+        while (x) {
+            Node *next = x->level[0].forward;
+            destroyNode(x);
+            x = next;
+        }
+        for (int i = 0; i < MaxLevel; i++) {
+            header_->level[i].forward = nullptr;
+            header_->level[i].span = 0;
+        }
+        tail_ = nullptr;
+        length_ = 0;
+        level_ = 1;
+    }
+
+    /* The 0-based rank of the entry, or npos if it is not in the list. */
+    size_type rank(const Key &key, const Score &score) const {
+        Node *x = header_;
+        size_type rank = 0;
+
+        for (int i = level_ - 1; i >= 0; i--) {
+            while (x->level[i].forward &&
+                   !after(x->level[i].forward, score, key)) {
+                rank += x->level[i].span;
+                x = x->level[i].forward;
+            }
+            if (x != header_ && equal(x, score, key)) {
+                return rank - 1;
+            }
+        }
+        return npos;
+    }
+
+    /* The entry at the given 0-based rank, or end(). */
+    const_iterator nth(size_type index) const {
+        Node *x = header_;
+        size_type traversed = 0;
+
+        if (index >= length_) return end();
+        for (int i = level_ - 1; i >= 0; i--) {
+            while (x->level[i].forward &&
+                   traversed + x->level[i].span <= index + 1) {
+                traversed += x->level[i].span;
+                x = x->level[i].forward;
+            }
+            if (traversed == index + 1) {
+                return const_iterator(this, x);
+            }
+        }
+        return end();
+    }
+
+    /* The number of entries with a score less than the given one. */
+    size_type count_less(const Score &score) const {
+        Node *x = header_;
+        size_type rank = 0;
+
+        for (int i = level_ - 1; i >= 0; i--) {
+            while (x->level[i].forward &&
+                   comp_(x->level[i].forward->score(), score)) {
+                rank += x->level[i].span;
+                x = x->level[i].forward;
+            }
+        }
+        return rank;
+    }
+
+    /* The first entry with a score not less than the given one. */
+    const_iterator lower_bound(const Score &score) const {
+        Node *x = header_;
+
+        for (int i = level_ - 1; i >= 0; i--) {
+            while (x->level[i].forward &&
+                   comp_(x->level[i].forward->score(), score)) {
+                x = x->level[i].forward;
+            }
+        }
+        return const_iterator(this, x->level[0].forward);
+    }
+
+    /* The first entry with a score greater than the given one. */
+    const_iterator upper_bound(const Score &score) const {
+        Node *x = header_;
+
+        for (int i = level_ - 1; i >= 0; i--) {
+            while (x->level[i].forward &&
+                   !comp_(score, x->level[i].forward->score())) {
+                x = x->level[i].forward;
+            }
+        }
+        return const_iterator(this, x->level[0].forward);
+    }
+
+    /* The entries with min <= score <= max, in order. Iterate the
+     * returned range backwards for the reverse direction. */
+    std::pair<const_iterator, const_iterator>
+    range(const Score &min, const Score &max) const {
+        if (comp_(max, min)) return std::make_pair(end(), end());
+        return std::make_pair(lower_bound(min), upper_bound(max));
+    }
+
+    score_compare score_comp() const { return comp_; }
+    allocator_type get_allocator() const { return allocator_type(alloc_); }
+
+private:
+    /* Entries are ordered by score and then by key. */
+    bool before(const Node *x, const Score &score, const Key &key) const {
+        return comp_(x->score(), score) ||
+            (!comp_(score, x->score()) && x->key() < key);
+    }
+
+    bool after(const Node *x, const Score &score, const Key &key) const {
+        return comp_(score, x->score()) ||
+            (!comp_(x->score(), score) && key < x->key());
+    }
+
+    bool equal(const Node *x, const Score &score, const Key &key) const {
+        return !before(x, score, key) && !after(x, score, key);
+    }
+
+    int randomLevel() {
+        /* xorshift64 */
+        std::uint64_t x = state_;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        state_ = x;
+
+        int level = 1;
+        while ((x & 0xffff) < (0xffff / 4) && level < MaxLevel) {
+            level++;
+            x >>= 16;
+            if (!x) break;
+        }
+        return level;
+    }
+
+    static size_type nodeUnits(int height) {
+        size_type bytes = sizeof(Node) + (height - 1) * sizeof(Level);
+        return (bytes + sizeof(Node) - 1) / sizeof(Node);
+    }
+
+    Node *createNode(int height) {
+        Node *x = NodeTraits::allocate(alloc_, nodeUnits(height));
+        x->height = height;
+        return x;
+    }
+
+    void freeNode(Node *x) {
+        NodeTraits::deallocate(alloc_, x, nodeUnits(x->height));
+    }
+
+    void destroyNode(Node *x) {
+        x->entry().~value_type();
+        freeNode(x);
+    }
+
+    void destroy() {
+        if (!header_) return;
+        clear();
+        freeNode(header_);
+        header_ = nullptr;
+    }
+
+    Node *find(const Key &key, const Score &score, Node **update) const {
+        Node *x = header_;
+
+        for (int i = level_ - 1; i >= 0; i--) {
+            while (x->level[i].forward &&
+                   before(x->level[i].forward, score, key)) {
+                x = x->level[i].forward;
+            }
+            update[i] = x;
+        }
+        x = x->level[0].forward;
+        if (x && equal(x, score, key)) return x;
+        return nullptr;
+    }
+
+    /* Link the node at its position, as slInsert() in the C core. */
+    void link(Node *x) {
+        const Score &score = x->score();
+        const Key &key = x->key();
+        int height = x->height;
+        Node *update[MaxLevel];
+        size_type rank[MaxLevel];
+        int i;
+
+        Node *p = header_;
+        for (i = level_ - 1; i >= 0; i--) {
+            /* store rank that is crossed to reach the insert position */
+            rank[i] = i == (level_ - 1) ? 0 : rank[i + 1];
+            while (p->level[i].forward &&
+                   before(p->level[i].forward, score, key)) {
+                rank[i] += p->level[i].span;
+                p = p->level[i].forward;
+            }
+            update[i] = p;
+        }
+        if (height > level_) {
+            for (i = level_; i < height; i++) {
+                rank[i] = 0;
+                update[i] = header_;
+                update[i]->level[i].span = length_;
+            }
+            level_ = height;
+        }
+        for (i = 0; i < height; i++) {
+            x->level[i].forward = update[i]->level[i].forward;
+            update[i]->level[i].forward = x;
+
+            /* update span covered by update[i] as x is inserted here */
+            x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+            update[i]->level[i].span = (rank[0] - rank[i]) + 1;
+        }
+
+        /* increment span for untouched levels */
+        for (i = height; i < level_; i++) {
+            update[i]->level[i].span++;
+        }
+
+        x->backward = (update[0] == header_) ? nullptr : update[0];
+        if (x->level[0].forward) {
+            x->level[0].forward->backward = x;
+        } else {
+            tail_ = x;
+        }
+        length_++;
+    }
+
+
+    /* Internal function used by erase() and update(), as
+     * slDeleteNode() in the C core. */
+    void unlink(Node *x, Node **update) {
+        int i;
+        for (i = 0; i < level_; i++) {
+            if (update[i]->level[i].forward == x) {
+                update[i]->level[i].span += x->level[i].span - 1;
+                update[i]->level[i].forward = x->level[i].forward;
+            } else {
+                update[i]->level[i].span -= 1;
+            }
+        }
+        if (x->level[0].forward) {
+            x->level[0].forward->backward = x->backward;
+        } else {
+            tail_ = x->backward;
+        }
+        while (level_ > 1 && header_->level[level_ - 1].forward == nullptr)
+            level_--;
+        length_--;
+    }
+
+    NodeAllocator alloc_;
+    Compare comp_;
+    Node *header_;
+    Node *tail_;
+    size_type length_;
+    int level_;
+    std::uint64_t state_;
+};
+
+template <typename Key, typename Score, typename Compare, int MaxLevel,
+          typename Allocator>
+constexpr int SkipList<Key, Score, Compare, MaxLevel, Allocator>::max_level;
+
+template <typename Key, typename Score, typename Compare, int MaxLevel,
+          typename Allocator>
+constexpr typename
+    SkipList<Key, Score, Compare, MaxLevel, Allocator>::size_type
+    SkipList<Key, Score, Compare, MaxLevel, Allocator>::npos;
+
+} // namespace skipdict
+
+#endif
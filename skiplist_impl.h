@@ -0,0 +1,1364 @@
+/* Definitions for one score type; see skiplist.h. The includer
+ * defines SL_SCORE and SL_SUFFIX as well as SL_LESS() and SL_EQ() to
+ * compare two scores, and SL_WEIGHT() to give the weight of a score
+ * for slGetNodeByWeight(). */
+
+/* Objects with equal scores are ordered by the list's comparator if it
+ * has one, and then by address. */
+static inline int SL(ObjLess)(const SLT(skiplist) *sl, const void *a,
+                              const void *b) {
+    if (sl->compare) {
+        int c = sl->compare(a, b, sl->compareData);
+        if (c) return c < 0;
+    }
+    return a < b;
+}
+
+#define SL_BEFORE(x, s, o) \
+    (SL_LESS((x)->score, s) || \
+     (SL_EQ((x)->score, s) && SL(ObjLess)(sl, (x)->obj, (o))))
+
+#define SL_NODE_SIZE(level) \
+    (sizeof(SLT(skiplistNode)) + (level) * sizeof(struct SLT(skiplistLevel)))
+
+static inline int SL(InSlab)(const SLT(skiplist) *sl,
+                             const SLT(skiplistNode) *x) {
+    return sl->slab && (uintptr_t) x >= (uintptr_t) sl->slab &&
+        (uintptr_t) x < (uintptr_t) sl->slab + sl->slabSize;
+}
+
+SLT(skiplistNode) *SL(CreateNode)(int level, SL_SCORE score, void *obj) {
+    SLT(skiplistNode) *n = calloc(1, SL_NODE_SIZE(level));
+    if (!n) return NULL;
+    n->score = score;
+    n->obj = obj;
+    return n;
+}
+
+SLT(skiplist) *SL(Create)(int maxlevel) {
+    return SL(CreateWithCompare)(maxlevel, NULL, NULL);
+}
+
+SLT(skiplist) *SL(CreateWithCompare)(int maxlevel, slCompareFn compare,
+                                     void *ud) {
+    int j;
+    SLT(skiplist) *sl;
+    SL_SCORE zero;
+
+    memset(&zero, 0, sizeof(zero));
+    sl = malloc(sizeof(*sl));
+    if (!sl) return NULL;
+    sl->level = 1;
+    sl->maxlevel = maxlevel;
+    sl->length = 0;
+    sl->weight = 0.0;
+    sl->compare = compare;
+    sl->compareData = ud;
+    sl->counters = NULL;
+    sl->slab = NULL;
+    sl->slabSize = sl->slabFree = 0;
+    sl->slabLive = 0;
+    sl->levels = calloc(maxlevel, sizeof(unsigned long));
+    sl->header = SL(CreateNode)(maxlevel, zero, NULL);
+    if (!sl->levels || !sl->header) {
+        free(sl->levels);
+        free(sl->header);
+        free(sl);
+        return NULL;
+    }
+    for (j=0; j < maxlevel; j++) {
+        sl->header->level[j].forward = NULL;
+        sl->header->level[j].span = 0;
+        sl->header->level[j].weight = 0.0;
+    }
+    sl->header->backward = NULL;
+    sl->tail = NULL;
+    return sl;
+}
+
+void SL(Free)(SLT(skiplist) *sl) {
+    SLT(skiplistNode) *node = sl->header->level[0].forward, *next;
+
+    free(sl->header);
+    while(node) {
+        next = node->level[0].forward;
+        if (!SL(InSlab)(sl, node)) free(node);
+        node = next;
+    }
+    free(sl->slab);
+    free(sl->levels);
+    free(sl->counters);
+    free(sl);
+}
+
+/* Changes the number of levels of the header, that is, the largest
+ * node height, to maxlevel or the current level if higher. Returns -1
+ * if out of memory, in which case the list is unchanged. */
+int SL(Resize)(SLT(skiplist) *sl, int maxlevel) {
+    SLT(skiplistNode) *header;
+    unsigned long *levels;
+    int i;
+
+    if (maxlevel < sl->level) maxlevel = sl->level;
+    if (maxlevel == sl->maxlevel) return 0;
+
+    /* When shrinking, a failed reallocation keeps the larger block. */
+    levels = realloc(sl->levels, maxlevel * sizeof(unsigned long));
+    if (levels) sl->levels = levels;
+    else if (maxlevel > sl->maxlevel) return -1;
+    header = realloc(sl->header, sizeof(*header) +
+                     maxlevel * sizeof(struct SLT(skiplistLevel)));
+    if (header) sl->header = header;
+    else if (maxlevel > sl->maxlevel) return -1;
+
+    for (i = sl->maxlevel; i < maxlevel; i++) {
+        sl->levels[i] = 0;
+        sl->header->level[i].forward = NULL;
+        sl->header->level[i].span = 0;
+        sl->header->level[i].weight = 0.0;
+    }
+    sl->maxlevel = maxlevel;
+    return 0;
+}
+
+/* Recomputes the weight of the link leaving x at level i from the links
+ * it spans one level down, which must be up to date. Adjusting weights
+ * by differences instead would leave the rounding error of a large score
+ * in every link that once spanned it. */
+static void SL(Reweigh)(SLT(skiplistNode) *x, int i) {
+    SLT(skiplistNode) *y, *end = x->level[i].forward;
+    double sum = 0.0;
+
+    if (i == 0) {
+        x->level[0].weight = end ? SL_WEIGHT(end->score) : 0.0;
+        return;
+    }
+    for (y = x; y != end; y = y->level[i-1].forward)
+        sum += y->level[i-1].weight;
+    x->level[i].weight = sum;
+}
+
+/* Recomputes the links on an update path, bottom-up, and the total. */
+static void SL(ReweighPath)(SLT(skiplist) *sl, SLT(skiplistNode) *x,
+                            int height, SLT(skiplistNode) **update) {
+    SLT(skiplistNode) *y;
+    double sum = 0.0;
+    int i;
+
+    for (i = 0; i < sl->level; i++) {
+        if (i < height) SL(Reweigh)(x, i);
+        SL(Reweigh)(update[i], i);
+    }
+    for (y = sl->header; y; y = y->level[sl->level-1].forward)
+        sum += y->level[sl->level-1].weight;
+    sl->weight = sum;
+}
+
+/* Returns the new node, or NULL if it cannot be allocated, leaving the
+ * list unchanged. */
+SLT(skiplistNode) *SL(Insert)(SLT(skiplist) *sl, SL_SCORE score, void *obj,
+                              int level) {
+    SLT(skiplistNode) *update[sl->maxlevel], *x;
+    unsigned int rank[sl->maxlevel];
+    int i;
+    SL_OP_BEGIN(sl);
+
+    x = sl->header;
+    for (i = sl->level-1; i >= 0; i--) {
+        /* store rank that is crossed to reach the insert position */
+        rank[i] = i == (sl->level-1) ? 0 : rank[i+1];
+        while (x->level[i].forward &&
+               SL_BEFORE(x->level[i].forward, score, obj)) {
+            SL_STEP();
+            rank[i] += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+    /* we assume the key is not already inside, since we allow duplicated
+     * scores, and the re-insertion of score and object should never
+     * happen since the caller of slInsert() should test in the hash table
+     * if the element is already inside or not. */
+    if (level < 1) level = 1;
+    x = SL(CreateNode)(level, score, obj);
+    if (!x) {
+        SL_OP_END(sl, SL_OP_INSERT);
+        return NULL;
+    }
+    SL_COUNT(sl, allocs, 1);
+    if (level > sl->level) {
+        for (i = sl->level; i < level; i++) {
+            rank[i] = 0;
+            update[i] = sl->header;
+            update[i]->level[i].span = sl->length;
+        }
+        sl->level = level;
+    }
+    sl->levels[level-1]++;
+    for (i = 0; i < level; i++) {
+        x->level[i].forward = update[i]->level[i].forward;
+        update[i]->level[i].forward = x;
+
+        /* update span covered by update[i] as x is inserted here */
+        x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+        update[i]->level[i].span = (rank[0] - rank[i]) + 1;
+    }
+
+    /* increment span for untouched levels */
+    for (i = level; i < sl->level; i++) {
+        update[i]->level[i].span++;
+    }
+    SL(ReweighPath)(sl, x, level, update);
+
+    x->backward = (update[0] == sl->header) ? NULL : update[0];
+    if (x->level[0].forward) {
+        x->level[0].forward->backward = x;
+    } else {
+        sl->tail = x;
+    }
+    sl->length++;
+    SL_OP_END(sl, SL_OP_INSERT);
+    return x;
+}
+
+typedef struct SLT(slWork) {
+    SLT(skiplist) *sl;
+    SLT(slEntry) *src, *dst;
+    unsigned long lo, mid, hi;
+    double p;
+    unsigned long seed;
+    int level;
+    int err;
+    SLT(skiplistNode) **first, **last;
+    unsigned long *firstrank, *lastrank;
+    double *firstweight, *lastweight;   /* from the start of the range */
+    double weight;
+    unsigned long *counts;
+} SLT(slWork);
+
+static int SL(EntryCompare)(const SLT(skiplist) *sl, const SLT(slEntry) *x,
+                            const SLT(slEntry) *y) {
+    if (SL_LESS(x->score, y->score)) return -1;
+    if (SL_LESS(y->score, x->score)) return 1;
+    if (SL(ObjLess)(sl, x->obj, y->obj)) return -1;
+    return SL(ObjLess)(sl, y->obj, x->obj);
+}
+
+/* The default order (by score and address), for qsort(). */
+static int SL(EntryCompareDefault)(const void *a, const void *b) {
+    const SLT(slEntry) *x = a, *y = b;
+    if (SL_LESS(x->score, y->score)) return -1;
+    if (SL_LESS(y->score, x->score)) return 1;
+    if (x->obj < y->obj) return -1;
+    return x->obj > y->obj;
+}
+
+/* Sort a[lo, hi) using tmp as scratch space. This is used instead of
+ * qsort() when the list has a comparator, which needs its context. */
+static void SL(MergeSort)(const SLT(skiplist) *sl, SLT(slEntry) *a,
+                          SLT(slEntry) *tmp, unsigned long lo,
+                          unsigned long hi) {
+    unsigned long mid, i, j, k;
+
+    if (hi - lo < 2) return;
+    mid = lo + (hi - lo) / 2;
+    SL(MergeSort)(sl, a, tmp, lo, mid);
+    SL(MergeSort)(sl, a, tmp, mid, hi);
+    i = lo; j = mid; k = lo;
+    while (i < mid && j < hi)
+        tmp[k++] = SL(EntryCompare)(sl, &a[j], &a[i]) < 0 ? a[j++] : a[i++];
+    while (i < mid)
+        tmp[k++] = a[i++];
+    while (j < hi)
+        tmp[k++] = a[j++];
+    memcpy(a + lo, tmp + lo, (hi - lo) * sizeof(*a));
+}
+
+static void *SL(SortWork)(void *arg) {
+    SLT(slWork) *w = arg;
+    if (w->sl->compare)
+        SL(MergeSort)(w->sl, w->src, w->dst, w->lo, w->hi);
+    else
+        qsort(w->src + w->lo, w->hi - w->lo, sizeof(SLT(slEntry)),
+              SL(EntryCompareDefault));
+    return NULL;
+}
+
+static void *SL(MergeWork)(void *arg) {
+    SLT(slWork) *w = arg;
+    unsigned long i = w->lo, j = w->mid, k = w->lo;
+
+    while (i < w->mid && j < w->hi)
+        w->dst[k++] = SL(EntryCompare)(w->sl, &w->src[j], &w->src[i]) < 0 ? \
+            w->src[j++] : w->src[i++];
+    while (i < w->mid)
+        w->dst[k++] = w->src[i++];
+    while (j < w->hi)
+        w->dst[k++] = w->src[j++];
+    return NULL;
+}
+
+/* Sort the entries using one chunk per thread and then merging the
+ * chunks pairwise. Returns -1 if out of memory. */
+static int SL(SortEntries)(SLT(skiplist) *sl, SLT(slEntry) *entries,
+                           unsigned long n, int threads) {
+    SLT(slWork) work[threads];
+    unsigned long bounds[threads + 1];
+    SLT(slEntry) *buf, *src = entries, *dst;
+    int i, chunks = threads, step;
+
+    if (threads < 2 && !sl->compare) {
+        qsort(entries, n, sizeof(SLT(slEntry)), SL(EntryCompareDefault));
+        return 0;
+    }
+
+    buf = malloc(n * sizeof(SLT(slEntry)));
+    if (!buf) return -1;
+    dst = buf;
+
+    if (threads < 2) {
+        SL(MergeSort)(sl, entries, buf, 0, n);
+        free(buf);
+        return 0;
+    }
+
+    for (i = 0; i <= threads; i++)
+        bounds[i] = n * i / threads;
+    for (i = 0; i < threads; i++) {
+        work[i].sl = sl;
+        work[i].src = entries;
+        work[i].dst = buf;
+        work[i].lo = bounds[i];
+        work[i].hi = bounds[i + 1];
+    }
+    slRunWork(SL(SortWork), work, sizeof(work[0]), threads);
+
+    for (step = 1; step < chunks; step *= 2) {
+        int merges = 0;
+        for (i = 0; i < chunks; i += 2 * step) {
+            work[merges].sl = sl;
+            work[merges].src = src;
+            work[merges].dst = dst;
+            work[merges].lo = bounds[i];
+            work[merges].mid = bounds[i + step < chunks ? i + step : chunks];
+            work[merges].hi = bounds[i + 2 * step < chunks ? i + 2 * step : chunks];
+            merges++;
+        }
+        slRunWork(SL(MergeWork), work, sizeof(work[0]), merges);
+        SWAP(src, dst, SLT(slEntry) *);
+    }
+
+    if (src != entries)
+        memcpy(entries, src, n * sizeof(SLT(slEntry)));
+    free(buf);
+    return 0;
+}
+
+static void *SL(LinkWork)(void *arg) {
+    SLT(slWork) *w = arg;
+    SLT(skiplistNode) *x, *prev = NULL;
+    unsigned long i, rank;
+    double weight = 0.0;
+    int j, level;
+
+    for (i = w->lo; i < w->hi; i++) {
+        rank = i + 1;
+        weight += SL_WEIGHT(w->src[i].score);
+        level = slLevelAt(w->seed, rank, w->p, w->sl->maxlevel);
+        x = SL(CreateNode)(level, w->src[i].score, w->src[i].obj);
+        if (!x) {
+            w->err = -1;
+            return NULL;
+        }
+        w->counts[level-1]++;
+        x->backward = prev;
+        for (j = 0; j < level; j++) {
+            if (w->last[j]) {
+                w->last[j]->level[j].forward = x;
+                w->last[j]->level[j].span = rank - w->lastrank[j];
+                w->last[j]->level[j].weight = weight - w->lastweight[j];
+            } else {
+                w->first[j] = x;
+                w->firstrank[j] = rank;
+                w->firstweight[j] = weight;
+            }
+            w->last[j] = x;
+            w->lastrank[j] = rank;
+            w->lastweight[j] = weight;
+        }
+        if (level > w->level)
+            w->level = level;
+        prev = x;
+    }
+    w->weight = weight;
+    return NULL;
+}
+
+/* Link sorted entries into an empty list, using up to the given number
+ * of threads. Returns -1 if out of memory, in which case the list is
+ * left empty. */
+int SL(BulkLoad)(SLT(skiplist) *sl, SLT(slEntry) *entries, unsigned long n,
+               double p, unsigned long seed, int threads) {
+    SLT(skiplistNode) *update[sl->maxlevel], *x, *next;
+    unsigned long rank[sl->maxlevel];
+    double weight[sl->maxlevel], base = 0.0;
+    int i, j, err = 0;
+
+    if (threads < 1 || n < (unsigned long) threads)
+        threads = 1;
+
+    if (SL(SortEntries)(sl, entries, n, threads))
+        return -1;
+
+    SLT(slWork) work[threads];
+    SLT(skiplistNode) **nodes = calloc(2 * threads * sl->maxlevel, sizeof(*nodes));
+    unsigned long *ranks = calloc(3 * threads * sl->maxlevel, sizeof(*ranks));
+    double *weights = calloc(2 * threads * sl->maxlevel, sizeof(*weights));
+    if (!nodes || !ranks || !weights) {
+        free(nodes);
+        free(ranks);
+        free(weights);
+        return -1;
+    }
+
+    for (i = 0; i < threads; i++) {
+        work[i].sl = sl;
+        work[i].src = entries;
+        work[i].lo = n * i / threads;
+        work[i].hi = n * (i + 1) / threads;
+        work[i].p = p;
+        work[i].seed = seed;
+        work[i].level = 0;
+        work[i].err = 0;
+        work[i].first = nodes + 2 * i * sl->maxlevel;
+        work[i].last = work[i].first + sl->maxlevel;
+        work[i].firstrank = ranks + 2 * i * sl->maxlevel;
+        work[i].lastrank = work[i].firstrank + sl->maxlevel;
+        work[i].firstweight = weights + 2 * i * sl->maxlevel;
+        work[i].lastweight = work[i].firstweight + sl->maxlevel;
+        work[i].counts = ranks + (2 * threads + i) * sl->maxlevel;
+    }
+    slRunWork(SL(LinkWork), work, sizeof(work[0]), threads);
+
+    /* Stitch the ranges together. The weights in each range are from
+     * its start, which is at base in the list. */
+    for (j = 0; j < sl->maxlevel; j++) {
+        update[j] = sl->header;
+        rank[j] = 0;
+        weight[j] = 0.0;
+    }
+    for (i = 0; i < threads; i++) {
+        err |= work[i].err;
+        for (j = 0; j < sl->maxlevel; j++)
+            sl->levels[j] += work[i].counts[j];
+        if (work[i].level > sl->level)
+            sl->level = work[i].level;
+        for (j = 0; j < work[i].level; j++) {
+            if (!work[i].first[j]) continue;
+            update[j]->level[j].forward = work[i].first[j];
+            update[j]->level[j].span = work[i].firstrank[j] - rank[j];
+            update[j]->level[j].weight =
+                base + work[i].firstweight[j] - weight[j];
+            if (j == 0)
+                work[i].first[0]->backward = \
+                    (update[0] == sl->header) ? NULL : update[0];
+            update[j] = work[i].last[j];
+            rank[j] = work[i].lastrank[j];
+            weight[j] = base + work[i].lastweight[j];
+        }
+        base += work[i].weight;
+    }
+    for (j = 0; j < sl->level; j++) {
+        update[j]->level[j].forward = NULL;
+        update[j]->level[j].span = n - rank[j];
+        update[j]->level[j].weight = base - weight[j];
+    }
+    sl->tail = (update[0] == sl->header) ? NULL : update[0];
+    sl->length = n;
+    sl->weight = base;
+    if (!err) SL_COUNT(sl, allocs, n);
+
+    free(nodes);
+    free(ranks);
+    free(weights);
+
+    if (err) {
+        x = sl->header->level[0].forward;
+        while (x) {
+            next = x->level[0].forward;
+            free(x);
+            x = next;
+        }
+        for (j = 0; j < sl->maxlevel; j++) {
+            sl->header->level[j].forward = NULL;
+            sl->header->level[j].span = 0;
+            sl->header->level[j].weight = 0.0;
+            sl->levels[j] = 0;
+        }
+        sl->level = 1;
+        sl->length = 0;
+        sl->weight = 0.0;
+        sl->tail = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Internal function used by slDelete, slDeleteByScore. Returns the
+ * height of the node. */
+int SL(DeleteNode)(SLT(skiplist) *sl, SLT(skiplistNode) *x, SLT(skiplistNode) **update) {
+    int i, height = 0;
+    for (i = 0; i < sl->level; i++) {
+        if (update[i]->level[i].forward == x) {
+            update[i]->level[i].span += x->level[i].span - 1;
+            update[i]->level[i].forward = x->level[i].forward;
+            height = i + 1;
+        } else {
+            update[i]->level[i].span -= 1;
+        }
+    }
+    if (x->level[0].forward) {
+        x->level[0].forward->backward = x->backward;
+    } else {
+        sl->tail = x->backward;
+    }
+    sl->levels[height-1]--;
+    while(sl->level > 1 && sl->header->level[sl->level-1].forward == NULL)
+        sl->level--;
+    sl->length--;
+    SL(ReweighPath)(sl, x, 0, update);
+    return height;
+}
+
+/* Frees a node unlinked by slDeleteNode(). Nodes in the slab stay in
+ * place until all of them are gone. */
+static void SL(FreeNode)(SLT(skiplist) *sl, SLT(skiplistNode) *x, int height) {
+    if (!SL(InSlab)(sl, x)) {
+        free(x);
+        return;
+    }
+    sl->slabFree += SL_NODE_SIZE(height);
+    if (--sl->slabLive == 0) {
+        free(sl->slab);
+        sl->slab = NULL;
+        sl->slabSize = sl->slabFree = 0;
+    }
+}
+
+/* Delete an element with matching score/object from the skiplist. */
+int SL(Delete)(SLT(skiplist) *sl, SL_SCORE score, void *obj,
+               const SL_SCORE *newscore) {
+    SLT(skiplistNode) *update[sl->maxlevel], *x, *y;
+    int i;
+    SL_OP_BEGIN(sl);
+
+    x = sl->header;
+    for (i = sl->level-1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               SL_BEFORE(x->level[i].forward, score, obj)) {
+            SL_STEP();
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+    /* We may have multiple elements with the same score, what we need
+     * is to find the element with both the right score and object. */
+    x = x->level[0].forward;
+    if (x && SL_EQ(score, x->score) && x->obj == obj) {
+        /* The score is updated in place if the node stays put. */
+        if (newscore) {
+            y = x->level[0].forward;
+            if ((!x->backward || SL_BEFORE(x->backward, *newscore, obj)) &&
+                (!y || !SL_BEFORE(y, *newscore, obj))) {
+                /* Every link on the path spans the node. */
+                x->score = *newscore;
+                SL(ReweighPath)(sl, x, 0, update);
+                SL_COUNT(sl, inplace, 1);
+                SL_OP_END(sl, SL_OP_DELETE);
+                return 2;
+            }
+            SL_COUNT(sl, relinks, 1);
+        }
+        SL(FreeNode)(sl, x, SL(DeleteNode)(sl, x, update));
+        SL_COUNT(sl, frees, 1);
+        SL_OP_END(sl, SL_OP_DELETE);
+        return 1;
+    }
+    SL_OP_END(sl, SL_OP_DELETE);
+    return 0; /* not found */
+}
+
+/* Delete all the elements with rank between start and end from the skiplist.
+ * Start and end are inclusive. Note that start and end need to be 1-based */
+unsigned long SL(DeleteByRank)(SLT(skiplist) *sl, unsigned int start, unsigned int end, slDeleteCb cb, void* ud) {
+    SLT(skiplistNode) *update[sl->maxlevel], *x;
+    unsigned long traversed = 0, removed = 0;
+    int i;
+
+    x = sl->header;
+    for (i = sl->level-1; i >= 0; i--) {
+        while (x->level[i].forward && (traversed + x->level[i].span) < start) {
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+
+    traversed++;
+    x = x->level[0].forward;
+    while (x && traversed <= end) {
+        SLT(skiplistNode) *next = x->level[0].forward;
+        int height = SL(DeleteNode)(sl,x,update);
+        cb(ud, x->obj);
+        SL(FreeNode)(sl, x, height);
+        removed++;
+        traversed++;
+        x = next;
+    }
+    SL_COUNT(sl, frees, removed);
+    return removed;
+}
+
+/* Delete the given entries, which are sorted in place. Unless there are
+ * only a few, this takes one sweep along the bottom level rather than
+ * a descent per entry, keeping the last node linked at each level as
+ * the predecessor for unlinking the next one. Entries that are not in
+ * the list are ignored. Returns the number of nodes deleted. */
+unsigned long SL(DeleteMany)(SLT(skiplist) *sl, SLT(slEntry) *entries,
+                             unsigned long n) {
+    SLT(skiplistNode) *update[sl->maxlevel], *x, *next;
+    unsigned long i, j = 0, removed = 0;
+    int k;
+
+    if (n * sl->level < sl->length || SL(SortEntries)(sl, entries, n, 1)) {
+        for (i = 0; i < n; i++)
+            removed += SL(Delete)(sl, entries[i].score, entries[i].obj, NULL);
+        return removed;
+    }
+
+    SL_OP_BEGIN(sl);
+    for (k = 0; k < sl->level; k++)
+        update[k] = sl->header;
+    for (x = sl->header->level[0].forward; x && j < n; x = next) {
+        SL_STEP();
+        next = x->level[0].forward;
+        /* Skip the entries that come before the node. */
+        while (j < n && !SL_BEFORE(x, entries[j].score, entries[j].obj) &&
+               x->obj != entries[j].obj)
+            j++;
+        if (j < n && x->obj == entries[j].obj &&
+            SL_EQ(x->score, entries[j].score)) {
+            SL(FreeNode)(sl, x, SL(DeleteNode)(sl, x, update));
+            removed++;
+            j++;
+            continue;
+        }
+        /* The node is linked at each level where it follows update. */
+        for (k = 0; k < sl->level && update[k]->level[k].forward == x; k++)
+            update[k] = x;
+    }
+    SL_COUNT(sl, frees, removed);
+    SL_OP_END(sl, SL_OP_DELETE);
+    return removed;
+}
+
+/* Find the rank for an element by both score and key.
+ * Returns 0 when the element cannot be found, rank otherwise.
+ * Note that the rank is 1-based due to the span of sl->header to the
+ * first element. */
+unsigned long SL(GetRank)(SLT(skiplist) *sl, SL_SCORE score, void *obj) {
+    SLT(skiplistNode) *x;
+    unsigned long rank = 0;
+    int i;
+    SL_OP_BEGIN(sl);
+
+    x = sl->header;
+    for (i = sl->level-1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               (SL_BEFORE(x->level[i].forward, score, obj) ||
+                (SL_EQ(x->level[i].forward->score, score) &&
+                 x->level[i].forward->obj == obj))) {
+            SL_STEP();
+            rank += x->level[i].span;
+            x = x->level[i].forward;
+        }
+
+        /* x might be equal to sl->header, so test if obj is non-NULL */
+        if (x->obj && x->obj == obj) {
+            SL_OP_END(sl, SL_OP_RANK);
+            return rank;
+        }
+    }
+    SL_OP_END(sl, SL_OP_RANK);
+    return 0;
+}
+
+/* Find the ranks of n elements as SL(GetRank) does, storing them in
+ * ranks. Up to SL_GROUP searches descend the list together, each
+ * taking one step per round; the node a search compares against next
+ * is prefetched when it is found, and only read in the next round, so
+ * that the cache misses of the searches in a group overlap. A search
+ * that finishes hands its slot to the next element. */
+void SL(GetRankMany)(SLT(skiplist) *sl, const SL_SCORE *scores,
+                     void *const *objs, unsigned long n,
+                     unsigned long *ranks) {
+    struct {
+        SLT(skiplistNode) *x;
+        unsigned long rank, j;
+        int i;
+    } group[SL_GROUP], *s;
+    SLT(skiplistNode) *y;
+    unsigned long next = 0;
+    int active, k, done;
+
+    for (active = 0; active < SL_GROUP && next < n; active++, next++) {
+        s = &group[active];
+        s->x = sl->header;
+        s->i = sl->level - 1;
+        s->rank = 0;
+        s->j = next;
+        SL_PREFETCH(s->x->level[s->i].forward);
+    }
+
+    while (active) {
+        for (k = 0; k < active; ) {
+            s = &group[k];
+            y = s->x->level[s->i].forward;
+            done = 0;
+            if (y && (SL_BEFORE(y, scores[s->j], objs[s->j]) ||
+                      (SL_EQ(y->score, scores[s->j]) &&
+                       y->obj == objs[s->j]))) {
+                s->rank += s->x->level[s->i].span;
+                s->x = y;
+            } else if (s->x->obj && s->x->obj == objs[s->j]) {
+                ranks[s->j] = s->rank;
+                done = 1;
+            } else if (s->i == 0) {
+                ranks[s->j] = 0;
+                done = 1;
+            } else {
+                s->i--;
+            }
+
+            if (done) {
+                if (next == n) {
+                    group[k] = group[--active];
+                    continue;
+                }
+                s->x = sl->header;
+                s->i = sl->level - 1;
+                s->rank = 0;
+                s->j = next++;
+            }
+            SL_PREFETCH(s->x->level[s->i].forward);
+            k++;
+        }
+    }
+}
+
+/* Count the elements that sort before the score/object pair, whether
+ * or not it is contained in the list. With a NULL object, this is the
+ * number of elements with a score less than the given score. */
+unsigned long SL(CountLess)(SLT(skiplist) *sl, SL_SCORE score, void *obj) {
+    SLT(skiplistNode) *x;
+    unsigned long rank = 0;
+    int i;
+
+    x = sl->header;
+    for (i = sl->level-1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               SL_BEFORE(x->level[i].forward, score, obj)) {
+            rank += x->level[i].span;
+            x = x->level[i].forward;
+        }
+    }
+    return rank;
+}
+
+/* The number of nodes with a score less than the given score (or not
+ * greater, if inclusive), and the sum of their weights. */
+static unsigned long SL(CountBelow)(SLT(skiplist) *sl, SL_SCORE score,
+                                    int inclusive, double *weight) {
+    SLT(skiplistNode) *x = sl->header;
+    unsigned long rank = 0;
+    double traversed = 0.0;
+    int i;
+    SL_OP_BEGIN(sl);
+
+    for (i = sl->level-1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               (SL_LESS(x->level[i].forward->score, score) ||
+                (inclusive && !SL_LESS(score, x->level[i].forward->score)))) {
+            SL_STEP();
+            rank += x->level[i].span;
+            traversed += x->level[i].weight;
+            x = x->level[i].forward;
+        }
+    }
+    SL_OP_END(sl, SL_OP_RANGE);
+    *weight = traversed;
+    return rank;
+}
+
+/* Counts the nodes in each of the n - 1 buckets [edges[i], edges[i+1])
+ * (the last one also includes its upper edge) and, if sums is not
+ * NULL, the sum of their weights. This takes one descent per edge
+ * rather than a scan. Returns -1 if the edges are out of order. */
+int SL(Histogram)(SLT(skiplist) *sl, const SL_SCORE *edges, unsigned long n,
+                  unsigned long *counts, double *sums) {
+    unsigned long i, below, previous = 0;
+    double weight, last = 0.0;
+
+    for (i = 1; i < n; i++)
+        if (SL_LESS(edges[i], edges[i-1])) return -1;
+    for (i = 0; i < n; i++) {
+        below = SL(CountBelow)(sl, edges[i], i > 0 && i == n - 1, &weight);
+        if (i) {
+            counts[i-1] = below - previous;
+            if (sums) sums[i-1] = weight - last;
+        }
+        previous = below;
+        last = weight;
+    }
+    return 0;
+}
+
+/* Finds an element by its rank. The rank argument needs to be 1-based. */
+/* Finds the node at the given rank relative to node, starting from the
+ * given level; node must have at least level + 1 levels (the header
+ * has all of them). */
+SLT(skiplistNode)* SL(GetNodeByRank)(SLT(skiplistNode)* node, int level, unsigned long rank)
+{
+    unsigned long traversed = 0;
+    int i;
+
+    for (i = level; i >= 0; i--) {
+        while (node->level[i].forward && (traversed + node->level[i].span) <= rank)
+        {
+            traversed += node->level[i].span;
+            node = node->level[i].forward;
+        }
+        if (traversed == rank) {
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+/* Finds the first node at which the running sum of the weights,
+ * counting the node itself, exceeds the given weight, or the last node
+ * if none does (the sums may be off by rounding). The weights must not
+ * be negative. Returns NULL if the list is empty. */
+SLT(skiplistNode) *SL(GetNodeByWeight)(SLT(skiplist) *sl, double weight)
+{
+    SLT(skiplistNode) *x = sl->header;
+    double traversed = 0.0;
+    int i;
+
+    for (i = sl->level-1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               traversed + x->level[i].weight <= weight) {
+            traversed += x->level[i].weight;
+            x = x->level[i].forward;
+        }
+    }
+    return x->level[0].forward ? x->level[0].forward : sl->tail;
+}
+
+/* range [min, max], left & right both include */
+/* Returns if there is a part of the dict in range. */
+static int SL(IsInRange)(SLT(skiplist) *sl, SL_SCORE min, SL_SCORE max) {
+    SLT(skiplistNode) *x;
+
+    /* Test for ranges that will always be empty. */
+    if (SL_LESS(max, min)) {
+        return 0;
+    }
+    x = sl->tail;
+    if (x == NULL || SL_LESS(x->score, min))
+        return 0;
+
+    x = sl->header->level[0].forward;
+    if (x == NULL || SL_LESS(max, x->score))
+        return 0;
+    return 1;
+}
+
+/* Find the first node that is contained in the specified range.
+ * Returns NULL when no element is contained in the range. */
+SLT(skiplistNode) *SL(FirstInRange)(SLT(skiplist) *sl, SL_SCORE min, SL_SCORE max) {
+    SLT(skiplistNode) *x;
+    int i;
+    SL_OP_BEGIN(sl);
+
+    /* If everything is out of range, return early. */
+    if (!SL(IsInRange)(sl,min, max)) {
+        SL_OP_END(sl, SL_OP_RANGE);
+        return NULL;
+    }
+
+    x = sl->header;
+    for (i = sl->level-1; i >= 0; i--) {
+        /* Go forward while *OUT* of range. */
+        while (x->level[i].forward &&
+               SL_LESS(x->level[i].forward->score, min)) {
+            SL_STEP();
+            x = x->level[i].forward;
+        }
+    }
+    SL_OP_END(sl, SL_OP_RANGE);
+
+    /* This is an inner range, so the next node cannot be NULL; it may
+     * still be past the end of the range if no node falls inside it. */
+    x = x->level[0].forward;
+    if (SL_LESS(max, x->score)) return NULL;
+    return x;
+}
+
+/* Find the last node that is contained in the specified range.
+ * Returns NULL when no element is contained in the range. */
+SLT(skiplistNode) *SL(LastInRange)(SLT(skiplist) *sl, SL_SCORE min, SL_SCORE max) {
+    SLT(skiplistNode) *x;
+    int i;
+    SL_OP_BEGIN(sl);
+
+    /* If everything is out of range, return early. */
+    if (!SL(IsInRange)(sl, min, max)) {
+        SL_OP_END(sl, SL_OP_RANGE);
+        return NULL;
+    }
+
+    x = sl->header;
+    for (i = sl->level-1; i >= 0; i--) {
+        /* Go forward while *IN* range. */
+        while (x->level[i].forward &&
+            !SL_LESS(max, x->level[i].forward->score)) {
+            SL_STEP();
+            x = x->level[i].forward;
+        }
+    }
+    SL_OP_END(sl, SL_OP_RANGE);
+
+    /* This is an inner range, so this node cannot be NULL; it may
+     * still be before the start of the range if no node falls inside it. */
+    if (SL_LESS(x->score, min)) return NULL;
+    return x;
+}
+
+/* Find the last node with a score not greater than the given score
+ * and its 1-based rank. Returns NULL (and a rank of 0) if there is none. */
+SLT(skiplistNode) *SL(Floor)(SLT(skiplist) *sl, SL_SCORE score,
+                             unsigned long *rank) {
+    SLT(skiplistNode) *x = sl->header;
+    unsigned long traversed = 0;
+    int i;
+    SL_OP_BEGIN(sl);
+
+    for (i = sl->level-1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               !SL_LESS(score, x->level[i].forward->score)) {
+            SL_STEP();
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+    }
+    SL_OP_END(sl, SL_OP_RANGE);
+
+    *rank = traversed;
+    return x == sl->header ? NULL : x;
+}
+
+/* Find the first node with a score not less than the given score and
+ * its 1-based rank. Returns NULL (and a rank of 0) if there is none. */
+SLT(skiplistNode) *SL(Ceiling)(SLT(skiplist) *sl, SL_SCORE score,
+                               unsigned long *rank) {
+    SLT(skiplistNode) *x = sl->header;
+    unsigned long traversed = 0;
+    int i;
+    SL_OP_BEGIN(sl);
+
+    for (i = sl->level-1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               SL_LESS(x->level[i].forward->score, score)) {
+            SL_STEP();
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+    }
+    SL_OP_END(sl, SL_OP_RANGE);
+
+    x = x->level[0].forward;
+    *rank = x ? traversed + 1 : 0;
+    return x;
+}
+
+unsigned long SL(Length)(SLT(skiplist) *sl)
+{
+    return sl->length;
+}
+
+/* Bytes allocated for the list itself; the objects are not included.
+ * Nodes only have as many levels as their height, so this follows from
+ * the number of nodes of each height (and the space left behind by
+ * deleted nodes in the slab). */
+size_t SL(MemoryUsage)(SLT(skiplist) *sl)
+{
+    size_t size = sizeof(*sl) + sl->maxlevel * sizeof(unsigned long) +
+        SL_NODE_SIZE(sl->maxlevel) + sl->slabFree;
+    int i;
+
+    for (i = 0; i < sl->maxlevel; i++)
+        size += sl->levels[i] * SL_NODE_SIZE(i + 1);
+    return size;
+}
+
+/* The number of forward steps taken by a lookup (as in slGetRank) of
+ * each node, summed over all nodes, and the largest such number. This
+ * walks the bottom level once, keeping the steps taken on each level
+ * since the last node that was at least one level higher. */
+void SL(PathStats)(SLT(skiplist) *sl, unsigned long *total,
+                   unsigned long *max)
+{
+    SLT(skiplistNode) *expect[sl->maxlevel], *x;
+    unsigned long run[sl->maxlevel], steps = 0;
+    int i, height;
+
+    *total = *max = 0;
+    for (i = 0; i < sl->level; i++) {
+        expect[i] = sl->header->level[i].forward;
+        run[i] = 0;
+    }
+    for (x = sl->header->level[0].forward; x; x = x->level[0].forward) {
+        for (height = 0; height < sl->level && expect[height] == x; height++)
+            expect[height] = x->level[height].forward;
+        /* Lookups of later nodes pass over x on its top level and
+         * start afresh on the levels below. */
+        for (i = 0; i < height - 1; i++) {
+            steps -= run[i];
+            run[i] = 0;
+        }
+        run[height-1]++;
+        steps++;
+        *total += steps;
+        if (steps > *max) *max = steps;
+    }
+}
+
+/* The height of the node at the given rank in a perfectly balanced
+ * list: one more level for each power of base that divides the rank. */
+static inline int SL(IdealHeight)(unsigned long rank, unsigned long base,
+                                  int maxlevel) {
+    int height = 1;
+
+    while (rank % base == 0 && height < maxlevel) {
+        rank /= base;
+        height++;
+    }
+    return height;
+}
+
+/* Relinks the list with the ideal level structure for level probability
+ * p, copying the nodes in order into one contiguous slab so that the
+ * bottom level is walked in address order. The objects are not
+ * touched, but all nodes move. Runs in O(n); returns -1 if out of
+ * memory, leaving the list unchanged. */
+int SL(Rebalance)(SLT(skiplist) *sl, double p)
+{
+    SLT(skiplistNode) *last[sl->maxlevel], *x, *y, *next, *prev = NULL;
+    unsigned long lastrank[sl->maxlevel], rank, n = sl->length;
+    double lastweight[sl->maxlevel], weight = 0.0;
+    unsigned long base = (unsigned long) (1.0 / p + 0.5);
+    char *slab, *cursor;
+    size_t size = 0;
+    int i, height, level = 1;
+
+    if (base < 2) base = 2;
+    for (rank = 1; rank <= n; rank++)
+        size += SL_NODE_SIZE(SL(IdealHeight)(rank, base, sl->maxlevel));
+    if (!n) return 0;
+    if (!(slab = malloc(size))) return -1;
+
+    for (i = 0; i < sl->maxlevel; i++) {
+        last[i] = sl->header;
+        lastrank[i] = 0;
+        lastweight[i] = 0.0;
+        sl->levels[i] = 0;
+    }
+    cursor = slab;
+    x = sl->header->level[0].forward;
+    for (rank = 1; x; rank++, x = next) {
+        next = x->level[0].forward;
+        height = SL(IdealHeight)(rank, base, sl->maxlevel);
+        y = (SLT(skiplistNode) *) cursor;
+        cursor += SL_NODE_SIZE(height);
+        y->score = x->score;
+        y->obj = x->obj;
+        y->backward = prev;
+        weight += SL_WEIGHT(x->score);
+        for (i = 0; i < height; i++) {
+            last[i]->level[i].forward = y;
+            last[i]->level[i].span = rank - lastrank[i];
+            last[i]->level[i].weight = weight - lastweight[i];
+            last[i] = y;
+            lastrank[i] = rank;
+            lastweight[i] = weight;
+        }
+        sl->levels[height-1]++;
+        if (height > level) level = height;
+        if (!SL(InSlab)(sl, x)) free(x);
+        prev = y;
+    }
+    for (i = 0; i < sl->maxlevel; i++) {
+        last[i]->level[i].forward = NULL;
+        last[i]->level[i].span = i < level ? n - lastrank[i] : 0;
+        last[i]->level[i].weight = i < level ? weight - lastweight[i] : 0.0;
+    }
+    sl->tail = prev;
+    sl->level = level;
+    sl->weight = weight;
+
+    free(sl->slab);
+    sl->slab = slab;
+    sl->slabSize = size;
+    sl->slabFree = 0;
+    sl->slabLive = n;
+    return 0;
+}
+
+/* Copies the list with the same objects into one slab, replicating the
+ * height, spans and weights of each node, so that no levels are drawn
+ * and nothing is compared. The height of a node is the number of levels
+ * on which it follows the last node seen on that level. The comparator
+ * carries over but not the counters. Returns NULL if out of memory. */
+SLT(skiplist) *SL(Copy)(SLT(skiplist) *sl)
+{
+    SLT(skiplistNode) *src[sl->maxlevel], *dst[sl->maxlevel];
+    SLT(skiplistNode) *x, *y, *prev = NULL;
+    SLT(skiplist) *copy;
+    char *cursor;
+    size_t size = 0;
+    int i, height;
+
+    for (i = 0; i < sl->maxlevel; i++)
+        size += sl->levels[i] * SL_NODE_SIZE(i + 1);
+    copy = SL(CreateWithCompare)(sl->maxlevel, sl->compare, sl->compareData);
+    if (!copy) return NULL;
+    if (size && !(copy->slab = malloc(size))) {
+        SL(Free)(copy);
+        return NULL;
+    }
+
+    memcpy(copy->header->level, sl->header->level,
+           sl->maxlevel * sizeof(struct SLT(skiplistLevel)));
+    memcpy(copy->levels, sl->levels, sl->maxlevel * sizeof(unsigned long));
+    for (i = 0; i < sl->maxlevel; i++) {
+        src[i] = sl->header;
+        dst[i] = copy->header;
+    }
+    cursor = copy->slab;
+    for (x = sl->header->level[0].forward; x; x = x->level[0].forward) {
+        height = 0;
+        while (height < sl->level && src[height]->level[height].forward == x)
+            height++;
+        y = (SLT(skiplistNode) *) cursor;
+        cursor += SL_NODE_SIZE(height);
+        y->score = x->score;
+        y->obj = x->obj;
+        y->backward = prev;
+        for (i = 0; i < height; i++) {
+            y->level[i] = x->level[i];
+            dst[i]->level[i].forward = y;
+            src[i] = x;
+            dst[i] = y;
+        }
+        prev = y;
+    }
+    for (i = 0; i < sl->level; i++)
+        dst[i]->level[i].forward = NULL;
+
+    copy->tail = prev;
+    copy->length = sl->length;
+    copy->level = sl->level;
+    copy->weight = sl->weight;
+    copy->slabSize = size;
+    copy->slabLive = sl->length;
+    return copy;
+}
+
+/* Puts each run of nodes with equal scores back in order after their
+ * objects have been replaced, as in a copy with copied objects. The
+ * structure is unchanged. Returns -1 if out of memory, in which case
+ * the list may be out of order. */
+int SL(SortTies)(SLT(skiplist) *sl)
+{
+    SLT(skiplistNode) *x = sl->header->level[0].forward, *start, *y;
+    SLT(slEntry) *buf = NULL, *grown;
+    unsigned long n, i, size = 0;
+
+    while (x) {
+        start = x;
+        for (n = 1, x = x->level[0].forward;
+             x && SL_EQ(x->score, start->score); x = x->level[0].forward)
+            n++;
+        if (n < 2) continue;
+        if (n > size) {
+            /* Twice the run, for the scratch space of the merge sort. */
+            if (!(grown = realloc(buf, 2 * n * sizeof(*buf)))) {
+                free(buf);
+                return -1;
+            }
+            buf = grown;
+            size = n;
+        }
+        for (i = 0, y = start; i < n; i++, y = y->level[0].forward) {
+            buf[i].score = y->score;
+            buf[i].obj = y->obj;
+        }
+        SL(MergeSort)(sl, buf, buf + n, 0, n);
+        for (i = 0, y = start; i < n; i++, y = y->level[0].forward) {
+            y->score = buf[i].score;
+            y->obj = buf[i].obj;
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+/* Starts (allocating zeroed counters) or stops counting. Returns -1 if
+ * out of memory or if built without SKIPLIST_COUNTERS. */
+int SL(EnableCounters)(SLT(skiplist) *sl, int enable)
+{
+#ifdef SKIPLIST_COUNTERS
+    if (enable && !sl->counters) {
+        sl->counters = calloc(1, sizeof(slCounters));
+        if (!sl->counters) return -1;
+    } else if (!enable) {
+        free(sl->counters);
+        sl->counters = NULL;
+    }
+    return 0;
+#else
+    (void) sl;
+    return enable ? -1 : 0;
+#endif
+}
+
+void SL(ResetCounters)(SLT(skiplist) *sl)
+{
+    if (sl->counters)
+        memset(sl->counters, 0, sizeof(slCounters));
+}
+
+SLT(skiplistiter) *SL(IterNew)(SLT(skiplist) *sl, SLT(skiplistNode)* head)
+{
+    SLT(skiplistiter) *it = calloc(1, sizeof(struct SLT(skiplistiter)));
+    if (it) {
+        it->parent = sl;
+        it->node = head;
+        it->forward = 1;
+        if (head) {
+            it->min = head->score;
+            it->max = sl->tail->score;
+        }
+    }
+    return it;
+}
+
+SLT(skiplistiter) *SL(IterNewFromHead)(SLT(skiplist) *sl)
+{
+    SLT(skiplistiter) *it = SL(IterNew)(sl, sl->header->level[0].forward);
+    if (it && it->node) {
+        it->rank = 1;
+        it->length = sl->length;
+    }
+    return it;
+}
+
+/* The range iterator also records the rank of its first node and the
+ * number of nodes in the range, both from the spans of two descents
+ * (to the last node below min and the last node not above max). */
+SLT(skiplistiter) *SL(IterNewFromRange)(SLT(skiplist) *sl, SL_SCORE min, SL_SCORE max)
+{
+    SLT(skiplistiter) *it = calloc(1, sizeof(struct SLT(skiplistiter)));
+    if (it) {
+        SLT(skiplistNode) *below = sl->header, *last = sl->header;
+        unsigned long lo = 0, hi = 0;
+        int reversed = SL_LESS(max, min);
+        int i;
+        SL_OP_BEGIN(sl);
+
+        if (reversed) SWAP(min, max, SL_SCORE);
+        for (i = sl->level-1; i >= 0; i--) {
+            while (below->level[i].forward &&
+                   SL_LESS(below->level[i].forward->score, min)) {
+                SL_STEP();
+                lo += below->level[i].span;
+                below = below->level[i].forward;
+            }
+        }
+        for (i = sl->level-1; i >= 0; i--) {
+            while (last->level[i].forward &&
+                   !SL_LESS(max, last->level[i].forward->score)) {
+                SL_STEP();
+                hi += last->level[i].span;
+                last = last->level[i].forward;
+            }
+        }
+        SL_OP_END(sl, SL_OP_RANGE);
+
+        it->parent = sl;
+        it->forward = (reversed) ? 0 : 1;
+        it->min = min;
+        it->max = max;
+        if (hi > lo) {
+            it->length = hi - lo;
+            it->rank = reversed ? hi : lo + 1;
+            it->node = reversed ? last : below->level[0].forward;
+        }
+    }
+    return it;
+}
+
+void SL(IterDel)(SLT(skiplistiter) *it)
+{
+    free(it);
+}
+
+int SL(IterGet)(SLT(skiplistiter) *it, SL_SCORE *score, const void **obj)
+{
+    int err = -1;
+    if (it &&
+        it->node &&
+        it->parent &&
+        it->node != it->parent->header &&
+        !SL_LESS(it->node->score, it->min) &&
+        !SL_LESS(it->max, it->node->score)) {
+        *score = it->node->score;
+        *obj = it->node->obj;
+        err = 0;
+    }
+    return err;
+}
+
+int SL(IterNext)(SLT(skiplistiter) *it)
+{
+    int err = -1;
+    if (it && it->node) {
+        if (it->forward) {
+            it->node = it->node->level[0].forward;
+        } else {
+            it->node = it->node->backward;
+        }
+        err = 0;
+    }
+    return err;
+}
+
+#undef SL_BEFORE
+#undef SL_NODE_SIZE
+#undef SL_SCORE
+#undef SL_SUFFIX
+#undef SL_LESS
+#undef SL_EQ
+#undef SL_WEIGHT
@@ -0,0 +1,213 @@
+/* Tests for the header-only C++ skip list (skiplist.hpp). */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "skiplist.hpp"
+
+using skipdict::SkipList;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n",           \
+                         __FILE__, __LINE__, #cond);                    \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static void test_order_and_ties() {
+    SkipList<std::string> sl;
+    sl.insert("bar", 2.0);
+    sl.insert("foo", 1.0);
+    sl.insert("baz", 2.0);
+    sl.insert("abc", 2.0);
+
+    CHECK(sl.size() == 4);
+    std::vector<std::string> keys;
+    for (const auto &entry : sl) keys.push_back(entry.first);
+    CHECK((keys == std::vector<std::string>{"foo", "abc", "bar", "baz"}));
+    CHECK(sl.front().first == "foo");
+    CHECK(sl.back().first == "baz");
+
+    keys.clear();
+    for (auto it = sl.rbegin(); it != sl.rend(); ++it)
+        keys.push_back(it->first);
+    CHECK((keys == std::vector<std::string>{"baz", "bar", "abc", "foo"}));
+}
+
+static void test_rank_and_nth() {
+    SkipList<int, double, std::less<double>, 12> sl;
+    std::vector<std::pair<double, int> > expected;
+    std::mt19937 rng(42);
+
+    for (int i = 0; i < 2000; i++) {
+        double score = rng() % 500;
+        sl.insert(i, score);
+        expected.push_back(std::make_pair(score, i));
+    }
+    std::sort(expected.begin(), expected.end());
+
+    /* Remove every third entry. */
+    for (int i = 0; i < 2000; i += 3) {
+        auto it = std::find_if(expected.begin(), expected.end(),
+                               [i](const std::pair<double, int> &e) {
+                                   return e.second == i;
+                               });
+        CHECK(sl.erase(it->second, it->first));
+        expected.erase(it);
+    }
+    CHECK(!sl.erase(0, 12345.0));
+    CHECK(sl.size() == expected.size());
+    CHECK(sl.level() <= sl.max_level);
+
+    for (std::size_t i = 0; i < expected.size(); i++) {
+        auto it = sl.nth(i);
+        CHECK(it != sl.end());
+        CHECK(it->first == expected[i].second);
+        CHECK(it->second == expected[i].first);
+        CHECK(sl.rank(expected[i].second, expected[i].first) == i);
+    }
+    CHECK(sl.nth(expected.size()) == sl.end());
+    CHECK(sl.rank(0, 0.0) == sl.npos);
+}
+
+static void test_update() {
+    SkipList<std::string> sl;
+    sl.insert("a", 1.0);
+    sl.insert("b", 2.0);
+    sl.insert("c", 3.0);
+
+    /* Keeps its position. */
+    CHECK(sl.update("b", 2.0, 2.5));
+    CHECK(sl.nth(1)->second == 2.5);
+
+    /* Moves to the front and then to the back. */
+    CHECK(sl.update("c", 3.0, 0.5));
+    CHECK(sl.front().first == "c");
+    CHECK(sl.update("c", 0.5, 4.0));
+    CHECK(sl.back().first == "c");
+    CHECK(sl.rank("c", 4.0) == 2);
+    CHECK(!sl.update("c", 3.0, 1.0));
+    CHECK(sl.size() == 3);
+}
+
+static void test_range() {
+    SkipList<int> sl;
+    for (int i = 0; i < 100; i++) sl.insert(i, i / 2);
+
+    auto range = sl.range(10, 12);
+    std::vector<int> keys;
+    for (auto it = range.first; it != range.second; ++it)
+        keys.push_back(it->first);
+    CHECK((keys == std::vector<int>{20, 21, 22, 23, 24, 25}));
+
+    /* Reverse direction. */
+    keys.clear();
+    for (auto it = range.second; it != range.first;)
+        keys.push_back((--it)->first);
+    CHECK((keys == std::vector<int>{25, 24, 23, 22, 21, 20}));
+
+    CHECK(sl.range(12, 10).first == sl.end());
+    CHECK(sl.lower_bound(100) == sl.end());
+    CHECK(sl.upper_bound(-1) == sl.begin());
+    CHECK(sl.count_less(10) == 20);
+}
+
+static void test_compare() {
+    SkipList<int, int, std::greater<int> > sl;
+    for (int i = 0; i < 10; i++) sl.insert(i, i);
+    CHECK(sl.front().first == 9);
+    CHECK(sl.rank(0, 0) == 9);
+
+    /* Range bounds follow the comparator. */
+    auto range = sl.range(5, 3);
+    CHECK(range.first->first == 5);
+    CHECK(std::distance(range.first, range.second) == 3);
+}
+
+struct Handle {
+    std::unique_ptr<int> id;
+
+    explicit Handle(int i) : id(new int(i)) {}
+    bool operator<(const Handle &other) const { return *id < *other.id; }
+};
+
+static void test_move_only() {
+    SkipList<Handle, int> sl;
+    sl.insert(Handle(2), 1);
+    sl.insert(Handle(1), 1);
+    CHECK(*sl.front().first.id == 1);
+    CHECK(sl.update(Handle(1), 1, 5));
+    CHECK(*sl.back().first.id == 1);
+
+    SkipList<Handle, int> moved(std::move(sl));
+    CHECK(moved.size() == 2);
+    SkipList<Handle, int> assigned;
+    assigned = std::move(moved);
+    CHECK(assigned.size() == 2);
+    CHECK(assigned.erase(Handle(2), 1));
+}
+
+static long live = 0;
+
+template <typename T>
+struct CountingAllocator {
+    typedef T value_type;
+
+    CountingAllocator() {}
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U> &) {}
+
+    T *allocate(std::size_t n) {
+        live += n;
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T *p, std::size_t n) {
+        live -= n;
+        std::allocator<T>().deallocate(p, n);
+    }
+    template <typename U>
+    bool operator==(const CountingAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const CountingAllocator<U> &) const { return false; }
+};
+
+static void test_allocator() {
+    {
+        SkipList<int, double, std::less<double>, 8,
+                 CountingAllocator<std::pair<int, double> > > sl;
+        for (int i = 0; i < 1000; i++) sl.insert(i, i % 7);
+        CHECK(live > 1000);
+        for (int i = 0; i < 500; i++) CHECK(sl.erase(i, i % 7));
+        sl.clear();
+        CHECK(sl.empty());
+        sl.insert(1, 1.0);
+    }
+    CHECK(live == 0);
+}
+
+int main() {
+    test_order_and_ties();
+    test_rank_and_nth();
+    test_update();
+    test_range();
+    test_compare();
+    test_move_only();
+    test_allocator();
+
+    if (failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+/* Declarations for one score type; see skiplist.h.
+ *
+ * The ABI covers the nodes, which callers walk, and the fields of a
+ * list up to maxlevel. Lists and iterators are only allocated by the
+ * library, so the rest of a list and all of an iterator are private
+ * and may change freely. Changing anything else means bumping
+ * SKIPLIST_SOVERSION in CMakeLists.txt. */
+
+typedef struct SLT(skiplistNode) {
+    void *obj;
+    SL_SCORE score;
+    struct SLT(skiplistNode) *backward;
+    struct SLT(skiplistLevel) {
+        struct SLT(skiplistNode) *forward;
+        unsigned int span;
+        double weight;          /* sum of the weights spanned */
+    }level[];
+} SLT(skiplistNode);
+
+typedef struct SLT(skiplist) {
+    struct SLT(skiplistNode) *header, *tail;
+    unsigned long length;
+    double weight;              /* sum of the node weights */
+    int level;
+    int maxlevel;
+    /* Private from here on. */
+    slCompareFn compare;
+    void *compareData;
+    unsigned long *levels;      /* number of nodes of each height */
+    slCounters *counters;       /* NULL unless counting */
+    char *slab;                 /* nodes placed by slRebalance() */
+    size_t slabSize;
+    size_t slabFree;            /* bytes of the slab's deleted nodes */
+    unsigned long slabLive;     /* nodes still in the slab */
+} SLT(skiplist);
+
+typedef struct SLT(skiplistiter) {
+    SLT(skiplist) *parent;
+    SLT(skiplistNode) *node;
+    int forward;
+    SL_SCORE min;
+    SL_SCORE max;
+    unsigned long rank;         /* of the first node, if known */
+    unsigned long length;       /* nodes in the range, if known */
+} SLT(skiplistiter);
+
+typedef struct SLT(slEntry) {
+    SL_SCORE score;
+    void *obj;
+} SLT(slEntry);
+
+SLT(skiplist) *SL(Create)(int maxlevel);
+SLT(skiplist) *SL(CreateWithCompare)(int maxlevel, slCompareFn compare,
+                                     void *ud);
+void SL(Free)(SLT(skiplist) *sl);
+int SL(Resize)(SLT(skiplist) *sl, int maxlevel);
+
+SLT(skiplistNode) *SL(Insert)(SLT(skiplist) *sl, SL_SCORE score, void *obj,
+                              int level);
+int SL(BulkLoad)(SLT(skiplist) *sl, SLT(slEntry) *entries, unsigned long n,
+                 double p, unsigned long seed, int threads);
+int SL(Delete)(SLT(skiplist) *sl, SL_SCORE score, void *obj,
+               const SL_SCORE *newscore);
+unsigned long SL(Length)(SLT(skiplist) *sl);
+size_t SL(MemoryUsage)(SLT(skiplist) *sl);
+void SL(PathStats)(SLT(skiplist) *sl, unsigned long *total,
+                   unsigned long *max);
+int SL(Rebalance)(SLT(skiplist) *sl, double p);
+SLT(skiplist) *SL(Copy)(SLT(skiplist) *sl);
+int SL(SortTies)(SLT(skiplist) *sl);
+int SL(EnableCounters)(SLT(skiplist) *sl, int enable);
+void SL(ResetCounters)(SLT(skiplist) *sl);
+unsigned long SL(DeleteMany)(SLT(skiplist) *sl, SLT(slEntry) *entries,
+                             unsigned long n);
+unsigned long SL(DeleteByRank)(SLT(skiplist) *sl, unsigned int start, unsigned int end, slDeleteCb cb, void* ud);
+
+unsigned long SL(GetRank)(SLT(skiplist) *sl, SL_SCORE score, void *o);
+void SL(GetRankMany)(SLT(skiplist) *sl, const SL_SCORE *scores,
+                     void *const *objs, unsigned long n,
+                     unsigned long *ranks);
+unsigned long SL(CountLess)(SLT(skiplist) *sl, SL_SCORE score, void *obj);
+int SL(Histogram)(SLT(skiplist) *sl, const SL_SCORE *edges, unsigned long n,
+                  unsigned long *counts, double *sums);
+SLT(skiplistNode)* SL(GetNodeByRank)(SLT(skiplistNode)* x, int level, unsigned long rank);
+SLT(skiplistNode) *SL(GetNodeByWeight)(SLT(skiplist) *sl, double weight);
+SLT(skiplistNode) *SL(FirstInRange)(SLT(skiplist) *sl, SL_SCORE min, SL_SCORE max);
+SLT(skiplistNode) *SL(LastInRange)(SLT(skiplist) *sl, SL_SCORE min, SL_SCORE max);
+SLT(skiplistNode) *SL(Floor)(SLT(skiplist) *sl, SL_SCORE score,
+                             unsigned long *rank);
+SLT(skiplistNode) *SL(Ceiling)(SLT(skiplist) *sl, SL_SCORE score,
+                               unsigned long *rank);
+
+SLT(skiplistiter) *SL(IterNew)(SLT(skiplist) *sl, SLT(skiplistNode)* head);
+SLT(skiplistiter)* SL(IterNewFromHead)(SLT(skiplist) *sl);
+SLT(skiplistiter) *SL(IterNewFromRange)(SLT(skiplist) *sl, SL_SCORE min, SL_SCORE max);
+void SL(IterDel)(SLT(skiplistiter) *it);
+int SL(IterGet)(SLT(skiplistiter) *it, SL_SCORE *score, const void **obj);
+int SL(IterNext)(SLT(skiplistiter) *it);
+
+#undef SL_SCORE
+#undef SL_SUFFIX
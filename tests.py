@@ -3,6 +3,7 @@ from unittest import TestCase
 from operator import itemgetter
 from random import Random, randrange, shuffle
 from itertools import combinations
+from threading import Thread
 
 
 class BaseTestCase(TestCase):
@@ -93,6 +94,145 @@ class IterTestCase(BaseTestCase):
     def test_most_common(self):
         self.assertEqual(self.skipdict.keys()[-1], ' ')
 
+    def test_reversed(self):
+        self.assertEqual(list(reversed(self.skipdict)),
+                         list(self.skipdict)[::-1])
+        self.assertEqual(list(reversed(self.make())), [])
+        empty = self.make().keys(1.0, 2.0)
+        self.assertEqual((len(empty), list(empty[::-1])), (0, []))
+        self.assertRaises(IndexError, empty.__getitem__, 0)
+
+
+class ThreadingTestCase(BaseTestCase):
+    items = tuple(("key%d" % i, float(i)) for i in range(1000))
+
+    def test_mutation_during_iteration(self):
+        iterator = self.skipdict.keys()
+        next(iterator)
+        del self.skipdict['key500']
+        self.assertRaises(RuntimeError, next, iterator)
+
+    def test_concurrent_readers_and_writer(self):
+        errors = []
+
+        def read():
+            try:
+                for i in range(2000):
+                    key = "key%d" % (i % 1000)
+                    self.skipdict.get(key)
+                    self.skipdict.index(key)
+                    # The writer may move an entry (invalidating the
+                    # iterator) before the first item is read.
+                    try:
+                        list(self.skipdict.values(100.0, 110.0))
+                    except RuntimeError:
+                        pass
+            except Exception as exc:
+                errors.append(exc)
+
+        def write():
+            for i in range(2000):
+                key = "key%d" % (i % 1000)
+                self.skipdict.change(key, 1.0)
+
+        threads = [Thread(target=read) for i in range(4)]
+        threads.append(Thread(target=write))
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        self.assertEqual(errors, [])
+        self.assertEqual(len(self.skipdict), 1000)
+        self.assertEqual(
+            list(self.skipdict.values()),
+            sorted(self.skipdict.values())
+        )
+
+    def test_reentrant_user_code(self):
+        # Hashing and comparing keys, dropping them and the random
+        # function all run outside of the lock, and may use the dict.
+        shared = []
+
+        class Key(object):
+            def __init__(self, name):
+                self.name = name
+
+            def __hash__(self):
+                len(shared[0])
+                return hash(self.name)
+
+            def __eq__(self, other):
+                shared[0].get(None)
+                return self.name == other.name
+
+            def __del__(self):
+                if shared:
+                    len(shared[0])
+
+        def random(maxlevel):
+            len(shared[0])
+            return 1
+
+        inst = self.make((), self.maxlevel, random)
+        shared.append(inst)
+        inst[Key("a")] = 1.0
+        inst[Key("a")] = 2.0
+        self.assertEqual(inst[Key("a")], 2.0)
+        self.assertEqual(inst.get(Key("a")), 2.0)
+        self.assertEqual(inst.index(Key("a")), 0)
+        inst.set(Key("b"), 3.0, ttl=60)
+        inst.setdefault(Key("c"), 4.0)
+        inst.change(Key("c"), 1.0)
+        del inst[Key("a")]
+        self.assertEqual([key.name for key in inst], ["b", "c"])
+        self.assertEqual(list(inst.values()), [3.0, 5.0])
+        del shared[:]
+
+
+class BulkLoadTestCase(BaseTestCase):
+    size = 5000
+
+    @property
+    def items(self):
+        rnd = Random(42)
+        return [
+            ("key%d" % i, float(rnd.randrange(self.size // 2)))
+            for i in range(self.size)
+        ]
+
+    def check(self, inst):
+        keys = list(inst)
+        values = list(inst.values())
+        self.assertEqual(values, sorted(values))
+        for i in range(0, len(keys), 7):
+            self.assertEqual(inst.index(keys[i]), i)
+            self.assertEqual(inst.keys()[i], keys[i])
+
+    def test_threads(self):
+        for threads in (1, 2, 3, 8):
+            inst = self.make(self.items, self.maxlevel, threads=threads)
+            self.assertEqual(len(inst), self.size)
+            self.assertEqual(inst, self.skipdict)
+            self.assertEqual(
+                list(inst.values()), list(self.skipdict.values())
+            )
+            self.check(inst)
+
+    def test_mutate_after_load(self):
+        inst = self.make(self.items, self.maxlevel, threads=4)
+        rnd = Random(1)
+        keys = list(inst)
+        rnd.shuffle(keys)
+        for key in keys[:1000]:
+            del inst[key]
+        for i in range(1000):
+            inst["new%d" % i] = rnd.random() * self.size
+        for key in keys[1000:2000]:
+            inst.change(key, 1.0)
+        self.assertEqual(len(inst), self.size)
+        self.check(inst)
+
 
 class FixtureTestCase(BaseTestCase):
     items = (
@@ -255,6 +395,31 @@ class ProtocolTestCase(FixtureTestCase):
     def test_index_no_args(self):
         self.assertRaises(TypeError, self.skipdict.index)
 
+    def test_index_many(self):
+        keys = self.keys[::-3] + self.keys[:5]
+        self.assertEqual(
+            self.skipdict.index_many(iter(keys)),
+            [self.skipdict.index(key) for key in keys]
+        )
+        self.assertEqual(self.skipdict.index_many([]), [])
+
+    def test_index_many_ties(self):
+        inst = self.make(("key%d" % i, float(i % 7)) for i in range(1000))
+        keys = list(inst)
+        self.assertEqual(inst.index_many(keys), list(range(len(keys))))
+
+    def test_index_many_missing_key(self):
+        self.assertRaises(
+            KeyError, self.skipdict.index_many, [self.keys[0], 'foo']
+        )
+
+    def test_get_many(self):
+        self.assertEqual(
+            self.skipdict.get_many(self.keys + ['foo']),
+            self.values + [None]
+        )
+        self.assertEqual(self.skipdict.get_many(['foo'], 0.0), [0.0])
+
     def test_random(self):
         # Lets test 7 random insertion orders
         for i in (10, 20, 30, 40, 50, 60, 70):
@@ -378,14 +543,63 @@ class IteratorTestCaseMixin:
         self.assertRaises(TypeError, self.iterator)
 
     def test_step(self):
-        self.assertRaises(
-            ValueError,
-            self.iterator.__getitem__,
-            slice(None, None, 2),
-        )
+        for s in (slice(None, None, 2), slice(3, 40, 7), slice(None, None, -1),
+                  slice(-3, 2, -4), slice(40, 3, -1), slice(5, 5, 3),
+                  slice(None, None, 100)):
+            self.assertEqual(list(self.iterator[s]), list(self.expected[s]))
+        self.assertEqual(list(self.iterator[::3][::-2][1:]),
+                         list(self.expected[::3][::-2][1:]))
+        self.assertRaises(ValueError, self.iterator.__getitem__,
+                          slice(None, None, 0))
+
+    def test_item_negative(self):
+        self.assertEqual(self.iterator[-1], self.expected[-1])
+        self.assertEqual(self.iterator[-50], self.expected[0])
+        self.assertRaises(IndexError, self.iterator.__getitem__, -51)
+        self.assertRaises(IndexError, self.iterator.__getitem__, 50)
 
     def test_length(self):
-        self.assertRaises(TypeError, len, self.iterator)
+        self.assertEqual(len(self.iterator), 50)
+        self.assertEqual(len(self.iterator[10:-5:2]), 18)
+        self.assertEqual(len(self.func(self.values[13], self.values[25])), 13)
+        self.assertEqual(len(self.func(self.values[25], self.values[13])), 13)
+        self.assertEqual(len(self.func(1e9, 2e9)), 0)
+        iterator = self.iterator
+        next(iterator)
+        self.assertEqual(iterator.__length_hint__(), 49)
+
+    def test_range_item(self):
+        # Indices are relative to the range.
+        iterator = self.func(self.values[13], self.values[25])
+        self.assertEqual(iterator[0], self.expected[13])
+        self.assertEqual(iterator[-1], self.expected[25])
+        self.assertRaises(IndexError, iterator.__getitem__, 13)
+        self.assertEqual(list(iterator[::-3]), list(self.expected[25:12:-3]))
+
+        iterator = self.func(self.values[25], self.values[13])
+        self.assertEqual(iterator[0], self.expected[25])
+        self.assertEqual(list(iterator[1::5]), list(self.expected[24:12:-5]))
+
+    def test_reversed(self):
+        self.assertEqual(list(reversed(self.iterator)),
+                         list(reversed(self.expected)))
+        self.assertEqual(
+            list(reversed(self.func(self.values[25], self.values[13]))),
+            list(self.expected[13:26])
+        )
+        iterator = self.iterator[::2]
+        next(iterator)
+        self.assertEqual(list(reversed(iterator)),
+                         list(reversed(self.expected[2::2])))
+
+    def test_consumed(self):
+        iterator = self.iterator
+        for _ in range(10):
+            next(iterator)
+        self.assertEqual(iterator[0], self.expected[10])
+        self.assertEqual(list(iterator[::10]), list(self.expected[10::10]))
+        self.assertEqual(list(iterator), list(self.expected[10:]))
+        self.assertEqual(len(iterator), 0)
 
     def test_next(self):
         iterator = self.func()
@@ -475,3 +689,1199 @@ class IterValuesTestCase(IteratorTestCaseMixin, FixtureTestCase):
 
 class IterItemsTestCase(IteratorTestCaseMixin, FixtureTestCase):
     method = "items"
+
+
+class IterBatchesTestCase(FixtureTestCase):
+    def test_batches(self):
+        batches = list(self.skipdict.iter_batches(8))
+        self.assertEqual([len(batch) for batch in batches], [8] * 6 + [2])
+        self.assertEqual(sum(batches, []), list(self.skipdict.items()))
+
+    def test_range(self):
+        batches = self.skipdict.iter_batches(
+            5, min=self.values[13], max=self.values[25])
+        self.assertEqual(len(batches), 3)
+        self.assertEqual(sum(batches, []), list(self.items[13:26]))
+
+    def test_reverse(self):
+        batches = self.skipdict.iter_batches(
+            5, max=self.values[25], reverse=True)
+        self.assertEqual(sum(batches, []), list(self.items[25::-1]))
+        batches = self.skipdict.iter_batches(
+            5, min=self.values[25], max=self.values[13], reverse=True)
+        self.assertEqual(sum(batches, []), list(self.items[13:26]))
+
+    def test_empty(self):
+        self.assertEqual(list(self.make().iter_batches(5)), [])
+        self.assertEqual(list(self.skipdict.iter_batches(5, 1e9, 2e9)), [])
+
+    def test_invalid(self):
+        self.assertRaises(ValueError, self.skipdict.iter_batches, 0)
+        self.assertRaises(TypeError,
+                          self.skipdict.iter_batches(5).__getitem__, 0)
+
+    def test_mutation(self):
+        batches = self.skipdict.iter_batches(5)
+        next(batches)
+        del self.skipdict[self.keys[20]]
+        self.assertRaises(RuntimeError, next, batches)
+
+
+class ScoreTypeTestCase(BaseTestCase):
+    def test_default(self):
+        from skipdict import SkipDict
+        self.assertEqual(self.skipdict.score_type, "double")
+        self.assertEqual(type(self.make(score_type="double")), SkipDict)
+
+    def test_unknown(self):
+        self.assertRaises(ValueError, self.make, score_type="decimal")
+
+    def test_mismatch(self):
+        from skipdict import Int64SkipDict
+        self.assertRaises(ValueError, Int64SkipDict, score_type="pair")
+
+    def test_int64_exact(self):
+        from skipdict import Int64SkipDict
+        big = 2 ** 62
+        skipdict = self.make(
+            (("a", big + 1), ("b", big), ("c", -1)), score_type="int64"
+        )
+        self.assertEqual(type(skipdict), Int64SkipDict)
+        self.assertEqual(skipdict.score_type, "int64")
+        self.assertEqual(list(skipdict), ["c", "b", "a"])
+        self.assertEqual(list(skipdict.values()), [-1, big, big + 1])
+        self.assertEqual(skipdict.index("a"), 2)
+        self.assertEqual(list(skipdict.keys(big + 1)), ["a"])
+        skipdict.change("c", big + 3)
+        self.assertEqual(skipdict.items()[-1], ("c", big + 2))
+
+    def test_int64_not_an_integer(self):
+        skipdict = self.make(score_type="int64")
+        self.assertRaises(TypeError, skipdict.__setitem__, "a", 1.5)
+        self.assertRaises(OverflowError, skipdict.__setitem__, "a", 2 ** 64)
+
+    def test_pair_ties(self):
+        skipdict = self.make(score_type="pair")
+        skipdict["late"] = (10, 2)
+        skipdict["early"] = (10, 1)
+        skipdict["low"] = (5, 3)
+        self.assertEqual(list(skipdict), ["low", "early", "late"])
+        self.assertEqual(skipdict.index("late"), 2)
+        self.assertEqual(
+            list(skipdict.items((10, 0), (10, 1))), [("early", (10.0, 1.0))]
+        )
+        skipdict.change("low", (5, 0))
+        self.assertEqual(list(skipdict), ["early", "late", "low"])
+        self.assertRaises(TypeError, skipdict.__setitem__, "a", 1.0)
+
+
+class StatsTestCase(BaseTestCase):
+    items = [("key%d" % i, float(i % 100)) for i in range(1000)]
+
+    def test_sizeof(self):
+        from sys import getsizeof
+        empty = getsizeof(self.make(maxlevel=self.maxlevel))
+        size = getsizeof(self.skipdict)
+        self.assertGreater(size - empty, len(self.items) * 3 * 8)
+        self.assertEqual(self.skipdict.stats()["bytes"],
+                         self.skipdict.__sizeof__())
+
+    def test_levels(self):
+        stats = self.skipdict.stats()
+        self.assertEqual(stats["length"], len(self.items))
+        self.assertEqual(stats["maxlevel"], self.maxlevel)
+        self.assertEqual(len(stats["levels"]), stats["level"])
+        self.assertEqual(sum(stats["levels"]), len(self.items))
+        self.assertGreater(stats["levels"][0], stats["levels"][-1])
+
+        for key, value in self.items[::2]:
+            del self.skipdict[key]
+        for key, value in self.items[1::4]:
+            self.skipdict.change(key, 1.0)
+        stats = self.skipdict.stats()
+        self.assertEqual(sum(stats["levels"]), len(self.items) // 2)
+        self.assertGreater(stats["avg_path"], 1)
+        self.assertGreaterEqual(stats["max_path"], stats["avg_path"])
+
+    def test_paths(self):
+        def random(maxlevel):
+            return 1
+
+        inst = self.make(self.items[:10], self.maxlevel, random)
+        stats = inst.stats()
+        self.assertEqual(stats["levels"], [10])
+        self.assertEqual(stats["avg_path"], 5.5)
+        self.assertEqual(stats["max_path"], 10)
+        self.assertNotIn("avg_path", inst.stats(paths=False))
+
+    def test_empty(self):
+        stats = self.make().stats()
+        self.assertEqual(stats["levels"], [0])
+        self.assertEqual(stats["bytes_per_entry"], 0.0)
+        self.assertEqual(stats["max_path"], 0)
+
+
+class AdaptiveTestCase(BaseTestCase):
+    maxlevel = 16
+
+    def test_p(self):
+        skipdict = self.make(p=0.5)
+        self.assertEqual(skipdict.p, 0.5)
+        self.assertEqual(self.skipdict.p, 0.25)
+        self.assertFalse(skipdict.adaptive)
+        self.assertRaises(ValueError, self.make, p=0.0)
+        self.assertRaises(ValueError, self.make, p=1.0)
+
+    def test_grow_and_shrink(self):
+        skipdict = self.make(maxlevel=self.maxlevel, adaptive=True)
+        self.assertTrue(skipdict.adaptive)
+        self.assertEqual(skipdict.stats()["header"], 2)
+
+        for i in range(1000):
+            skipdict["key%d" % i] = float(i)
+        stats = skipdict.stats()
+        self.assertEqual(stats["header"], 6)
+        self.assertEqual(stats["maxlevel"], self.maxlevel)
+        self.assertEqual(skipdict.maxlevel, self.maxlevel)
+
+        for i in range(990):
+            del skipdict["key%d" % i]
+        stats = skipdict.stats()
+        self.assertLess(stats["header"], 6)
+        self.assertGreaterEqual(stats["header"], stats["level"])
+        self.assertEqual(list(skipdict), ["key%d" % i for i in range(990, 1000)])
+        self.assertEqual(skipdict.index("key995"), 5)
+
+    def test_bulk_load(self):
+        items = [("key%d" % i, float(i % 7)) for i in range(10000)]
+        skipdict = self.make(items, self.maxlevel, adaptive=True)
+        self.assertEqual(skipdict.stats()["header"], 8)
+        self.assertEqual(len(skipdict), len(items))
+        skipdict = self.make(items, 4, adaptive=True, p=0.5)
+        self.assertEqual(skipdict.stats()["header"], 4)
+        self.assertEqual(skipdict.stats()["level"], 4)
+
+
+class RebalanceTestCase(BaseTestCase):
+    maxlevel = 16
+    items = [("key%d" % i, float(i % 50)) for i in range(2000)]
+
+    def churn(self, skipdict, n, seed=7):
+        rnd = Random(seed)
+        for i in range(n):
+            skipdict["key%d" % rnd.randrange(len(self.items))] = rnd.random() * 50
+
+    def test_rebalance(self):
+        self.churn(self.skipdict, 3000)
+        items = list(self.skipdict.items())
+        before = self.skipdict.stats()
+        iterator = iter(self.skipdict)
+        next(iterator)
+
+        self.skipdict.rebalance()
+        stats = self.skipdict.stats()
+        self.assertEqual(list(self.skipdict.items()), items)
+        self.assertEqual(self.skipdict.index(items[777][0]), 777)
+        self.assertEqual(self.skipdict.keys()[1500], items[1500][0])
+        self.assertEqual(stats["levels"][:3], [1500, 375, 94])
+        self.assertLessEqual(stats["avg_path"], before["avg_path"])
+        self.assertEqual(stats["slab_utilization"], 1.0)
+        self.assertRaises(RuntimeError, list, iterator)
+
+        for key, value in items[:1000]:
+            del self.skipdict[key]
+        stats = self.skipdict.stats()
+        self.assertLess(stats["slab_utilization"], 0.6)
+        self.assertEqual(list(self.skipdict.items()), items[1000:])
+
+    def test_auto_rebalance(self):
+        skipdict = self.make(self.items, self.maxlevel, auto_rebalance=1.0)
+        self.assertEqual(skipdict.stats()["slab_bytes"], 0)
+        self.churn(skipdict, 1000)
+        self.assertEqual(skipdict.stats()["slab_bytes"], 0)
+        self.churn(skipdict, 1500, seed=8)
+        self.assertGreater(skipdict.stats()["slab_bytes"], 0)
+        self.assertEqual(len(skipdict), len(self.items))
+        values = list(skipdict.values())
+        self.assertEqual(values, sorted(values))
+        self.assertRaises(ValueError, self.make, auto_rebalance=-1.0)
+
+
+class LazyDeleteTestCase(BaseTestCase):
+    maxlevel = 16
+    items = [("key%d" % i, float(i % 50)) for i in range(2000)]
+
+    def test_lazy_delete(self):
+        skipdict = self.make(self.items, self.maxlevel, lazy_delete=1.0)
+        expected = dict(self.items)
+        for key, value in self.items[::3]:
+            del skipdict[key]
+            del expected[key]
+        self.assertEqual(len(skipdict), len(expected))
+        self.assertNotIn("key0", skipdict)
+        self.assertRaises(KeyError, skipdict.__delitem__, "key0")
+        skipdict["key0"] = 0.5
+        expected["key0"] = 0.5
+
+        # Walking the skip list unlinks the deleted entries first.
+        self.assertEqual(dict(skipdict.items()), expected)
+        self.assertEqual(skipdict.stats()["length"], len(expected))
+        values = list(skipdict.values())
+        self.assertEqual(values, sorted(expected.values()))
+        keys = list(skipdict)
+        self.assertEqual(skipdict.index(keys[777]), 777)
+        self.assertEqual(skipdict.keys()[-1], keys[-1])
+
+    def test_threshold(self):
+        skipdict = self.make(self.items, self.maxlevel, lazy_delete=0.25)
+        size = skipdict.__sizeof__()
+        for key, value in self.items[:500]:
+            del skipdict[key]
+        self.assertLess(skipdict.__sizeof__(), size)
+        self.assertEqual(len(skipdict), 1500)
+
+    def test_iterators(self):
+        skipdict = self.make(self.items, self.maxlevel, lazy_delete=1.0)
+        iterator = skipdict.items()
+        next(iterator)
+        del skipdict["key1"]
+        self.assertRaises(RuntimeError, next, iterator)
+        self.assertNotIn("key1", skipdict.keys(1.0, 1.0))
+        copy = skipdict.copy()
+        del copy["key2"]
+        self.assertEqual(len(copy), len(skipdict) - 1)
+        self.assertIn("key2", skipdict)
+
+    def test_invalid(self):
+        self.assertRaises(ValueError, self.make, lazy_delete=-1.0)
+
+
+class CountersTestCase(BaseTestCase):
+    items = [("key%d" % i, float(i)) for i in range(100)]
+
+    def enable(self):
+        try:
+            self.skipdict.counting = True
+        except NotImplementedError:
+            self.skipTest("built without SKIPLIST_COUNTERS")
+
+    def test_disabled(self):
+        self.assertFalse(self.skipdict.counting)
+        self.assertEqual(self.skipdict.counters(), None)
+        self.skipdict.reset_counters()
+
+    def test_counters(self):
+        self.enable()
+        self.assertTrue(self.skipdict.counting)
+        self.skipdict["new"] = 50.5
+        self.assertEqual(self.skipdict.index("key50"), 50)
+        self.skipdict["key99"] = 100.0
+        self.skipdict["key0"] = 200.0
+        del self.skipdict["key10"]
+        self.assertEqual(list(self.skipdict.keys(20.0, 21.0)),
+                         ["key20", "key21"])
+
+        counters = self.skipdict.counters()
+        self.assertEqual(counters["insert"]["calls"], 2)
+        self.assertEqual(counters["rank"]["calls"], 1)
+        self.assertEqual(counters["delete"]["calls"], 3)
+        self.assertEqual(counters["range"]["calls"], 1)
+        self.assertGreater(counters["range"]["steps"], 0)
+        self.assertEqual(sum(counters["insert"]["latency"]), 2)
+        self.assertEqual(counters["allocs"], 2)
+        self.assertEqual(counters["frees"], 2)
+        self.assertEqual(counters["inplace"], 1)
+        self.assertEqual(counters["relinks"], 1)
+
+        self.skipdict.reset_counters()
+        self.assertEqual(self.skipdict.counters()["delete"]["calls"], 0)
+        self.skipdict.counting = False
+        self.assertEqual(self.skipdict.counters(), None)
+
+
+class ExpiryTestCase(BaseTestCase):
+    items = [("key%d" % i, float(i)) for i in range(10)]
+    later = 4102444800.0  # 2100-01-01
+
+    def test_expire(self):
+        for i in range(5):
+            self.skipdict.set("key%d" % i, float(i), ttl=1000 + i)
+        self.assertEqual(self.skipdict.expire(), 0)
+        self.assertEqual(self.skipdict.expire(self.later), 5)
+        self.assertEqual(list(self.skipdict), ["key%d" % i for i in range(5, 10)])
+        self.assertEqual(self.skipdict.expire(self.later), 0)
+
+    def test_ttl(self):
+        self.skipdict.set("key1", 1.0, ttl=100)
+        self.assertTrue(0 < self.skipdict.ttl("key1") <= 100)
+        self.assertEqual(self.skipdict.ttl("key2"), None)
+        self.assertRaises(KeyError, self.skipdict.ttl, "foo")
+        self.assertRaises(ValueError, self.skipdict.set, "key1", 1.0, -1)
+        self.assertRaises(TypeError, self.skipdict.expire, "now")
+
+    def test_replace(self):
+        self.skipdict.set("key1", 1.0, ttl=100)
+        self.skipdict.set("key2", 2.0, ttl=100)
+        self.skipdict.set("key3", 3.0, ttl=100)
+        self.skipdict.change("key1", 10.0)
+        self.skipdict["key2"] = 20.0
+        self.skipdict.set("key3", 30.0)
+        self.assertEqual(self.skipdict.ttl("key2"), None)
+        self.assertEqual(self.skipdict.ttl("key3"), None)
+        self.assertEqual(self.skipdict.expire(self.later), 1)
+        self.assertFalse("key1" in self.skipdict)
+
+    def test_delete(self):
+        self.skipdict.set("key1", 1.0, ttl=100)
+        del self.skipdict["key1"]
+        self.skipdict["key1"] = 1.0
+        self.assertEqual(self.skipdict.expire(self.later), 0)
+        self.assertEqual(len(self.skipdict), 10)
+
+    def test_lazy(self):
+        # Each mutation first removes up to two expired entries.
+        self.skipdict.set("key0", 0.0, ttl=0)
+        self.skipdict.set("key1", 1.0, ttl=0)
+        self.assertEqual(len(self.skipdict), 9)
+        for i in range(2, 5):
+            self.skipdict.set("key%d" % i, float(i), ttl=0)
+        self.assertEqual(len(self.skipdict), 6)
+        self.assertEqual(self.skipdict.ttl("key4"), 0.0)
+        self.skipdict.change("key9", 1.0)
+        self.assertEqual(list(self.skipdict), ["key5", "key6", "key7", "key8",
+                                               "key9"])
+
+    def test_iteration(self):
+        self.skipdict.set("key1", 1.0, ttl=0)
+        iterator = iter(self.skipdict)
+        self.assertEqual(self.skipdict.expire(), 1)
+        self.assertRaises(RuntimeError, list, iterator)
+
+    def test_score_types(self):
+        for score_type, score in (("int64", 1), ("pair", (1.0, 2.0))):
+            inst = self.make(score_type=score_type)
+            inst.set("bar", score)
+            inst.set("foo", score, ttl=0)
+            self.assertEqual(inst.expire(), 1)
+            self.assertEqual(list(inst.items()), [("bar", score)])
+
+    def test_sizeof(self):
+        size = self.skipdict.__sizeof__()
+        for i in range(10):
+            self.skipdict.set("key%d" % i, float(i), ttl=100)
+        self.assertGreater(self.skipdict.__sizeof__(), size)
+
+
+class SampleTestCase(BaseTestCase):
+    items = [("key%d" % i, float(i % 10)) for i in range(100)]
+
+    def test_sample(self):
+        keys = set(self.skipdict)
+        for k in (0, 1, 10, 25, 26, 60, 100):
+            sample = self.skipdict.sample(k)
+            self.assertEqual(len(sample), k)
+            self.assertEqual(len(set(sample)), k)
+            self.assertTrue(set(sample) <= keys)
+        self.assertRaises(ValueError, self.skipdict.sample, 101)
+        self.assertRaises(ValueError, self.skipdict.sample, -1)
+        self.assertEqual(self.make().sample(0), [])
+
+    def test_seed(self):
+        for k in (5, 50):
+            self.skipdict.seed(42)
+            first = self.skipdict.sample(k)
+            self.skipdict.seed(42)
+            self.assertEqual(self.skipdict.sample(k), first)
+            self.assertNotEqual(self.skipdict.sample(k), first)
+        self.skipdict.seed()
+        self.assertRaises(TypeError, self.skipdict.seed, "42")
+
+    def test_uniform(self):
+        self.skipdict.seed(1)
+        counts = dict.fromkeys(self.skipdict, 0)
+        for _ in range(2000):
+            for key in self.skipdict.sample(5):
+                counts[key] += 1
+        # Each key is expected 100 times.
+        self.assertTrue(all(50 < count < 150 for count in counts.values()))
+
+    def test_weighted_sample(self):
+        inst = self.make({"a": 1.0, "b": 3.0, "c": 0.0})
+        inst.seed(7)
+        sample = inst.weighted_sample(20000)
+        self.assertEqual(sample.count("c"), 0)
+        self.assertTrue(2.7 < sample.count("b") / float(sample.count("a")) < 3.3)
+
+        inst["c"] = 4.0
+        inst.change("a", -1.0)
+        del inst["b"]
+        inst["d"] = 0.0
+        self.assertEqual(set(inst.weighted_sample(1000)), set(["c"]))
+        inst.rebalance()
+        self.assertEqual(set(inst.weighted_sample(1000)), set(["c"]))
+
+    def test_weighted_sample_errors(self):
+        self.assertEqual(self.make().weighted_sample(0), [])
+        self.assertRaises(ValueError, self.make().weighted_sample, 1)
+        self.assertRaises(ValueError, self.make({"a": 0.0}).weighted_sample, 1)
+        self.assertRaises(ValueError, self.make({"a": -1.0, "b": 2.0}).weighted_sample, 1)
+        self.assertRaises(ValueError, self.skipdict.weighted_sample, -1)
+
+    def test_large_score(self):
+        # The sums of a link must not keep the rounding error of a
+        # score that it no longer spans.
+        inst = self.make({"big": 1e17})
+        for i in range(100):
+            inst[i] = 1.0
+        del inst["big"]
+        self.assertEqual(len(inst.weighted_sample(5)), 5)
+        self.assertEqual(inst.histogram([0, 2], sums=True), ([100], [100.0]))
+
+        inst["big"] = 1e17
+        inst["big"] = 2.0
+        self.assertEqual(inst.histogram([0, 2], sums=True), ([101], [102.0]))
+        inst["big"] = 0.0
+        inst["big"] = 1e17
+        del inst["big"]
+        self.assertEqual(len(inst.weighted_sample(5)), 5)
+
+    def test_score_types(self):
+        inst = self.make({"a": 0, "b": 5}, score_type="int64")
+        self.assertEqual(set(inst.weighted_sample(100)), set(["b"]))
+        inst = self.make({"a": (0.0, 9.0), "b": (2.0, 0.0)}, score_type="pair")
+        self.assertEqual(set(inst.weighted_sample(100)), set(["b"]))
+        self.assertEqual(sorted(inst.sample(2)), ["a", "b"])
+
+
+class UnionTestCase(BaseTestCase):
+    items = (("a", 1.0), ("b", 2.0), ("c", 3.0))
+
+    def setUp(self):
+        super(UnionTestCase, self).setUp()
+        self.other = self.make({"b": 5.0, "c": -1.0, "d": 0.5})
+
+    def test_union(self):
+        from skipdict import SkipDict
+        result = SkipDict.union(self.skipdict, self.other)
+        self.assertEqual(list(result.items()),
+                         [("d", 0.5), ("a", 1.0), ("c", 2.0), ("b", 7.0)])
+        self.assertEqual(result.index("c"), 2)
+        self.assertEqual(list(self.skipdict.union().items()),
+                         list(self.skipdict.items()))
+        self.assertEqual(len(self.make().union(self.make())), 0)
+
+    def test_aggregate(self):
+        result = self.skipdict.union(self.other, aggregate="min")
+        self.assertEqual(dict(result), {"a": 1.0, "b": 2.0, "c": -1.0, "d": 0.5})
+        result = self.skipdict.union(self.other, aggregate="max")
+        self.assertEqual(dict(result), {"a": 1.0, "b": 5.0, "c": 3.0, "d": 0.5})
+        self.assertRaises(ValueError, self.skipdict.union, aggregate="avg")
+
+    def test_weights(self):
+        result = self.skipdict.union(self.other, weights=(2, -1))
+        self.assertEqual(list(result.items()),
+                         [("b", -1.0), ("d", -0.5), ("a", 2.0), ("c", 7.0)])
+        self.assertRaises(ValueError, self.skipdict.union, self.other,
+                          weights=(1,))
+        self.assertRaises(TypeError, self.skipdict.union, self.other,
+                          weights=(1, "2"))
+
+    def test_intersection(self):
+        third = self.make({"c": 1.0, "b": 1.0, "e": 1.0})
+        result = self.skipdict.intersection(self.other, third)
+        self.assertEqual(list(result.items()), [("c", 3.0), ("b", 8.0)])
+        result = self.skipdict.intersection(self.other, aggregate="max",
+                                            weights=(1, 10))
+        self.assertEqual(list(result.items()), [("c", 3.0), ("b", 50.0)])
+        self.assertEqual(len(self.skipdict.intersection(self.make())), 0)
+
+    def test_large(self):
+        rnd = Random(3)
+        inputs = [self.make((i, float(rnd.randrange(100)))
+                            for i in rnd.sample(range(1000), 500))
+                  for _ in range(3)]
+        union = inputs[0].union(*inputs[1:])
+        intersection = inputs[0].intersection(*inputs[1:])
+        expected = {}
+        for inst in inputs:
+            for key, score in inst.items():
+                expected[key] = expected.get(key, 0.0) + score
+        self.assertEqual(dict(union), expected)
+        self.assertEqual(
+            set(intersection),
+            set(inputs[0]) & set(inputs[1]) & set(inputs[2])
+        )
+        for result in union, intersection:
+            scores = list(result.values())
+            self.assertEqual(scores, sorted(scores))
+            for i, key in enumerate(result):
+                self.assertEqual(result.index(key), i)
+
+    def test_type_errors(self):
+        self.assertRaises(TypeError, self.skipdict.union, {"a": 1.0})
+        self.assertRaises(TypeError, self.skipdict.intersection,
+                          self.make(score_type="int64"))
+
+    def test_score_types(self):
+        a = self.make({"a": 1, "b": 2}, score_type="int64")
+        b = self.make({"b": 3, "c": 4}, score_type="int64")
+        self.assertEqual(dict(a.union(b, weights=(2, 1))),
+                         {"a": 2, "b": 7, "c": 4})
+        self.assertEqual(type(a.union(b)), type(a))
+        self.assertRaises(ValueError, a.union, b, weights=(0.5, 1))
+
+    def test_int64_overflow(self):
+        a = self.make({"a": 2 ** 62, "b": -2 ** 63}, score_type="int64")
+        b = self.make({"a": 2 ** 62, "b": 0}, score_type="int64")
+        self.assertRaises(OverflowError, a.union, b)
+        self.assertRaises(OverflowError, a.intersection, b)
+        self.assertRaises(OverflowError, a.union, b, weights=(4, 4))
+        self.assertRaises(OverflowError, a.union, b, weights=(-1, 1))
+        self.assertRaises(OverflowError, a.union, b, weights=(1e19, 1))
+        # Up to the limits, the scores are exact.
+        a = self.make({"a": 2 ** 62 - 1, "b": -2 ** 62}, score_type="int64")
+        b = self.make({"a": 2 ** 62, "b": -2 ** 62}, score_type="int64")
+        self.assertEqual(dict(a.union(b)), {"a": 2 ** 63 - 1, "b": -2 ** 63})
+        self.assertEqual(dict(a.union(b, aggregate="max", weights=(2, 1))),
+                         {"a": 2 ** 63 - 2, "b": -2 ** 62})
+
+        a = self.make({"a": (1.0, 2.0), "b": (2.0, 0.0)}, score_type="pair")
+        b = self.make({"b": (2.0, 1.0)}, score_type="pair")
+        self.assertEqual(dict(a.intersection(b)), {"b": (4.0, 1.0)})
+        self.assertEqual(dict(a.intersection(b, aggregate="max")),
+                         {"b": (2.0, 1.0)})
+
+
+class NearestTestCase(BaseTestCase):
+    items = (("a", 1.0), ("b", 3.0), ("c", 3.0), ("d", 7.0), ("e", 10.0))
+
+    def test_floor(self):
+        # Of equal scores, the last one in order.
+        key, score, index = self.skipdict.floor(5.0)
+        self.assertEqual((score, index), (3.0, 2))
+        self.assertEqual(self.skipdict.index(key), 2)
+        self.assertEqual(self.skipdict.floor(3.0), (key, 3.0, 2))
+        self.assertEqual(self.skipdict.floor(10), ("e", 10.0, 4))
+        self.assertEqual(self.skipdict.floor(0.5), None)
+        self.assertEqual(self.make().floor(0.5), None)
+
+    def test_ceiling(self):
+        key, score, index = self.skipdict.ceiling(2.0)
+        self.assertEqual((score, index), (3.0, 1))
+        self.assertEqual(self.skipdict.index(key), 1)
+        self.assertEqual(self.skipdict.ceiling(3.0), (key, 3.0, 1))
+        self.assertEqual(self.skipdict.ceiling(-5), ("a", 1.0, 0))
+        self.assertEqual(self.skipdict.ceiling(10.5), None)
+        self.assertRaises(TypeError, self.skipdict.ceiling, "3")
+
+    def test_nearest(self):
+        self.assertEqual(
+            [(score, index) for key, score, index in
+             self.skipdict.nearest(6.0, 3)],
+            [(7.0, 3), (3.0, 2), (3.0, 1)]
+        )
+        # At equal distance, the lower score comes first.
+        self.assertEqual(
+            [score for key, score, index in self.skipdict.nearest(5.0, 5)],
+            [3.0, 3.0, 7.0, 1.0, 10.0]
+        )
+        self.assertEqual(len(self.skipdict.nearest(100.0, 10)), 5)
+        self.assertEqual(self.skipdict.nearest(0.0, 0), [])
+        self.assertEqual(self.make().nearest(0.0, 3), [])
+        self.assertRaises(ValueError, self.skipdict.nearest, 0.0, -1)
+
+    def test_random(self):
+        rnd = Random(5)
+        inst = self.make((i, float(rnd.randrange(200))) for i in range(300))
+        for _ in range(50):
+            x = rnd.randrange(-10, 210) + 0.5
+            result = inst.nearest(x, 20)
+            distances = [abs(score - x) for key, score, index in result]
+            self.assertEqual(distances, sorted(distances))
+            bound = max(distances)
+            self.assertEqual(
+                len([score for score in inst.values()
+                     if abs(score - x) < bound]),
+                len([d for d in distances if d < bound])
+            )
+            for key, score, index in result:
+                self.assertEqual(inst.index(key), index)
+                self.assertEqual(inst[key], score)
+
+    def test_score_types(self):
+        inst = self.make({"a": -2 ** 63, "b": 2 ** 63 - 1, "c": 0},
+                         score_type="int64")
+        self.assertEqual(inst.nearest(-1, 2),
+                         [("c", 0, 1), ("a", -2 ** 63, 0)])
+        self.assertEqual(inst.floor(2 ** 62), ("c", 0, 1))
+        # The scores are converted as for items(), not as stored.
+        inst["d"] = True
+        self.assertEqual(inst.ceiling(1), ("d", 1, 2))
+        self.assertEqual(type(inst.ceiling(1)[1]), type(dict(inst.items())["d"]))
+
+        inst = self.make({"a": (1.0, 5.0), "b": (2.0, 0.0), "c": (4.0, 0.0)},
+                         score_type="pair")
+        self.assertEqual(inst.ceiling((1.0, 6.0)), ("b", (2.0, 0.0), 1))
+        inst["d"] = [5, 1]
+        self.assertEqual(inst.floor((5.0, 1.0)), ("d", (5.0, 1.0), 3))
+        self.assertEqual([key for key, score, index in inst.nearest((3.0, 0.0), 3)],
+                         ["b", "c", "a"])
+
+
+class HistogramTestCase(BaseTestCase):
+    items = [("key%d" % i, float(i % 100)) for i in range(1000)]
+
+    def test_histogram(self):
+        self.assertEqual(self.skipdict.histogram([0, 10, 50, 99]),
+                         [100, 400, 500])
+        self.assertEqual(self.skipdict.histogram((-5, 0, 0, 0.5, 200)),
+                         [0, 0, 10, 990])
+        self.assertEqual(self.skipdict.histogram([98.5, 99]), [10])
+        self.assertEqual(self.skipdict.histogram([1]), [])
+        self.assertEqual(self.skipdict.histogram([]), [])
+        self.assertEqual(self.make().histogram([0, 1]), [0])
+
+    def test_sums(self):
+        counts, sums = self.skipdict.histogram([0, 10, 50, 99.5], sums=True)
+        self.assertEqual(counts, [100, 400, 500])
+        self.assertEqual(sums, [450.0, 11800.0, 37250.0])
+
+    def test_random(self):
+        rnd = Random(11)
+        inst = self.make((i, rnd.random() * 100) for i in range(2000))
+        edges = sorted(rnd.random() * 120 - 10 for _ in range(20))
+        counts, sums = inst.histogram(edges, sums=True)
+        for i, (low, high) in enumerate(zip(edges, edges[1:])):
+            last = i == len(edges) - 2
+            scores = [s for s in inst.values()
+                      if low <= s and (s < high or last and s == high)]
+            self.assertEqual(counts[i], len(scores))
+            self.assertAlmostEqual(sums[i], sum(scores), 6)
+
+    def test_errors(self):
+        self.assertRaises(ValueError, self.skipdict.histogram, [2, 1])
+        self.assertRaises(TypeError, self.skipdict.histogram, ["a", "b"])
+        self.assertRaises(TypeError, self.skipdict.histogram, 1)
+
+    def test_score_types(self):
+        inst = self.make(((i, i) for i in range(10)), score_type="int64")
+        self.assertEqual(inst.histogram([0, 5, 9], sums=True),
+                         ([5, 5], [10.0, 35.0]))
+        inst = self.make({"a": (1.0, 0.0), "b": (1.0, 5.0), "c": (2.0, 0.0)},
+                         score_type="pair")
+        self.assertEqual(inst.histogram([(1.0, 1.0), (2.0, 0.0)]), [2])
+
+
+class CopyTestCase(BaseTestCase):
+    items = [("key%d" % i, float(i % 50)) for i in range(500)]
+
+    def assertSame(self, clone, inst):
+        # Keys with equal scores may come in another order.
+        self.assertEqual(dict(clone), dict(inst))
+        self.assertEqual(list(clone.values()), list(inst.values()))
+        for i, key in enumerate(clone):
+            self.assertEqual(clone.index(key), i)
+
+    def test_copy(self):
+        from copy import copy
+        for clone in (self.skipdict.copy(), copy(self.skipdict)):
+            self.assertEqual(type(clone), type(self.skipdict))
+            self.assertSame(clone, self.skipdict)
+            self.assertEqual(clone.stats()["levels"],
+                             self.skipdict.stats()["levels"])
+            self.assertEqual(clone.maxlevel, self.skipdict.maxlevel)
+
+    def test_independent(self):
+        clone = self.skipdict.copy()
+        # An update in place must not show through the other copy.
+        clone.change("key0", 0.5)
+        clone["key1"] = 100.0
+        del clone["key2"]
+        self.assertEqual(self.skipdict["key0"], 0.0)
+        self.assertEqual(self.skipdict["key1"], 1.0)
+        self.assertTrue("key2" in self.skipdict)
+        self.assertEqual(clone["key0"], 0.5)
+        self.skipdict.change("key3", 0.25)
+        self.assertEqual(clone["key3"], 3.0)
+        self.assertEqual(clone.keys()[-1], "key1")
+        for inst in (self.skipdict, clone):
+            for i, key in enumerate(inst):
+                self.assertEqual(inst.index(key), i)
+            scores = list(inst.values())
+            self.assertEqual(scores, sorted(scores))
+
+    def test_options(self):
+        inst = self.make(self.items, adaptive=True, p=0.5)
+        clone = inst.copy()
+        self.assertEqual((clone.p, clone.adaptive), (0.5, True))
+        self.assertSame(clone, inst)
+        self.assertEqual(len(self.make().copy()), 0)
+
+    def test_expiry(self):
+        inst = self.make()
+        inst.set("a", 1.0, ttl=1000)
+        inst.set("b", 2.0, ttl=10)
+        inst["c"] = 3.0
+        clone = inst.copy()
+        self.assertTrue(900 < clone.ttl("a") <= 1000)
+        self.assertEqual(clone.ttl("c"), None)
+        clone.set("b", 2.0)
+        self.assertEqual(clone.ttl("b"), None)
+        self.assertTrue(inst.ttl("b") > 0)
+        self.assertEqual(clone.expire(10 ** 12), 1)
+        self.assertEqual(len(inst), 3)
+
+    def test_deepcopy(self):
+        from copy import deepcopy
+        inst = self.make({(1, 2): [1.0, 2.0], (3, 4): (1.0, 2.0)},
+                         score_type="pair")
+        inst.set((5, 6), (0.0, 0.0), ttl=1000)
+        clone = deepcopy(inst)
+        self.assertSame(clone, inst)
+        self.assertIsNot(clone[(1, 2)], inst[(1, 2)])
+        self.assertTrue(clone.ttl((5, 6)) > 0)
+        self.assertEqual(clone.expire(10 ** 12), 1)
+        self.assertEqual(len(inst), 3)
+
+        inst = self.make(self.items)
+        memo = {}
+        clone = deepcopy([inst, inst], memo)
+        self.assertIs(clone[0], clone[1])
+        self.assertSame(clone[0], inst)
+
+    def test_score_types(self):
+        inst = self.make(((i, i % 3) for i in range(100)), score_type="int64")
+        clone = inst.copy()
+        clone.change(0, 10)
+        self.assertEqual(inst[0], 0)
+        self.assertEqual(list(clone.items())[-1], (0, 10))
+
+
+class ShardedTestCase(FixtureTestCase):
+    shards = 4
+
+    def make(self, *args, **kwargs):
+        from skipdict import ShardedSkipDict
+        kwargs.setdefault('shards', self.shards)
+        return ShardedSkipDict(*args, **kwargs)
+
+    def test_shards(self):
+        self.assertEqual(self.skipdict.shards, self.shards)
+
+    def test_length(self):
+        self.assertEqual(len(self.skipdict), len(self.items))
+
+    def test_get(self):
+        for key, value in self.items:
+            self.assertEqual(self.skipdict[key], value)
+            self.assertEqual(self.skipdict.get(key), value)
+            self.assertTrue(key in self.skipdict)
+
+    def test_iteration(self):
+        self.assertEqual(list(self.skipdict), self.keys)
+        self.assertEqual(list(self.skipdict.values()), self.values)
+        self.assertEqual(list(self.skipdict.items()), list(self.items))
+
+    def test_range(self):
+        self.assertEqual(
+            list(self.skipdict.keys(self.values[13], self.values[25])),
+            self.keys[13:26]
+        )
+        self.assertEqual(
+            list(self.skipdict.keys(self.values[25], self.values[13])),
+            list(reversed(self.keys[13:26]))
+        )
+
+    def test_range_gap(self):
+        skipdict = self.make({"a": 1.0, "b": 10.0}, shards=1)
+        self.assertEqual(list(skipdict.keys(4.0, 6.0)), [])
+        self.assertEqual(list(skipdict.keys(6.0, 4.0)), [])
+
+    def test_top(self):
+        self.assertEqual(
+            self.skipdict.top(5),
+            list(reversed(self.items[-5:]))
+        )
+        self.assertEqual(len(self.skipdict.top(100)), len(self.items))
+
+    def test_index(self):
+        for i, key in enumerate(self.keys):
+            self.assertEqual(self.skipdict.index(key), i)
+
+    def test_index_ties(self):
+        inst = self.make((("key%d" % i, float(i % 3)) for i in range(30)))
+        keys = list(inst)
+        for i, key in enumerate(keys):
+            self.assertEqual(inst.index(key), i)
+
+    def test_change_and_delete(self):
+        self.skipdict.change(self.keys[0], 100000.0)
+        self.assertEqual(list(self.skipdict)[-1], self.keys[0])
+        del self.skipdict[self.keys[0]]
+        self.assertEqual(list(self.skipdict), self.keys[1:])
+        self.assertRaises(KeyError, self.skipdict.index, self.keys[0])
+
+    def test_mutation_during_iteration(self):
+        iterator = iter(self.skipdict)
+        next(iterator)
+        for key in self.keys[1:]:
+            del self.skipdict[key]
+        self.assertRaises(RuntimeError, list, iterator)
+
+    def test_bulk_load(self):
+        rnd = Random(0)
+        scores = list(range(50000))
+        rnd.shuffle(scores)
+        items = [("key%d" % i, float(s)) for i, s in enumerate(scores)]
+        inst = self.make(items + [("key0", 0.5)], shards=8, threads=4)
+        self.assertEqual(len(inst), len(items))
+        self.assertEqual(inst["key0"], scores[0] + 0.5)
+        expected = sorted(items[1:] + [("key0", scores[0] + 0.5)],
+                          key=lambda item: item[1])
+        self.assertEqual(list(inst.items()), expected)
+        for i in range(0, len(expected), 997):
+            self.assertEqual(inst.index(expected[i][0]), i)
+
+    def test_repr(self):
+        inst = self.make({"a": 2.0, "b": 1.0})
+        self.assertEqual(repr(inst), "{'b': 1.0, 'a': 2.0}")
+        self.assertEqual(repr(self.make()), "{}")
+
+    def test_reinit(self):
+        self.assertRaises(RuntimeError, self.skipdict.__init__, {"a": 1.0})
+        self.assertEqual(len(self.skipdict), len(self.items))
+
+
+class SharedTestCase(TestCase):
+    def setUp(self):
+        import os
+        from skipdict import SharedSkipDict
+        self.name = "/skipdict-test-%d-%d" % (os.getpid(), id(self))
+        self.skipdict = SharedSkipDict(self.name, create=True, capacity=64)
+
+    def tearDown(self):
+        self.skipdict.unlink()
+        self.skipdict.close()
+
+    def reader(self):
+        from skipdict import SharedSkipDict
+        return SharedSkipDict(self.name)
+
+    def test_set_get(self):
+        self.skipdict[b"foo"] = 1
+        self.skipdict[42] = 2.5
+        self.assertEqual(self.skipdict[b"foo"], 1.0)
+        self.assertEqual(self.skipdict.get(42), 2.5)
+        self.assertEqual(self.skipdict.get(b"bar", 0), 0)
+        self.assertIn(42, self.skipdict)
+        self.assertNotIn(b"bar", self.skipdict)
+        self.assertRaises(KeyError, lambda: self.skipdict[b"bar"])
+        self.assertEqual(len(self.skipdict), 2)
+
+    def test_order(self):
+        rnd = Random(0)
+        expected = {}
+        for i in range(200):
+            key = rnd.choice((rnd.randrange(-30, 30), b"k%d" % rnd.randrange(30)))
+            if key in expected and rnd.random() < 0.3:
+                del self.skipdict[key]
+                del expected[key]
+            else:
+                expected[key] = float(rnd.randrange(10))
+                self.skipdict[key] = expected[key]
+
+        def order(item):
+            key, score = item
+            return score, isinstance(key, bytes), key
+
+        items = sorted(expected.items(), key=order)
+        self.assertEqual(self.skipdict.items(), items)
+        self.assertEqual(list(self.skipdict), [k for k, v in items])
+        for i, (key, score) in enumerate(items):
+            self.assertEqual(self.skipdict.index(key), i)
+        self.assertEqual(
+            self.skipdict.values(min=3, max=5),
+            [v for k, v in items if 3 <= v <= 5]
+        )
+
+    def test_reversed_range(self):
+        for i in range(6):
+            self.skipdict[i] = float(i)
+        self.assertEqual(self.skipdict.keys(min=3, max=1), [3, 2, 1])
+        self.assertEqual(
+            self.skipdict.items(4, 0),
+            [(i, float(i)) for i in range(4, -1, -1)]
+        )
+        self.assertEqual(self.skipdict.values(min=9, max=6), [])
+
+    def test_stalled_writer(self):
+        import mmap
+        import os
+        import struct
+        path = "/dev/shm" + self.name
+        if not os.path.exists(path):
+            self.skipTest("no /dev/shm")
+        self.skipdict[1] = 1.0
+        reader = self.reader()
+        # Leave the sequence counter odd, as a writer that died in the
+        # middle of an update would.
+        with open(path, "r+b") as f:
+            m = mmap.mmap(f.fileno(), 16)
+            seq, = struct.unpack("=Q", m[8:16])
+            m[8:16] = struct.pack("=Q", seq + 1)
+            try:
+                self.assertRaises(RuntimeError, reader.get, 1)
+                self.assertRaises(RuntimeError, reader.items)
+            finally:
+                m[8:16] = struct.pack("=Q", seq)
+                m.close()
+        self.assertEqual(reader.items(), [(1, 1.0)])
+        reader.close()
+
+    def test_change(self):
+        self.skipdict.change(1, 2.0)
+        self.skipdict.change(1, 3.0)
+        self.assertEqual(self.skipdict[1], 5.0)
+
+    def test_reader(self):
+        self.skipdict[b"foo"] = 1.0
+        reader = self.reader()
+        self.assertFalse(reader.writable)
+        self.assertEqual(reader.items(), [(b"foo", 1.0)])
+        self.skipdict[b"bar"] = 0.5
+        self.assertEqual(reader.keys(), [b"bar", b"foo"])
+        self.assertRaises(TypeError, reader.__setitem__, b"foo", 2.0)
+        reader.close()
+        self.assertRaises(ValueError, len, reader)
+
+    def test_capacity(self):
+        for i in range(64):
+            self.skipdict[i] = float(i)
+        self.assertRaises(MemoryError, self.skipdict.__setitem__, 64, 0.0)
+        del self.skipdict[0]
+        self.skipdict[64] = 0.0
+        self.assertEqual(len(self.skipdict), 64)
+
+    def test_invalid_keys(self):
+        self.assertRaises(TypeError, self.skipdict.__setitem__, u"foo", 1.0)
+        self.assertRaises(ValueError, self.skipdict.__setitem__, b"x" * 33, 1.0)
+        self.assertRaises(OverflowError, self.skipdict.__setitem__, 2 ** 64, 1.0)
+
+    def test_missing_segment(self):
+        from skipdict import SharedSkipDict
+        self.assertRaises(OSError, SharedSkipDict, self.name + "-missing")
+        self.assertRaises(OSError, SharedSkipDict, self.name, create=True)
+
+    def test_concurrent_processes(self):
+        import os
+        import subprocess
+        import sys
+        # A reader process checks that every snapshot is complete and
+        # ordered while we keep moving scores around.
+        for i in range(32):
+            self.skipdict[i] = float(i)
+        script = (
+            "import sys\n"
+            "from skipdict import SharedSkipDict\n"
+            "d = SharedSkipDict(sys.argv[1])\n"
+            "for i in range(2000):\n"
+            "    items = d.items()\n"
+            "    assert len(items) == 32, items\n"
+            "    assert sorted(items, key=lambda i: (i[1], i[0])) == items\n"
+            "    assert sorted(k for k, v in items) == list(range(32))\n"
+        )
+        env = dict(os.environ, PYTHONPATH=os.pathsep.join(sys.path))
+        child = subprocess.Popen(
+            [sys.executable, "-c", script, self.name], env=env
+        )
+        rnd = Random(1)
+        while child.poll() is None:
+            self.skipdict[rnd.randrange(32)] = float(rnd.randrange(64))
+            self.skipdict.change(rnd.randrange(32), 0.5)
+        self.assertEqual(child.returncode, 0)
+
+
+class MultiTestCase(TestCase):
+    def setUp(self):
+        from skipdict import MultiSkipDict
+        self.skipdict = MultiSkipDict(("points", "wins", "seen"))
+
+    def fill(self, n=100):
+        rnd = Random(0)
+        expected = {}
+        for i in range(n):
+            expected[i] = tuple(v + i / 128.0 for v in rnd.sample(range(1000), 3))
+            self.skipdict[i] = expected[i]
+        return expected
+
+    def test_set_get(self):
+        self.skipdict[b"foo"] = (1, 2, 3)
+        self.assertEqual(self.skipdict.fields, ("points", "wins", "seen"))
+        self.assertEqual(self.skipdict[b"foo"], (1.0, 2.0, 3.0))
+        self.assertEqual(self.skipdict.get(b"bar", 0), 0)
+        self.assertIsNone(self.skipdict.get(b"bar"))
+        self.assertEqual(self.skipdict.get(b"foo", 0), (1.0, 2.0, 3.0))
+        self.assertRaises(TypeError, self.skipdict.get, [])
+        self.assertIn(b"foo", self.skipdict)
+        self.assertRaises(KeyError, lambda: self.skipdict[b"bar"])
+        self.assertEqual(list(self.skipdict), [b"foo"])
+        del self.skipdict[b"foo"]
+        self.assertEqual(len(self.skipdict), 0)
+        self.assertEqual(self.skipdict.keys("wins"), [])
+        self.assertRaises(KeyError, self.skipdict.__delitem__, b"foo")
+
+    def test_order(self):
+        expected = self.fill()
+        rnd = Random(1)
+        for i in rnd.sample(range(100), 30):
+            del self.skipdict[i]
+            del expected[i]
+        for i in rnd.sample(sorted(expected), 30):
+            self.skipdict.set(i, wins=rnd.randrange(-500, 500) + i / 128.0)
+            expected[i] = (expected[i][0], self.skipdict[i][1], expected[i][2])
+
+        for f, field in enumerate(self.skipdict.fields):
+            items = sorted(
+                ((k, v[f]) for k, v in expected.items()),
+                key=lambda item: item[1]
+            )
+            self.assertEqual(self.skipdict.items(field), items)
+            self.assertEqual(self.skipdict.keys(field), [k for k, v in items])
+            self.assertEqual(
+                self.skipdict.values(field),
+                [expected[k] for k, v in items]
+            )
+            for i, (key, score) in enumerate(items):
+                self.assertEqual(self.skipdict.index(field, key), i)
+            self.assertEqual(
+                self.skipdict.keys(field, min=200, max=500),
+                [k for k, v in items if 200 <= v <= 500]
+            )
+            self.assertEqual(
+                self.skipdict.keys(field, min=500, max=200),
+                [k for k, v in reversed(items) if 200 <= v <= 500]
+            )
+
+    def test_partial_update(self):
+        self.skipdict[1] = (1, 2, 3)
+        self.skipdict[1] = {"points": 10, "seen": 30}
+        self.assertEqual(self.skipdict[1], (10.0, 2.0, 30.0))
+        self.skipdict.set(1, wins=20)
+        self.assertEqual(self.skipdict[1], (10.0, 20.0, 30.0))
+        self.skipdict.set(1)
+        self.assertEqual(self.skipdict[1], (10.0, 20.0, 30.0))
+
+    def test_atomic(self):
+        self.skipdict[1] = (1, 2, 3)
+        # Nothing changes unless every score converts.
+        self.assertRaises(TypeError, self.skipdict.set, 1, points=5, wins="x")
+        self.assertRaises(KeyError, self.skipdict.set, 1, points=5, level=1)
+        self.assertRaises(ValueError, self.skipdict.__setitem__, 1, (5, 6))
+        self.assertEqual(self.skipdict[1], (1.0, 2.0, 3.0))
+        self.assertEqual(self.skipdict.keys("points", min=5), [])
+        self.assertRaises(ValueError, self.skipdict.set, 2, points=5)
+        self.assertNotIn(2, self.skipdict)
+
+    def test_invalid(self):
+        from skipdict import MultiSkipDict
+        self.assertRaises(ValueError, MultiSkipDict, ())
+        self.assertRaises(ValueError, MultiSkipDict, ("a", "a"))
+        self.assertRaises(KeyError, self.skipdict.keys, "level")
+        self.assertRaises(KeyError, self.skipdict.index, "wins", 1)
+        self.assertRaises(TypeError, self.skipdict.keys, "wins", min="x")
+
+    def test_repr(self):
+        self.assertEqual(repr(self.skipdict), "{}")
+        self.skipdict[1] = (2, 0, 0)
+        self.skipdict[2] = (1, 5, 0)
+        self.assertEqual(repr(self.skipdict),
+                         "{2: (1.0, 5.0, 0.0), 1: (2.0, 0.0, 0.0)}")
+
+    def test_sequence(self):
+        from skipdict import MultiSkipDict
+        skipdict = MultiSkipDict(("a", "b"), {1: (2, 1), 2: (1, 2)})
+        self.assertEqual(skipdict.keys("a"), [2, 1])
+        self.assertEqual(skipdict.keys("b"), [1, 2])
+
+
+class CAPITestCase(FixtureTestCase):
+    # The capsule is meant for compiled extensions; ctypes stands in
+    # for one here.
+    def setUp(self):
+        super(CAPITestCase, self).setUp()
+        import ctypes
+        from ctypes import c_char_p, c_double, c_int, c_ssize_t, c_void_p
+        from ctypes import POINTER, PYFUNCTYPE, Structure, py_object
+        import skipdict
+
+        class API(Structure):
+            _fields_ = [
+                ("SkipDictType", c_void_p),
+                ("Lookup", PYFUNCTYPE(
+                    c_int, py_object, py_object, POINTER(c_double))),
+                ("Set", PYFUNCTYPE(c_int, py_object, py_object, c_double)),
+                ("Change", PYFUNCTYPE(
+                    c_int, py_object, py_object, c_double,
+                    POINTER(c_double))),
+                ("Delete", PYFUNCTYPE(c_int, py_object, py_object)),
+                ("Rank", PYFUNCTYPE(c_ssize_t, py_object, py_object)),
+                ("Count", PYFUNCTYPE(
+                    c_ssize_t, py_object, c_double, c_double)),
+                ("Range", PYFUNCTYPE(
+                    c_int, py_object, c_double, c_double, c_void_p,
+                    c_void_p)),
+            ]
+
+        get = ctypes.pythonapi.PyCapsule_GetPointer
+        get.restype = c_void_p
+        get.argtypes = [py_object, c_char_p]
+        self.api = API.from_address(
+            get(skipdict.skipdict_CAPI, b"skipdict.skipdict_CAPI")
+        )
+        self.visitfunc = PYFUNCTYPE(c_int, py_object, c_double, c_void_p)
+        self.score = c_double()
+        self.pscore = ctypes.pointer(self.score)
+
+    def test_lookup(self):
+        key, value = self.items[3]
+        self.assertEqual(self.api.Lookup(self.skipdict, key, self.pscore), 1)
+        self.assertEqual(self.score.value, value)
+        self.assertEqual(self.api.Lookup(self.skipdict, "foo", self.pscore), 0)
+
+    def test_set_change_delete(self):
+        self.assertEqual(self.api.Set(self.skipdict, "foo", 1.0), 0)
+        self.assertEqual(self.skipdict["foo"], 1.0)
+        self.assertEqual(
+            self.api.Change(self.skipdict, "foo", 1e9, self.pscore), 0
+        )
+        self.assertEqual(self.score.value, 1e9 + 1.0)
+        self.assertEqual(self.skipdict.keys()[-1], "foo")
+        self.assertEqual(self.api.Delete(self.skipdict, "foo"), 1)
+        self.assertEqual(self.api.Delete(self.skipdict, "foo"), 0)
+        self.assertEqual(len(self.skipdict), len(self.items))
+
+    def test_rank_count(self):
+        for i, key in enumerate(self.keys):
+            self.assertEqual(self.api.Rank(self.skipdict, key), i)
+        self.assertRaises(KeyError, self.api.Rank, self.skipdict, "foo")
+        self.assertEqual(
+            self.api.Count(self.skipdict, self.values[13], self.values[25]),
+            13
+        )
+        self.assertEqual(self.api.Count(self.skipdict, 151.0, 152.0), 0)
+
+    def test_range(self):
+        from ctypes import c_void_p, cast
+        visited = []
+
+        def visit(key, score, arg):
+            visited.append(key)
+            return len(visited) == 5
+
+        func = self.visitfunc(visit)
+        self.assertEqual(
+            self.api.Range(self.skipdict, self.values[25], self.values[13],
+                           cast(func, c_void_p), None),
+            1
+        )
+        self.assertEqual(visited, list(reversed(self.keys[21:26])))